@@ -19,21 +19,28 @@
     MA 02110-1301 USA.
 */
 
+#include <sys/eventfd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
 #include "access.h"
 #include "sensors.h"
 #include "data.h"
 #include "error.h"
 #include "sysfs.h"
+#include "expr.h"
+#include "batch.h"
 
 /* We watch the recursion depth for variables only, as an easy way to
    detect cycles. */
 #define DEPTH_MAX	8
 
-static int sensors_eval_expr(const sensors_chip_features *chip_features,
-			     const sensors_expr *expr,
+/* Expressions needing a larger stack get it allocated */
+#define STACK_LOCAL	16
+
+static int sensors_eval_prog(const sensors_chip_features *chip_features,
+			     const sensors_prog *prog,
 			     double val, int depth, double *result);
 
 /* Compare two chips name descriptions, to see whether they could match.
@@ -96,11 +103,19 @@ sensors_for_all_config_chips(const sensors_chip_name *name,
 static const sensors_chip_features *
 sensors_lookup_chip(const sensors_chip_name *name)
 {
+	sensors_chip_features *chip;
 	int i;
 
+	/* Fast path: most callers pass a chip name which was returned by
+	   sensors_get_detected_chips(), which points into our own list */
+	if ((chip = sensors_find_proc_chip(name)))
+		return sensors_discover_chip(chip) ? chip : NULL;
+
+	/* The features of a chip are only read once it is needed */
 	for (i = 0; i < sensors_proc_chips_count; i++)
-		if (sensors_match_chip(&sensors_proc_chips[i].chip, name))
-			return &sensors_proc_chips[i];
+		if (sensors_match_chip(&sensors_proc_chips[i]->chip, name) &&
+		    sensors_discover_chip(sensors_proc_chips[i]))
+			return sensors_proc_chips[i];
 
 	return NULL;
 }
@@ -118,28 +133,22 @@ sensors_lookup_subfeature_nr(const sensors_chip_features *chip,
 	return chip->subfeature + subfeat_nr;
 }
 
-/* Look up a feature of the given chip, and return a pointer to it.
-   Do not modify the struct the return value points to! Returns NULL if
-   not found.*/
-static const sensors_feature *
-sensors_lookup_feature_nr(const sensors_chip_features *chip, int feat_nr)
-{
-	if (feat_nr < 0 ||
-	    feat_nr >= chip->feature_count)
-		return NULL;
-	return chip->feature + feat_nr;
-}
-
 /* Look up a subfeature by name, and return a pointer to it.
    Do not modify the struct the return value points to! Returns NULL if 
    not found.*/
-static const sensors_subfeature *
+const sensors_subfeature *
 sensors_lookup_subfeature_name(const sensors_chip_features *chip,
 			       const char *name)
 {
+	unsigned int h, mask;
 	int j;
 
-	for (j = 0; j < chip->subfeature_count; j++)
+	if (!chip->subfeature_hash)
+		return NULL;
+
+	mask = chip->subfeature_hash_size - 1;
+	for (h = sensors_hash_string(name);
+	     (j = chip->subfeature_hash[h & mask]) >= 0; h++)
 		if (!strcmp(chip->subfeature[j].name, name))
 			return chip->subfeature + j;
 	return NULL;
@@ -159,6 +168,34 @@ int sensors_chip_name_has_wildcards(const sensors_chip_name *chip)
 		return 0;
 }
 
+/* Look up a feature by name, and return its number. Returns -1 if not
+   found. */
+static int sensors_lookup_feature_name(const sensors_chip_features *chip,
+				       const char *name)
+{
+	int j;
+
+	for (j = 0; j < chip->feature_count; j++)
+		if (!strcmp(chip->feature[j].name, name))
+			return j;
+	return -1;
+}
+
+/* Return the resolved configuration of a feature of a detected chip, or
+   NULL if it isn't available (feature not belonging to this chip, or
+   configuration not resolved yet). */
+static const sensors_feature_config *
+sensors_lookup_feature_config(const sensors_chip_features *chip_features,
+			      const sensors_feature *feature)
+{
+	if (!chip_features || !chip_features->feature_config ||
+	    feature->number < 0 ||
+	    feature->number >= chip_features->feature_count ||
+	    feature != &chip_features->feature[feature->number])
+		return NULL;
+	return &chip_features->feature_config[feature->number];
+}
+
 /* Look up the label for a given feature. Note that chip should not
    contain wildcard values! The returned string is newly allocated (free it
    yourself). On failure, NULL is returned.
@@ -166,21 +203,33 @@ int sensors_chip_name_has_wildcards(const sensors_chip_name *chip)
 char *sensors_get_label(const sensors_chip_name *name,
 			const sensors_feature *feature)
 {
-	char *label;
+	const char *label;
+	const sensors_feature_config *config;
 	const sensors_chip *chip;
-	char buf[PATH_MAX];
+	char buf[PATH_MAX], *res;
 	FILE *f;
 	int i;
 
 	if (sensors_chip_name_has_wildcards(name))
 		return NULL;
 
-	for (chip = NULL; (chip = sensors_for_all_config_chips(name, chip));)
-		for (i = 0; i < chip->labels_count; i++)
-			if (!strcmp(feature->name, chip->labels[i].name)) {
-				label = chip->labels[i].value;
-				goto sensors_get_label_exit;
-			}
+	config = sensors_lookup_feature_config(sensors_lookup_chip(name),
+					       feature);
+	if (config) {
+		if (config->label) {
+			label = config->label;
+			goto sensors_get_label_exit;
+		}
+	} else {
+		for (chip = NULL;
+		     (chip = sensors_for_all_config_chips(name, chip));)
+			for (i = 0; i < chip->labels_count; i++)
+				if (!strcmp(feature->name,
+					    chip->labels[i].name)) {
+					label = chip->labels[i].value;
+					goto sensors_get_label_exit;
+				}
+	}
 
 	/* No user specified label, check for a _label sysfs file */
 	snprintf(buf, PATH_MAX, "%s/%s_label", name->path, feature->name);
@@ -200,20 +249,26 @@ char *sensors_get_label(const sensors_chip_name *name,
 	label = feature->name;
 	
 sensors_get_label_exit:
-	label = strdup(label);
-	if (!label)
+	res = strdup(label);
+	if (!res)
 		sensors_fatal_error(__func__, "Allocating label text");
-	return label;
+	return res;
 }
 
 /* Looks up whether a feature should be ignored. Returns
    1 if it should be ignored, 0 if not. */
-static int sensors_get_ignored(const sensors_chip_name *name,
+static int sensors_get_ignored(const sensors_chip_features *chip_features,
+			       const sensors_chip_name *name,
 			       const sensors_feature *feature)
 {
+	const sensors_feature_config *config;
 	const sensors_chip *chip;
 	int i;
 
+	config = sensors_lookup_feature_config(chip_features, feature);
+	if (config)
+		return config->ignored;
+
 	for (chip = NULL; (chip = sensors_for_all_config_chips(name, chip));)
 		for (i = 0; i < chip->ignores_count; i++)
 			if (!strcmp(feature->name, chip->ignores[i].name))
@@ -221,78 +276,223 @@ static int sensors_get_ignored(const sensors_chip_name *name,
 	return 0;
 }
 
-/* Read the value of a subfeature of a certain chip. Note that chip should not
-   contain wildcard values! This function will return 0 on success, and <0
-   on failure. */
-static int __sensors_get_value(const sensors_chip_name *name, int subfeat_nr,
-			       int depth, double *result)
+/* Resolve the configuration statements applying to every feature of a
+   detected chip, so that this doesn't have to be done each time a value
+   is accessed. The matching configuration chips are recorded, latest
+   first, and compute expressions are compiled at this point. */
+void sensors_resolve_chip_config(sensors_chip_features *chip_features)
 {
-	const sensors_chip_features *chip_features;
-	const sensors_subfeature *subfeature;
-	const sensors_expr *expr = NULL;
-	double val;
-	int res, i;
+	sensors_feature_config *config;
+	sensors_chip *chip, *maxage = NULL;
+	int j, k, f;
+
+	config = calloc(chip_features->feature_count,
+			sizeof(sensors_feature_config));
+	if (!config)
+		sensors_fatal_error(__func__, "Out of memory");
+
+	for (chip = NULL;
+	     (chip = sensors_for_all_config_chips(&chip_features->chip,
+						  chip));)
+		sensors_add_array_el(&chip,
+				     &chip_features->config_chips,
+				     &chip_features->config_chips_count,
+				     &chip_features->config_chips_max,
+				     sizeof(sensors_chip *));
+
+	/* Latest statements first, the first match wins */
+	for (k = 0; k < chip_features->config_chips_count; k++) {
+		chip = chip_features->config_chips[k];
+
+		for (j = 0; j < chip->labels_count; j++) {
+			f = sensors_lookup_feature_name(chip_features,
+						chip->labels[j].name);
+			if (f >= 0 && !config[f].label)
+				config[f].label = chip->labels[j].value;
+		}
 
-	if (depth >= DEPTH_MAX)
-		return -SENSORS_ERR_RECURSION;
-	if (sensors_chip_name_has_wildcards(name))
-		return -SENSORS_ERR_WILDCARDS;
-	if (!(chip_features = sensors_lookup_chip(name)))
-		return -SENSORS_ERR_NO_ENTRY;
-	if (!(subfeature = sensors_lookup_subfeature_nr(chip_features,
-							subfeat_nr)))
-		return -SENSORS_ERR_NO_ENTRY;
-	if (!(subfeature->flags & SENSORS_MODE_R))
-		return -SENSORS_ERR_ACCESS_R;
+		for (j = 0; j < chip->ignores_count; j++) {
+			f = sensors_lookup_feature_name(chip_features,
+						chip->ignores[j].name);
+			if (f >= 0)
+				config[f].ignored = 1;
+		}
 
-	/* Apply compute statement if it exists */
-	if (subfeature->flags & SENSORS_COMPUTE_MAPPING) {
-		const sensors_feature *feature;
-		const sensors_chip *chip;
+		for (j = 0; j < chip->computes_count; j++) {
+			f = sensors_lookup_feature_name(chip_features,
+						chip->computes[j].name);
+			if (f < 0 || config[f].from_proc)
+				continue;
+			config[f].from_proc =
+				sensors_compile_expr(chip_features,
+					chip->computes[j].from_proc);
+			config[f].to_proc =
+				sensors_compile_expr(chip_features,
+					chip->computes[j].to_proc);
+		}
 
-		feature = sensors_lookup_feature_nr(chip_features,
-					subfeature->mapping);
+		if (!maxage && chip->maxage >= 0)
+			maxage = chip;
+	}
+	chip_features->feature_config = config;
 
-		chip = NULL;
-		while (!expr &&
-		       (chip = sensors_for_all_config_chips(name, chip)))
-			for (i = 0; i < chip->computes_count; i++) {
-				if (!strcmp(feature->name,
-					    chip->computes[i].name)) {
-					expr = chip->computes[i].from_proc;
-					break;
-				}
-			}
+	if (maxage)
+		sensors_init_value_cache(chip_features, maxage->maxage,
+					 maxage->maxage_auto);
+}
+
+void sensors_resolve_config(void)
+{
+	int i;
+
+	/* The others are resolved when discovered */
+	for (i = 0; i < sensors_proc_chips_count; i++)
+		if (sensors_proc_chips[i]->discovered)
+			sensors_resolve_chip_config(sensors_proc_chips[i]);
+}
+
+/* Free the resolved configuration of a chip */
+void sensors_free_feature_config(sensors_chip_features *chip_features)
+{
+	int i;
+
+	if (chip_features->value_cache) {
+		free(chip_features->value_cache->values);
+		free(chip_features->value_cache);
+		chip_features->value_cache = NULL;
+	}
+
+	if (!chip_features->feature_config)
+		return;
+
+	for (i = 0; i < chip_features->feature_count; i++) {
+		sensors_free_prog(chip_features->feature_config[i].from_proc);
+		sensors_free_prog(chip_features->feature_config[i].to_proc);
 	}
+	free(chip_features->feature_config);
+	chip_features->feature_config = NULL;
+
+	free(chip_features->config_chips);
+	chip_features->config_chips = NULL;
+	chip_features->config_chips_count = chip_features->config_chips_max = 0;
+}
+
+/* Return the compiled from_proc (if to_proc is 0) or to_proc expression
+   applying to a subfeature, or NULL if there is none. */
+static const sensors_prog *
+sensors_get_compute(const sensors_chip_features *chip_features,
+		    const sensors_subfeature *subfeature, int to_proc)
+{
+	const sensors_feature_config *config;
+
+	if (!(subfeature->flags & SENSORS_COMPUTE_MAPPING) ||
+	    !chip_features->feature_config)
+		return NULL;
+
+	config = &chip_features->feature_config[subfeature->mapping];
+	return to_proc ? config->to_proc : config->from_proc;
+}
+
+/* Read the value of a subfeature and apply the given compute expression
+   (if not NULL) to it. This function will return 0 on success, and <0 on
+   failure. */
+static int sensors_read_value(const sensors_chip_features *chip_features,
+			      const sensors_subfeature *subfeature,
+			      const sensors_prog *expr, int depth,
+			      double *result)
+{
+	double val;
+	int res;
+
+	if (!(subfeature->flags & SENSORS_MODE_R))
+		return -SENSORS_ERR_ACCESS_R;
 
-	res = sensors_read_sysfs_attr(name, subfeature, &val);
+	res = sensors_read_sysfs_attr(chip_features, subfeature, &val);
 	if (res)
 		return res;
 	if (!expr)
 		*result = val;
-	else if ((res = sensors_eval_expr(chip_features, expr, val, depth,
+	else if ((res = sensors_eval_prog(chip_features, expr, val, depth,
 					  result)))
 		return res;
 	return 0;
 }
 
+/* Read the value of a subfeature of a known chip, applying its compute
+   statement if it exists. This function will return 0 on success, and <0
+   on failure. */
+static int sensors_get_subfeature_value(const sensors_chip_features
+					*chip_features,
+					const sensors_subfeature *subfeature,
+					int depth, double *result)
+{
+	if (depth >= DEPTH_MAX)
+		return -SENSORS_ERR_RECURSION;
+
+	return sensors_read_value(chip_features, subfeature,
+				  sensors_get_compute(chip_features,
+						      subfeature, 0),
+				  depth, result);
+}
+
 int sensors_get_value(const sensors_chip_name *name, int subfeat_nr,
 		      double *result)
 {
-	return __sensors_get_value(name, subfeat_nr, 0, result);
+	const sensors_chip_features *chip_features;
+	const sensors_subfeature *subfeature;
+
+	if (sensors_chip_name_has_wildcards(name))
+		return -SENSORS_ERR_WILDCARDS;
+	if (!(chip_features = sensors_lookup_chip(name)))
+		return -SENSORS_ERR_NO_ENTRY;
+	if (!(subfeature = sensors_lookup_subfeature_nr(chip_features,
+							subfeat_nr)))
+		return -SENSORS_ERR_NO_ENTRY;
+
+	return sensors_get_subfeature_value(chip_features, subfeature, 0,
+					    result);
 }
 
-/* Set the value of a subfeature of a certain chip. Note that chip should not
-   contain wildcard values! This function will return 0 on success, and <0
-   on failure. */
-int sensors_set_value(const sensors_chip_name *name, int subfeat_nr,
-		      double value)
+/* Read the values of several subfeatures of a chip at once. Note that chip
+   should not contain wildcard values! The chip is only looked up once for
+   the whole batch. */
+int sensors_get_values(const sensors_chip_name *name, const int *subfeat_nr,
+		       int count, double *values, int *errors)
 {
 	const sensors_chip_features *chip_features;
 	const sensors_subfeature *subfeature;
-	const sensors_expr *expr = NULL;
 	int i, res;
-	double to_write;
+
+	if (sensors_chip_name_has_wildcards(name))
+		return -SENSORS_ERR_WILDCARDS;
+	if (!(chip_features = sensors_lookup_chip(name)))
+		return -SENSORS_ERR_NO_ENTRY;
+
+	if (!subfeat_nr && count > chip_features->subfeature_count)
+		count = chip_features->subfeature_count;
+
+	for (i = 0; i < count; i++) {
+		subfeature = sensors_lookup_subfeature_nr(chip_features,
+						subfeat_nr ? subfeat_nr[i] : i);
+		if (!subfeature)
+			res = -SENSORS_ERR_NO_ENTRY;
+		else
+			res = sensors_read_value(chip_features, subfeature,
+					sensors_get_compute(chip_features,
+							    subfeature, 0),
+					0, &values[i]);
+		if (errors)
+			errors[i] = res;
+	}
+
+	return subfeat_nr ? count : chip_features->subfeature_count;
+}
+
+int sensors_get_value_raw(const sensors_chip_name *name, int subfeat_nr,
+			  long long *value, int *scale)
+{
+	const sensors_chip_features *chip_features;
+	const sensors_subfeature *subfeature;
 
 	if (sensors_chip_name_has_wildcards(name))
 		return -SENSORS_ERR_WILDCARDS;
@@ -301,46 +501,283 @@ int sensors_set_value(const sensors_chip_name *name, int subfeat_nr,
 	if (!(subfeature = sensors_lookup_subfeature_nr(chip_features,
 							subfeat_nr)))
 		return -SENSORS_ERR_NO_ENTRY;
-	if (!(subfeature->flags & SENSORS_MODE_W))
-		return -SENSORS_ERR_ACCESS_W;
+	if (!(subfeature->flags & SENSORS_MODE_R))
+		return -SENSORS_ERR_ACCESS_R;
 
-	/* Apply compute statement if it exists */
-	if (subfeature->flags & SENSORS_COMPUTE_MAPPING) {
-		const sensors_feature *feature;
-		const sensors_chip *chip;
+	*scale = -chip_features->subfeature_scale[subfeat_nr];
+	return sensors_read_sysfs_attr_raw(chip_features, subfeature, value);
+}
 
-		feature = sensors_lookup_feature_nr(chip_features,
-					subfeature->mapping);
+/* A single divisor for the whole array, so that the loop has no branch and
+   the compiler is free to vectorize it. Dividing rather than multiplying
+   by the inverse gives the same values as sensors_get_value(). */
+void sensors_scale_values(const long long *raw, int scale, double *values,
+			  int count)
+{
+	double factor = 1;
+	int i;
 
-		chip = NULL;
-		while (!expr &&
-		       (chip = sensors_for_all_config_chips(name, chip)))
-			for (i = 0; i < chip->computes_count; i++) {
-				if (!strcmp(feature->name,
-					    chip->computes[i].name)) {
-					expr = chip->computes[i].to_proc;
-					break;
-				}
-			}
+	for (i = scale; i < 0; i++)
+		factor *= 10;
+	for (i = scale; i > 0; i--)
+		factor /= 10;
+
+	for (i = 0; i < count; i++)
+		values[i] = raw[i] / factor;
+}
+
+int sensors_submit_reads(sensors_read_request *requests, int count,
+			 sensors_read_batch **batch)
+{
+	struct sensors_read_batch *b;
+	struct sensors_batch_entry *entry;
+	int i;
+
+	if (!(b = calloc(1, sizeof(*b))) ||
+	    !(b->entries = calloc(count ? count : 1, sizeof(*b->entries))))
+		sensors_fatal_error(__func__, "Out of memory");
+	b->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (b->event_fd < 0) {
+		free(b->entries);
+		free(b);
+		return -SENSORS_ERR_KERNEL;
+	}
+	b->requests = requests;
+	b->count = count;
+
+	for (i = 0; i < count; i++) {
+		entry = &b->entries[i];
+		entry->read.fd = -1;
+		requests[i].error = 0;
+
+		if (sensors_chip_name_has_wildcards(requests[i].name)) {
+			requests[i].error = -SENSORS_ERR_WILDCARDS;
+			continue;
+		}
+		if (!(entry->chip = sensors_lookup_chip(requests[i].name)) ||
+		    !(entry->subfeature =
+		      sensors_lookup_subfeature_nr(entry->chip,
+						   requests[i].subfeat_nr))) {
+			requests[i].error = -SENSORS_ERR_NO_ENTRY;
+			continue;
+		}
+		if (!(entry->subfeature->flags & SENSORS_MODE_R)) {
+			requests[i].error = -SENSORS_ERR_ACCESS_R;
+			continue;
+		}
+		requests[i].error = sensors_open_sysfs_read(entry->chip,
+							    entry->subfeature,
+							    &entry->read,
+							    &entry->value);
+		if (requests[i].error > 0) {
+			entry->cached = 1;
+			requests[i].error = 0;
+		}
+	}
+
+	sensors_start_batch(b);
+	*batch = b;
+	return 0;
+}
+
+int sensors_get_batch_fd(const sensors_read_batch *batch)
+{
+	return batch->event_fd;
+}
+
+int sensors_complete_reads(sensors_read_batch *batch)
+{
+	struct sensors_batch_entry *entry;
+	sensors_read_request *request;
+	const sensors_prog *expr;
+	double val;
+	int i, failed = 0;
+
+	sensors_wait_batch(batch);
+
+	/* The compute statements may read other subfeatures, so they are
+	   only evaluated now, in the calling thread */
+	for (i = 0; i < batch->count; i++) {
+		entry = &batch->entries[i];
+		request = &batch->requests[i];
+		if (entry->read.fd >= 0 || entry->cached) {
+			val = entry->value;
+			if (!entry->cached)
+				request->error =
+					sensors_finish_sysfs_read(entry->chip,
+							entry->subfeature,
+							&entry->read, &val);
+			expr = sensors_get_compute(entry->chip,
+						   entry->subfeature, 0);
+			if (!request->error && !expr)
+				request->value = val;
+			else if (!request->error)
+				request->error =
+					sensors_eval_prog(entry->chip, expr,
+							  val, 0,
+							  &request->value);
+		}
+		if (request->error)
+			failed++;
+	}
+
+	close(batch->event_fd);
+	free(batch->entries);
+	free(batch);
+	return failed;
+}
+
+int sensors_get_stats(const sensors_chip_name *name, int subfeat_nr,
+		      sensors_subfeature_stats *stats)
+{
+	const sensors_chip_features *chip_features;
+	const sensors_subfeature *subfeature;
+	const unsigned long long *from;
+	unsigned long long *to;
+	size_t i;
+
+	if (sensors_chip_name_has_wildcards(name))
+		return -SENSORS_ERR_WILDCARDS;
+	if (!(chip_features = sensors_lookup_chip(name)) ||
+	    !(subfeature = sensors_lookup_subfeature_nr(chip_features,
+							subfeat_nr)))
+		return -SENSORS_ERR_NO_ENTRY;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!chip_features->subfeature_stats)
+		return 0;
+
+	/* Other threads may be recording, the statistics are only made of
+	   counters which they update atomically */
+	from = (const unsigned long long *)
+	       &chip_features->subfeature_stats[subfeature->number];
+	to = (unsigned long long *) stats;
+	for (i = 0; i < sizeof(*stats) / sizeof(*to); i++)
+		to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* Look up a subfeature which can be polled: it must be readable, and have
+   no compute mapping (bit 7 of its type set), as alarms and faults */
+static const sensors_subfeature *
+sensors_lookup_poll_subfeature(const sensors_chip_name *name, int subfeat_nr,
+			       const sensors_chip_features **chip_features,
+			       int *err)
+{
+	const sensors_subfeature *subfeature;
+
+	*err = 0;
+	if (sensors_chip_name_has_wildcards(name)) {
+		*err = -SENSORS_ERR_WILDCARDS;
+		return NULL;
+	}
+	if (!(*chip_features = sensors_lookup_chip(name)) ||
+	    !(subfeature = sensors_lookup_subfeature_nr(*chip_features,
+							subfeat_nr)) ||
+	    !(subfeature->type & 0x80)) {
+		*err = -SENSORS_ERR_NO_ENTRY;
+		return NULL;
+	}
+	if (!(subfeature->flags & SENSORS_MODE_R)) {
+		*err = -SENSORS_ERR_ACCESS_R;
+		return NULL;
 	}
+	return subfeature;
+}
+
+/* Open a file descriptor to poll for changes of an alarm or fault
+   subfeature. Note that chip should not contain wildcard values! Returns
+   the file descriptor, or <0 on error. */
+int sensors_open_poll(const sensors_chip_name *name, int subfeat_nr,
+		      double *value)
+{
+	const sensors_chip_features *chip_features;
+	const sensors_subfeature *subfeature;
+	int err;
+
+	subfeature = sensors_lookup_poll_subfeature(name, subfeat_nr,
+						    &chip_features, &err);
+	if (!subfeature)
+		return err;
+
+	return sensors_open_sysfs_poll(chip_features, subfeature, value);
+}
+
+/* Read the value of a subfeature from a file descriptor returned by
+   sensors_open_poll(), after it was signaled. Returns 0 on success, <0 on
+   failure. */
+int sensors_read_poll(const sensors_chip_name *name, int subfeat_nr, int fd,
+		      double *value)
+{
+	const sensors_chip_features *chip_features;
+	const sensors_subfeature *subfeature;
+	int err;
+
+	subfeature = sensors_lookup_poll_subfeature(name, subfeat_nr,
+						    &chip_features, &err);
+	if (!subfeature)
+		return err;
+
+	return sensors_read_sysfs_poll(chip_features, fd, subfeature, value);
+}
+
+/* Apply the compute statement of a subfeature if any, and write the result.
+   With only_changed set, the write is skipped if the attribute already
+   holds that value. */
+static int sensors_set_subfeature(const sensors_chip_features *chip_features,
+				  const sensors_subfeature *subfeature,
+				  double value, int only_changed)
+{
+	const sensors_prog *expr;
+	int res;
+	double to_write;
+
+	if (!(subfeature->flags & SENSORS_MODE_W))
+		return -SENSORS_ERR_ACCESS_W;
+
+	/* Apply compute statement if it exists */
+	expr = sensors_get_compute(chip_features, subfeature, 1);
 
 	to_write = value;
 	if (expr)
-		if ((res = sensors_eval_expr(chip_features, expr,
+		if ((res = sensors_eval_prog(chip_features, expr,
 					     value, 0, &to_write)))
 			return res;
-	return sensors_write_sysfs_attr(name, subfeature, to_write);
+	return sensors_write_sysfs_attr(chip_features, subfeature, to_write,
+					only_changed);
+}
+
+/* Set the value of a subfeature of a certain chip. Note that chip should not
+   contain wildcard values! This function will return 0 on success, and <0
+   on failure. */
+int sensors_set_value(const sensors_chip_name *name, int subfeat_nr,
+		      double value)
+{
+	const sensors_chip_features *chip_features;
+	const sensors_subfeature *subfeature;
+
+	if (sensors_chip_name_has_wildcards(name))
+		return -SENSORS_ERR_WILDCARDS;
+	if (!(chip_features = sensors_lookup_chip(name)))
+		return -SENSORS_ERR_NO_ENTRY;
+	if (!(subfeature = sensors_lookup_subfeature_nr(chip_features,
+							subfeat_nr)))
+		return -SENSORS_ERR_NO_ENTRY;
+
+	return sensors_set_subfeature(chip_features, subfeature, value, 0);
 }
 
 const sensors_chip_name *sensors_get_detected_chips(const sensors_chip_name
 						    *match, int *nr)
 {
-	const sensors_chip_name *res;
+	sensors_chip_features *chip;
 
+	/* Chips without any subfeature once discovered are skipped */
 	while (*nr < sensors_proc_chips_count) {
-		res = &sensors_proc_chips[(*nr)++].chip;
-		if (!match || sensors_match_chip(res, match))
-			return res;
+		chip = sensors_proc_chips[(*nr)++];
+		if ((!match || sensors_match_chip(&chip->chip, match)) &&
+		    sensors_discover_chip(chip))
+			return &chip->chip;
 	}
 	return NULL;
 }
@@ -390,7 +827,7 @@ sensors_get_features(const sensors_chip_name *name, int *nr)
 		return NULL;	/* No such chip */
 
 	while (*nr < chip->feature_count
-	    && sensors_get_ignored(name, &chip->feature[*nr]))
+	    && sensors_get_ignored(chip, name, &chip->feature[*nr]))
 		(*nr)++;
 	if (*nr >= chip->feature_count)
 		return NULL;
@@ -438,66 +875,84 @@ sensors_get_subfeature(const sensors_chip_name *name,
 	return NULL;	/* No such subfeature */
 }
 
-/* Evaluate an expression */
-static int sensors_eval_expr(const sensors_chip_features *chip_features,
-			     const sensors_expr *expr,
+/* Evaluate a compiled expression */
+static int sensors_eval_prog(const sensors_chip_features *chip_features,
+			     const sensors_prog *prog,
 			     double val, int depth, double *result)
 {
-	double res1, res2;
-	int res;
-	const sensors_subfeature *subfeature;
+	double local[STACK_LOCAL], *stack = local, *sp;
+	const sensors_insn *insn, *end;
+	int res = 0;
 
-	if (expr->kind == sensors_kind_val) {
-		*result = expr->data.val;
-		return 0;
+	if (prog->stack_size > STACK_LOCAL) {
+		stack = malloc(prog->stack_size * sizeof(double));
+		if (!stack)
+			sensors_fatal_error(__func__, "Out of memory");
 	}
-	if (expr->kind == sensors_kind_source) {
-		*result = val;
-		return 0;
-	}
-	if (expr->kind == sensors_kind_var) {
-		if (!(subfeature = sensors_lookup_subfeature_name(chip_features,
-							    expr->data.var)))
-			return -SENSORS_ERR_NO_ENTRY;
-		return __sensors_get_value(&chip_features->chip,
-					   subfeature->number, depth + 1,
-					   result);
-	}
-	if ((res = sensors_eval_expr(chip_features, expr->data.subexpr.sub1,
-				     val, depth, &res1)))
-		return res;
-	if (expr->data.subexpr.sub2 &&
-	    (res = sensors_eval_expr(chip_features, expr->data.subexpr.sub2,
-				     val, depth, &res2)))
-		return res;
-	switch (expr->data.subexpr.op) {
-	case sensors_add:
-		*result = res1 + res2;
-		return 0;
-	case sensors_sub:
-		*result = res1 - res2;
-		return 0;
-	case sensors_multiply:
-		*result = res1 * res2;
-		return 0;
-	case sensors_divide:
-		if (res2 == 0.0)
-			return -SENSORS_ERR_DIV_ZERO;
-		*result = res1 / res2;
-		return 0;
-	case sensors_negate:
-		*result = -res1;
-		return 0;
-	case sensors_exp:
-		*result = exp(res1);
-		return 0;
-	case sensors_log:
-		if (res1 < 0.0)
-			return -SENSORS_ERR_DIV_ZERO;
-		*result = log(res1);
-		return 0;
+
+	sp = stack;
+	end = prog->insn + prog->insn_count;
+	for (insn = prog->insn; insn < end; insn++) {
+		switch (insn->code) {
+		case sensors_insn_val:
+			*sp++ = insn->data.val;
+			break;
+		case sensors_insn_source:
+			*sp++ = val;
+			break;
+		case sensors_insn_var:
+			if (insn->data.subfeat_nr < 0) {
+				res = -SENSORS_ERR_NO_ENTRY;
+				goto exit_free;
+			}
+			res = sensors_get_subfeature_value(chip_features,
+				&chip_features->subfeature[insn->data.subfeat_nr],
+				depth + 1, sp);
+			if (res)
+				goto exit_free;
+			sp++;
+			break;
+		case sensors_insn_add:
+			sp--;
+			sp[-1] += sp[0];
+			break;
+		case sensors_insn_sub:
+			sp--;
+			sp[-1] -= sp[0];
+			break;
+		case sensors_insn_multiply:
+			sp--;
+			sp[-1] *= sp[0];
+			break;
+		case sensors_insn_divide:
+			sp--;
+			if (sp[0] == 0.0) {
+				res = -SENSORS_ERR_DIV_ZERO;
+				goto exit_free;
+			}
+			sp[-1] /= sp[0];
+			break;
+		case sensors_insn_negate:
+			sp[-1] = -sp[-1];
+			break;
+		case sensors_insn_exp:
+			sp[-1] = exp(sp[-1]);
+			break;
+		case sensors_insn_log:
+			if (sp[-1] < 0.0) {
+				res = -SENSORS_ERR_DIV_ZERO;
+				goto exit_free;
+			}
+			sp[-1] = log(sp[-1]);
+			break;
+		}
 	}
-	return 0;
+	*result = stack[0];
+
+exit_free:
+	if (stack != local)
+		free(stack);
+	return res;
 }
 
 /* Execute all set statements for this particular chip. The chip may not 
@@ -507,14 +962,16 @@ static int sensors_do_this_chip_sets(const sensors_chip_name *name)
 {
 	const sensors_chip_features *chip_features;
 	sensors_chip *chip;
+	sensors_prog *prog;
 	double value;
-	int i;
+	int i, j;
 	int err = 0, res;
 	const sensors_subfeature *subfeature;
 
 	chip_features = sensors_lookup_chip(name);	/* Can't fail */
 
-	for (chip = NULL; (chip = sensors_for_all_config_chips(name, chip));)
+	for (j = 0; j < chip_features->config_chips_count; j++) {
+		chip = chip_features->config_chips[j];
 		for (i = 0; i < chip->sets_count; i++) {
 			subfeature = sensors_lookup_subfeature_name(chip_features,
 							chip->sets[i].name);
@@ -526,9 +983,11 @@ static int sensors_do_this_chip_sets(const sensors_chip_name *name)
 				continue;
 			}
 
-			res = sensors_eval_expr(chip_features,
-						chip->sets[i].value, 0,
-						0, &value);
+			prog = sensors_compile_expr(chip_features,
+						    chip->sets[i].value);
+			res = sensors_eval_prog(chip_features, prog, 0, 0,
+						&value);
+			sensors_free_prog(prog);
 			if (res) {
 				sensors_parse_error_wfn("Error parsing expression",
 						    chip->sets[i].line.filename,
@@ -536,8 +995,10 @@ static int sensors_do_this_chip_sets(const sensors_chip_name *name)
 				err = res;
 				continue;
 			}
-			if ((res = sensors_set_value(name, subfeature->number,
-						     value))) {
+			/* Only write the values which differ */
+			if ((res = sensors_set_subfeature(chip_features,
+							  subfeature, value,
+							  1))) {
 				sensors_parse_error_wfn("Failed to set value",
 						chip->sets[i].line.filename,
 						chip->sets[i].line.lineno);
@@ -545,6 +1006,7 @@ static int sensors_do_this_chip_sets(const sensors_chip_name *name)
 				continue;
 			}
 		}
+	}
 	return err;
 }
 
@@ -30,4 +30,21 @@
    if there are wildcards. */
 int sensors_chip_name_has_wildcards(const sensors_chip_name *chip);
 
+/* Look up a subfeature by name, and return a pointer to it.
+   Do not modify the struct the return value points to! Returns NULL if
+   not found.*/
+const sensors_subfeature *
+sensors_lookup_subfeature_name(const sensors_chip_features *chip,
+			       const char *name);
+
+/* Resolve the configuration statements applying to the features of the
+   detected chips. Must be called once the configuration is loaded. */
+void sensors_resolve_config(void);
+
+/* Same for a single detected chip */
+void sensors_resolve_chip_config(sensors_chip_features *chip_features);
+
+/* Free the resolved configuration of a chip */
+void sensors_free_feature_config(sensors_chip_features *chip_features);
+
 #endif /* def LIB_SENSORS_ACCESS_H */
@@ -0,0 +1,350 @@
+/*
+    batch.c - Part of libsensors, a Linux library for reading sensor data.
+    Copyright (C) 2026  lm-sensors contributors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "sensors.h"
+#include "data.h"
+#include "error.h"
+#include "sysfs.h"
+#include "batch.h"
+
+/* Most drivers sleep on a bus transaction while reading, so the number of
+   worker threads doesn't depend on the number of processors */
+#define MAX_BATCH_THREADS	16
+
+/* io_uring is used through the raw system calls, not liburing. Reading
+   needs IORING_OP_READ, from Linux 5.6, which came with
+   IORING_FEAT_RW_CUR_POS. */
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_RW_CUR_POS
+#define HAVE_IO_URING
+#endif
+#endif
+
+static void batch_signal(struct sensors_read_batch *batch)
+{
+	uint64_t one = 1;
+
+	while (write(batch->event_fd, &one, sizeof(one)) < 0 &&
+	       errno == EINTR)
+		;
+}
+
+/* Read an attribute file synchronously */
+static void batch_read(struct sensors_sysfs_read *read)
+{
+	ssize_t len;
+
+	len = pread(read->fd, read->buf, sizeof(read->buf) - 1, 0);
+	read->len = len < 0 ? -errno : len;
+}
+
+#ifdef HAVE_IO_URING
+
+struct sensors_uring {
+	int fd;
+	void *ring;
+	size_t ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned *sq_tail, *sq_array;
+	unsigned *cq_head, *cq_tail, cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned submitted;	/* completions to wait for */
+	uint64_t one;		/* written to event_fd */
+};
+
+static void uring_free(struct sensors_uring *uring)
+{
+	if (uring->sqes)
+		munmap(uring->sqes, uring->sqes_size);
+	if (uring->ring)
+		munmap(uring->ring, uring->ring_size);
+	close(uring->fd);
+	free(uring);
+}
+
+/* Set up a ring for entries requests. Returns NULL if io_uring can't be
+   used, because the kernel is too old, or it is disabled. */
+static struct sensors_uring *uring_new(unsigned entries)
+{
+	struct sensors_uring *uring;
+	struct io_uring_params p;
+	size_t cq_size;
+	char *ring;
+
+	if (!(uring = calloc(1, sizeof(*uring))))
+		sensors_fatal_error(__func__, "Out of memory");
+
+	memset(&p, 0, sizeof(p));
+	uring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (uring->fd < 0) {
+		free(uring);
+		return NULL;
+	}
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+	    !(p.features & IORING_FEAT_RW_CUR_POS))
+		goto fail;
+
+	/* The submission and completion rings share the same mapping */
+	uring->ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (cq_size > uring->ring_size)
+		uring->ring_size = cq_size;
+	ring = mmap(NULL, uring->ring_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED)
+		goto fail;
+	uring->ring = ring;
+
+	uring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, uring->fd,
+			   IORING_OFF_SQES);
+	if (uring->sqes == MAP_FAILED) {
+		uring->sqes = NULL;
+		goto fail;
+	}
+
+	uring->sq_tail = (unsigned *) (ring + p.sq_off.tail);
+	uring->sq_array = (unsigned *) (ring + p.sq_off.array);
+	uring->cq_head = (unsigned *) (ring + p.cq_off.head);
+	uring->cq_tail = (unsigned *) (ring + p.cq_off.tail);
+	uring->cq_mask = *(unsigned *) (ring + p.cq_off.ring_mask);
+	uring->cqes = (struct io_uring_cqe *) (ring + p.cq_off.cqes);
+	return uring;
+
+fail:
+	uring_free(uring);
+	return NULL;
+}
+
+/* Collect the completions of all the submitted requests */
+static void uring_wait(struct sensors_read_batch *batch)
+{
+	struct sensors_uring *uring = batch->uring;
+	struct io_uring_cqe *cqe;
+	unsigned head, tail, done = 0;
+
+	while (done < uring->submitted) {
+		head = *uring->cq_head;
+		tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			syscall(__NR_io_uring_enter, uring->fd, 0, 1,
+				IORING_ENTER_GETEVENTS, NULL, 0);
+			continue;
+		}
+		for (; head != tail; head++, done++) {
+			cqe = &uring->cqes[head & uring->cq_mask];
+			if (cqe->user_data < (unsigned) batch->count)
+				batch->entries[cqe->user_data].read.len =
+					cqe->res;
+		}
+		__atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	uring_free(uring);
+	batch->uring = NULL;
+}
+
+/*
+ * Queue one read per open file, then a write to event_fd which is only
+ * started once all the reads completed (IOSQE_IO_DRAIN), and submit them
+ * all with a single system call. Returns 0 on success, -1 if nothing could
+ * be submitted.
+ */
+static int uring_start(struct sensors_read_batch *batch)
+{
+	struct sensors_uring *uring;
+	struct io_uring_sqe *sqe;
+	unsigned n = 0;
+	int i, ret;
+
+	for (i = 0; i < batch->count; i++)
+		if (batch->entries[i].read.fd >= 0)
+			n++;
+	if (!n || !(uring = uring_new(n + 1)))
+		return -1;
+
+	for (i = 0; i < batch->count; i++) {
+		struct sensors_sysfs_read *read = &batch->entries[i].read;
+
+		if (read->fd < 0)
+			continue;
+		sqe = &uring->sqes[uring->submitted];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = read->fd;
+		sqe->addr = (unsigned long) read->buf;
+		sqe->len = sizeof(read->buf) - 1;
+		sqe->user_data = i;
+		uring->sq_array[uring->submitted] = uring->submitted;
+		uring->submitted++;
+	}
+	sqe = &uring->sqes[n];
+	memset(sqe, 0, sizeof(*sqe));
+	uring->one = 1;
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->flags = IOSQE_IO_DRAIN;
+	sqe->fd = batch->event_fd;
+	sqe->addr = (unsigned long) &uring->one;
+	sqe->len = sizeof(uring->one);
+	sqe->user_data = batch->count;
+	uring->sq_array[n] = n;
+	__atomic_store_n(uring->sq_tail, n + 1, __ATOMIC_RELEASE);
+
+	uring->submitted = 0;
+	while (uring->submitted < n + 1) {
+		ret = syscall(__NR_io_uring_enter, uring->fd,
+			      n + 1 - uring->submitted, 0, 0, NULL, 0);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		uring->submitted += ret;
+	}
+	if (!uring->submitted) {
+		uring_free(uring);
+		return -1;
+	}
+
+	batch->uring = uring;
+
+	/* The kernel takes the requests in order, so the write signaling the
+	   batch wasn't submitted. Do the other reads here, and signal the
+	   batch once the submitted ones completed too. */
+	if (uring->submitted < n + 1) {
+		for (i = 0, n = 0; i < batch->count; i++) {
+			if (batch->entries[i].read.fd < 0)
+				continue;
+			if (n++ >= uring->submitted)
+				batch_read(&batch->entries[i].read);
+		}
+		uring_wait(batch);
+		batch_signal(batch);
+	}
+	return 0;
+}
+
+#else /* !HAVE_IO_URING */
+
+static int uring_start(struct sensors_read_batch *batch)
+{
+	(void) batch;
+	return -1;
+}
+
+static void uring_wait(struct sensors_read_batch *batch)
+{
+	(void) batch;
+}
+
+#endif /* HAVE_IO_URING */
+
+static void *batch_thread(void *arg)
+{
+	struct sensors_read_batch *batch = arg;
+	int i, last;
+
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		do {
+			i = batch->next++;
+		} while (i < batch->count && batch->entries[i].read.fd < 0);
+		pthread_mutex_unlock(&batch->lock);
+		if (i >= batch->count)
+			break;
+
+		batch_read(&batch->entries[i].read);
+
+		pthread_mutex_lock(&batch->lock);
+		last = !--batch->pending;
+		pthread_mutex_unlock(&batch->lock);
+		if (last)
+			batch_signal(batch);
+	}
+	return NULL;
+}
+
+static void threads_start(struct sensors_read_batch *batch)
+{
+	int i, n;
+
+	batch->next = 0;
+	batch->pending = 0;
+	for (i = 0; i < batch->count; i++)
+		if (batch->entries[i].read.fd >= 0)
+			batch->pending++;
+	if (!batch->pending) {
+		batch_signal(batch);
+		return;
+	}
+
+	n = batch->pending;
+	if (n > MAX_BATCH_THREADS)
+		n = MAX_BATCH_THREADS;
+	if (!(batch->threads = malloc(n * sizeof(pthread_t))))
+		sensors_fatal_error(__func__, "Out of memory");
+	pthread_mutex_init(&batch->lock, NULL);
+	for (i = 0; i < n; i++)
+		if (pthread_create(&batch->threads[i], NULL, batch_thread,
+				   batch))
+			break;
+	batch->thread_count = i;
+
+	/* No thread, no concurrency, but the reads still get done */
+	if (!batch->thread_count)
+		batch_thread(batch);
+}
+
+static void threads_wait(struct sensors_read_batch *batch)
+{
+	int i;
+
+	if (!batch->threads)
+		return;
+	for (i = 0; i < batch->thread_count; i++)
+		pthread_join(batch->threads[i], NULL);
+	pthread_mutex_destroy(&batch->lock);
+	free(batch->threads);
+	batch->threads = NULL;
+}
+
+void sensors_start_batch(struct sensors_read_batch *batch)
+{
+	if (uring_start(batch))
+		threads_start(batch);
+}
+
+void sensors_wait_batch(struct sensors_read_batch *batch)
+{
+	if (batch->uring)
+		uring_wait(batch);
+	else
+		threads_wait(batch);
+}
@@ -0,0 +1,67 @@
+/*
+    batch.h - Part of libsensors, a Linux library for reading sensor data.
+    Copyright (C) 2026  lm-sensors contributors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#ifndef LIB_SENSORS_BATCH_H
+#define LIB_SENSORS_BATCH_H
+
+#include <pthread.h>
+#include "sensors.h"
+#include "data.h"
+#include "sysfs.h"
+
+struct sensors_uring;
+
+/* One request of a batch. The file is only read if fd is valid. */
+struct sensors_batch_entry {
+	const sensors_chip_features *chip;
+	const sensors_subfeature *subfeature;
+	struct sensors_sysfs_read read;
+	int cached;		/* value taken from the value cache */
+	double value;
+};
+
+/* The attribute files of a batch are read all at once, with io_uring if
+   the kernel supports it, by worker threads otherwise. Either way, the
+   reads are done when event_fd gets readable. */
+struct sensors_read_batch {
+	sensors_read_request *requests;
+	struct sensors_batch_entry *entries;
+	int count;
+	int event_fd;
+
+	struct sensors_uring *uring;	/* NULL with the worker threads */
+
+	pthread_mutex_t lock;		/* for the worker threads */
+	int next;			/* next entry to be picked */
+	int pending;			/* reads not done yet */
+	pthread_t *threads;
+	int thread_count;
+};
+
+/* Start reading the files of the entries of a batch, whose event_fd must
+   be open. If no worker thread can be created, the files are read right
+   away. */
+void sensors_start_batch(struct sensors_read_batch *batch);
+
+/* Wait until all the files of a batch are read, and release what was
+   used to read them */
+void sensors_wait_batch(struct sensors_read_batch *batch);
+
+#endif /* def LIB_SENSORS_BATCH_H */
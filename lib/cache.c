@@ -0,0 +1,870 @@
+/*
+    cache.c - Part of libsensors, a Linux library for reading sensor data.
+    Copyright (C) 2026  lm-sensors contributors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/* Needed for scandir() and alphasort(), _BSD_SOURCE for older libcs */
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include "sensors.h"
+#include "data.h"
+#include "error.h"
+#include "general.h"
+#include "sysfs.h"
+#include "init.h"
+#include "cache.h"
+#include "../version.h"
+
+/* The cache file starts with a magic string, a byte order check and the
+   key of the configuration files it was built from. The parsed
+   configuration follows, before bus substitution, so that it doesn't depend
+   on the system state. Then come the key of the system state and the
+   detected chips and busses. Everything is in the native byte order. Bump
+   CACHE_VERSION whenever the layout changes. */
+#define CACHE_MAGIC	"LMSENSC\n"
+#define CACHE_VERSION	4
+#define CACHE_ENDIAN	0x01020304
+
+/* Maximum nesting of stored expressions */
+#define EXPR_DEPTH_MAX	256
+
+void sensors_cache_buf_free(sensors_cache_buf *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = buf->size = 0;
+}
+
+static void put_bytes(sensors_cache_buf *buf, const void *data, size_t len)
+{
+	if (buf->len + len > buf->size) {
+		size_t size = buf->size ? buf->size : 1024;
+
+		while (buf->len + len > size)
+			size *= 2;
+		buf->data = realloc(buf->data, size);
+		if (!buf->data)
+			sensors_fatal_error(__func__, "Out of memory");
+		buf->size = size;
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void put_int(sensors_cache_buf *buf, int val)
+{
+	put_bytes(buf, &val, sizeof(val));
+}
+
+static void put_long(sensors_cache_buf *buf, long long val)
+{
+	put_bytes(buf, &val, sizeof(val));
+}
+
+static void put_double(sensors_cache_buf *buf, double val)
+{
+	put_bytes(buf, &val, sizeof(val));
+}
+
+/* Strings are stored with their length, -1 for NULL */
+static void put_str(sensors_cache_buf *buf, const char *str)
+{
+	if (!str) {
+		put_int(buf, -1);
+		return;
+	}
+	put_int(buf, strlen(str));
+	put_bytes(buf, str, strlen(str));
+}
+
+/*
+ * Cache key
+ */
+
+static void key_stat(sensors_cache_buf *key, const char *path)
+{
+	struct stat st;
+
+	put_str(key, path);
+	if (stat(path, &st) < 0) {
+		put_int(key, errno);
+		return;
+	}
+	put_int(key, 0);
+	put_long(key, st.st_dev);
+	put_long(key, st.st_ino);
+	put_long(key, st.st_mode);
+	put_long(key, st.st_size);
+	put_long(key, st.st_mtim.tv_sec);
+	put_long(key, st.st_mtim.tv_nsec);
+}
+
+static int entry_filter(const struct dirent *entry)
+{
+	return entry->d_name[0] != '.';		/* Skip hidden files */
+}
+
+/* Record the entries of a sysfs class or bus directory. Devices get new
+   inode numbers when they are re-created, and the link targets tell where
+   they live in the device tree. */
+static int key_sysfs_dir(sensors_cache_buf *key, const char *subdir,
+			 int required)
+{
+	char path[PATH_MAX], target[PATH_MAX];
+	struct dirent **namelist;
+	int count, i, len;
+
+	snprintf(path, sizeof(path), "%s/%s", sensors_sysfs_mount, subdir);
+	put_str(key, path);
+	count = scandir(path, &namelist, entry_filter, alphasort);
+	if (count < 0) {
+		if (required)
+			return -1;
+		put_int(key, -errno);
+		return 0;
+	}
+
+	put_int(key, count);
+	for (i = 0; i < count; i++) {
+		put_str(key, namelist[i]->d_name);
+		put_long(key, namelist[i]->d_ino);
+
+		snprintf(path, sizeof(path), "%s/%s/%s", sensors_sysfs_mount,
+			 subdir, namelist[i]->d_name);
+		len = readlink(path, target, sizeof(target) - 1);
+		target[len < 0 ? 0 : len] = '\0';
+		put_str(key, target);
+		free(namelist[i]);
+	}
+	free(namelist);
+
+	return 0;
+}
+
+static void key_config_dir(sensors_cache_buf *key, const char *dir)
+{
+	char path[PATH_MAX];
+	struct dirent **namelist;
+	int count, i;
+
+	key_stat(key, dir);
+	count = scandir(dir, &namelist, entry_filter, alphasort);
+	put_int(key, count);
+	for (i = 0; i < count; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir,
+			 namelist[i]->d_name);
+		key_stat(key, path);
+		free(namelist[i]);
+	}
+	if (count >= 0)
+		free(namelist);
+}
+
+int sensors_cache_config_key(sensors_cache_buf *key, FILE *input)
+{
+	put_str(key, LM_VERSION);
+	put_int(key, CACHE_VERSION);
+
+	if (input) {
+		struct stat st;
+		long pos;
+
+		/* Only a regular file can be told apart from another */
+		if (fstat(fileno(input), &st) < 0 || !S_ISREG(st.st_mode) ||
+		    (pos = ftell(input)) < 0)
+			goto uncacheable;
+		put_long(key, st.st_dev);
+		put_long(key, st.st_ino);
+		put_long(key, st.st_size);
+		put_long(key, st.st_mtim.tv_sec);
+		put_long(key, st.st_mtim.tv_nsec);
+		put_long(key, pos);
+	} else {
+		key_stat(key, DEFAULT_CONFIG_FILE);
+		key_stat(key, ALT_CONFIG_FILE);
+		key_config_dir(key, DEFAULT_CONFIG_DIR);
+	}
+
+	return 0;
+
+uncacheable:
+	sensors_cache_buf_free(key);
+	return -1;
+}
+
+int sensors_cache_system_key(sensors_cache_buf *key)
+{
+	put_str(key, sensors_sysfs_mount);
+
+	if (key_sysfs_dir(key, "class/hwmon", 1) ||
+	    key_sysfs_dir(key, "class/i2c-adapter", 0) ||
+	    key_sysfs_dir(key, "bus/i2c/devices", 0)) {
+		sensors_cache_buf_free(key);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Saving
+ */
+
+static int config_file_index(const char *filename)
+{
+	int i;
+
+	if (!filename)
+		return -1;
+	for (i = 0; i < sensors_config_files_count; i++)
+		if (sensors_config_files[i] == filename)
+			return i;
+	return -1;
+}
+
+static void put_line(sensors_cache_buf *buf, const sensors_config_line *line)
+{
+	put_int(buf, config_file_index(line->filename));
+	put_int(buf, line->lineno);
+}
+
+static void put_expr(sensors_cache_buf *buf, const sensors_expr *expr)
+{
+	if (!expr) {
+		put_int(buf, -1);
+		return;
+	}
+
+	put_int(buf, expr->kind);
+	switch (expr->kind) {
+	case sensors_kind_val:
+		put_double(buf, expr->data.val);
+		break;
+	case sensors_kind_source:
+		break;
+	case sensors_kind_var:
+		put_str(buf, expr->data.var);
+		break;
+	case sensors_kind_sub:
+		put_int(buf, expr->data.subexpr.op);
+		put_expr(buf, expr->data.subexpr.sub1);
+		put_expr(buf, expr->data.subexpr.sub2);
+		break;
+	}
+}
+
+static void put_chip_name(sensors_cache_buf *buf,
+			  const sensors_chip_name *name)
+{
+	put_str(buf, name->prefix);
+	put_int(buf, name->bus.type);
+	put_int(buf, name->bus.nr);
+	put_int(buf, name->addr);
+	put_str(buf, name->path);
+}
+
+static void put_proc_chip(sensors_cache_buf *buf,
+			  const sensors_chip_features *chip)
+{
+	int i, names_size = 0;
+
+	put_chip_name(buf, &chip->chip);
+	put_int(buf, chip->feature_count);
+	put_int(buf, chip->subfeature_count);
+
+	/* Size of the names in the chip arena */
+	for (i = 0; i < chip->feature_count; i++)
+		names_size += strlen(chip->feature[i].name) + 1;
+	for (i = 0; i < chip->subfeature_count; i++)
+		names_size += strlen(chip->subfeature[i].name) + 1;
+	put_int(buf, names_size);
+
+	for (i = 0; i < chip->feature_count; i++) {
+		put_str(buf, chip->feature[i].name);
+		put_int(buf, chip->feature[i].type);
+		put_int(buf, chip->feature[i].first_subfeature);
+	}
+	for (i = 0; i < chip->subfeature_count; i++) {
+		put_str(buf, chip->subfeature[i].name);
+		put_int(buf, chip->subfeature[i].type);
+		put_int(buf, chip->subfeature[i].mapping);
+		put_int(buf, chip->subfeature[i].flags);
+	}
+}
+
+static void put_config_chip(sensors_cache_buf *buf, const sensors_chip *chip)
+{
+	int i;
+
+	put_int(buf, chip->chips.fits_count);
+	for (i = 0; i < chip->chips.fits_count; i++)
+		put_chip_name(buf, &chip->chips.fits[i]);
+
+	put_int(buf, chip->labels_count);
+	for (i = 0; i < chip->labels_count; i++) {
+		put_str(buf, chip->labels[i].name);
+		put_str(buf, chip->labels[i].value);
+		put_line(buf, &chip->labels[i].line);
+	}
+
+	put_int(buf, chip->sets_count);
+	for (i = 0; i < chip->sets_count; i++) {
+		put_str(buf, chip->sets[i].name);
+		put_expr(buf, chip->sets[i].value);
+		put_line(buf, &chip->sets[i].line);
+	}
+
+	put_int(buf, chip->computes_count);
+	for (i = 0; i < chip->computes_count; i++) {
+		put_str(buf, chip->computes[i].name);
+		put_expr(buf, chip->computes[i].from_proc);
+		put_expr(buf, chip->computes[i].to_proc);
+		put_line(buf, &chip->computes[i].line);
+	}
+
+	put_int(buf, chip->ignores_count);
+	for (i = 0; i < chip->ignores_count; i++) {
+		put_str(buf, chip->ignores[i].name);
+		put_line(buf, &chip->ignores[i].line);
+	}
+
+	put_double(buf, chip->maxage);
+	put_int(buf, chip->maxage_auto);
+	put_line(buf, &chip->line);
+}
+
+void sensors_cache_encode_config(sensors_cache_buf *buf)
+{
+	int i;
+
+	put_int(buf, sensors_config_files_count);
+	for (i = 0; i < sensors_config_files_count; i++)
+		put_str(buf, sensors_config_files[i]);
+
+	put_int(buf, sensors_config_busses_count);
+	for (i = 0; i < sensors_config_busses_count; i++) {
+		put_str(buf, sensors_config_busses[i].adapter);
+		put_int(buf, sensors_config_busses[i].bus.type);
+		put_int(buf, sensors_config_busses[i].bus.nr);
+		put_line(buf, &sensors_config_busses[i].line);
+	}
+
+	put_int(buf, sensors_config_chips_count);
+	for (i = 0; i < sensors_config_chips_count; i++)
+		put_config_chip(buf, &sensors_config_chips[i]);
+}
+
+void sensors_cache_save(const char *path, const sensors_cache_buf *config_key,
+			const sensors_cache_buf *system_key,
+			const sensors_cache_buf *config)
+{
+	sensors_cache_buf buf = { NULL, 0, 0 };
+	char tmp[PATH_MAX];
+	size_t off;
+	ssize_t n;
+	int i, fd;
+
+	put_bytes(&buf, CACHE_MAGIC, strlen(CACHE_MAGIC));
+	put_int(&buf, CACHE_ENDIAN);
+	put_int(&buf, config_key->len);
+	put_bytes(&buf, config_key->data, config_key->len);
+	put_int(&buf, config->len);
+	put_bytes(&buf, config->data, config->len);
+
+	put_int(&buf, system_key->len);
+	put_bytes(&buf, system_key->data, system_key->len);
+
+	put_int(&buf, sensors_proc_bus_count);
+	for (i = 0; i < sensors_proc_bus_count; i++) {
+		put_str(&buf, sensors_proc_bus[i].adapter);
+		put_int(&buf, sensors_proc_bus[i].bus.type);
+		put_int(&buf, sensors_proc_bus[i].bus.nr);
+	}
+
+	put_int(&buf, sensors_proc_chips_count);
+	for (i = 0; i < sensors_proc_chips_count; i++)
+		put_proc_chip(&buf, sensors_proc_chips[i]);
+
+	/* Write to a temporary file and rename it, so that concurrent
+	   readers never see a partial cache file */
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+		goto exit_free;
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto exit_free;
+	fchmod(fd, 0644);
+	for (off = 0; off < buf.len; off += n) {
+		n = write(fd, buf.data + off, buf.len - off);
+		if (n < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			break;
+		}
+	}
+	if (close(fd) < 0 || off < buf.len || rename(tmp, path) < 0)
+		unlink(tmp);
+
+exit_free:
+	sensors_cache_buf_free(&buf);
+}
+
+/*
+ * Loading
+ */
+
+/* Once a read fails, all subsequent reads return neutral values, so that
+   the structures being built stay consistent and can be freed */
+struct reader {
+	const char *p;
+	const char *end;
+	int err;
+};
+
+static void get_bytes(struct reader *r, void *data, size_t len)
+{
+	if (r->err || (size_t)(r->end - r->p) < len) {
+		r->err = 1;
+		memset(data, 0, len);
+		return;
+	}
+	memcpy(data, r->p, len);
+	r->p += len;
+}
+
+static int get_int(struct reader *r)
+{
+	int val;
+
+	get_bytes(r, &val, sizeof(val));
+	return val;
+}
+
+static double get_double(struct reader *r)
+{
+	double val;
+
+	get_bytes(r, &val, sizeof(val));
+	return val;
+}
+
+/* Get an element count, each element taking at least min_size bytes */
+static int get_count(struct reader *r, size_t min_size)
+{
+	int count = get_int(r);
+
+	if (count < 0 || (size_t)count > (size_t)(r->end - r->p) / min_size) {
+		r->err = 1;
+		return 0;
+	}
+	return count;
+}
+
+static char *get_str(struct reader *r)
+{
+	char *str;
+	int len = get_int(r);
+
+	if (r->err || len < 0)
+		return NULL;
+	if (len > r->end - r->p) {
+		r->err = 1;
+		return NULL;
+	}
+	str = malloc(len + 1);
+	if (!str)
+		sensors_fatal_error(__func__, "Out of memory");
+	memcpy(str, r->p, len);
+	str[len] = '\0';
+	r->p += len;
+	return str;
+}
+
+/* Same as get_str for strings which can't be NULL */
+static char *get_str_nn(struct reader *r)
+{
+	char *str = get_str(r);
+
+	if (!str) {
+		r->err = 1;
+		str = strdup("");
+		if (!str)
+			sensors_fatal_error(__func__, "Out of memory");
+	}
+	return str;
+}
+
+static void get_line(struct reader *r, sensors_config_line *line)
+{
+	int file = get_int(r);
+
+	if (file < -1 || file >= sensors_config_files_count) {
+		r->err = 1;
+		file = -1;
+	}
+	line->filename = file < 0 ? NULL : sensors_config_files[file];
+	line->lineno = get_int(r);
+}
+
+static sensors_expr *get_expr(struct reader *r, int depth)
+{
+	sensors_expr *expr;
+	int kind = get_int(r);
+
+	if (kind == -1 && !r->err)
+		return NULL;
+
+	expr = calloc(1, sizeof(sensors_expr));
+	if (!expr)
+		sensors_fatal_error(__func__, "Out of memory");
+	expr->kind = sensors_kind_val;
+
+	if (depth > EXPR_DEPTH_MAX)
+		r->err = 1;
+	if (r->err)
+		return expr;
+
+	switch (kind) {
+	case sensors_kind_val:
+		expr->data.val = get_double(r);
+		break;
+	case sensors_kind_source:
+		expr->kind = sensors_kind_source;
+		break;
+	case sensors_kind_var:
+		expr->kind = sensors_kind_var;
+		expr->data.var = get_str_nn(r);
+		break;
+	case sensors_kind_sub:
+		expr->kind = sensors_kind_sub;
+		expr->data.subexpr.op = get_int(r);
+		if (expr->data.subexpr.op < sensors_add ||
+		    expr->data.subexpr.op > sensors_log)
+			r->err = 1;
+		expr->data.subexpr.sub1 = get_expr(r, depth + 1);
+		expr->data.subexpr.sub2 = get_expr(r, depth + 1);
+		if (!expr->data.subexpr.sub1)
+			r->err = 1;
+		break;
+	default:
+		r->err = 1;
+	}
+	return expr;
+}
+
+/* Same as get_expr for expressions which can't be NULL */
+static sensors_expr *get_expr_nn(struct reader *r)
+{
+	sensors_expr *expr = get_expr(r, 0);
+
+	if (!expr) {
+		r->err = 1;
+		expr = calloc(1, sizeof(sensors_expr));
+		if (!expr)
+			sensors_fatal_error(__func__, "Out of memory");
+		expr->kind = sensors_kind_val;
+	}
+	return expr;
+}
+
+static void get_chip_name(struct reader *r, sensors_chip_name *name)
+{
+	name->prefix = get_str(r);
+	name->bus.type = get_int(r);
+	name->bus.nr = get_int(r);
+	name->addr = get_int(r);
+	name->path = get_str(r);
+}
+
+/* Allocate an array for count elements, as sensors_add_array_el would */
+static void *alloc_array(int count, size_t size)
+{
+	void *array;
+
+	if (!count)
+		return NULL;
+	array = calloc(count, size);
+	if (!array)
+		sensors_fatal_error(__func__, "Out of memory");
+	return array;
+}
+
+/* Get a string into the names space of a chip arena */
+static char *get_arena_str(struct reader *r, char **names, const char *end)
+{
+	static char empty[1];
+	char *str;
+	int len = get_int(r);
+
+	if (r->err || len < 0 || len >= end - *names || len > r->end - r->p) {
+		r->err = 1;
+		return empty;
+	}
+	str = *names;
+	memcpy(str, r->p, len);
+	str[len] = '\0';
+	r->p += len;
+	*names += len + 1;
+	return str;
+}
+
+static void get_proc_chip(struct reader *r, sensors_chip_features *chip)
+{
+	int i, fnum, sfnum, names_size;
+	char *names, *names_end;
+
+	/* Detected chip names have no wildcards */
+	get_chip_name(r, &chip->chip);
+	if (!chip->chip.prefix || !chip->chip.path ||
+	    chip->chip.bus.type < SENSORS_BUS_TYPE_I2C ||
+	    chip->chip.bus.type > SENSORS_BUS_TYPE_SCSI ||
+	    chip->chip.bus.nr < 0 || chip->chip.addr < 0)
+		r->err = 1;
+
+	fnum = get_count(r, 3 * sizeof(int));
+	sfnum = get_count(r, 4 * sizeof(int));
+	names_size = get_count(r, 1);
+	names = sensors_alloc_chip_arena(chip, fnum, sfnum, names_size);
+	names_end = names + names_size;
+
+	for (i = 0; i < fnum; i++) {
+		chip->feature[i].name = get_arena_str(r, &names, names_end);
+		chip->feature[i].number = i;
+		chip->feature[i].type = get_int(r);
+		chip->feature[i].first_subfeature = get_int(r);
+		chip->feature[i].padding1 = 0;
+		if (chip->feature[i].first_subfeature < 0 ||
+		    chip->feature[i].first_subfeature >= sfnum)
+			r->err = 1;
+	}
+
+	for (i = 0; i < sfnum; i++) {
+		chip->subfeature[i].name = get_arena_str(r, &names, names_end);
+		chip->subfeature[i].number = i;
+		chip->subfeature[i].type = get_int(r);
+		chip->subfeature[i].mapping = get_int(r);
+		chip->subfeature[i].flags = get_int(r);
+		if (chip->subfeature[i].mapping < 0 ||
+		    chip->subfeature[i].mapping >= fnum)
+			r->err = 1;
+	}
+
+	sensors_init_chip_tables(chip);
+	chip->discovered = 1;
+}
+
+static void get_config_chip(struct reader *r, sensors_chip *chip)
+{
+	int i;
+
+	chip->chips.fits_count = chip->chips.fits_max =
+		get_count(r, 5 * sizeof(int));
+	chip->chips.fits = alloc_array(chip->chips.fits_count,
+				       sizeof(sensors_chip_name));
+	for (i = 0; i < chip->chips.fits_count; i++)
+		get_chip_name(r, &chip->chips.fits[i]);
+
+	chip->labels_count = chip->labels_max = get_count(r, 4 * sizeof(int));
+	chip->labels = alloc_array(chip->labels_count, sizeof(sensors_label));
+	for (i = 0; i < chip->labels_count; i++) {
+		chip->labels[i].name = get_str_nn(r);
+		chip->labels[i].value = get_str_nn(r);
+		get_line(r, &chip->labels[i].line);
+	}
+
+	chip->sets_count = chip->sets_max = get_count(r, 4 * sizeof(int));
+	chip->sets = alloc_array(chip->sets_count, sizeof(sensors_set));
+	for (i = 0; i < chip->sets_count; i++) {
+		chip->sets[i].name = get_str_nn(r);
+		chip->sets[i].value = get_expr_nn(r);
+		get_line(r, &chip->sets[i].line);
+	}
+
+	chip->computes_count = chip->computes_max =
+		get_count(r, 5 * sizeof(int));
+	chip->computes = alloc_array(chip->computes_count,
+				     sizeof(sensors_compute));
+	for (i = 0; i < chip->computes_count; i++) {
+		chip->computes[i].name = get_str_nn(r);
+		chip->computes[i].from_proc = get_expr_nn(r);
+		chip->computes[i].to_proc = get_expr_nn(r);
+		get_line(r, &chip->computes[i].line);
+	}
+
+	chip->ignores_count = chip->ignores_max = get_count(r, 3 * sizeof(int));
+	chip->ignores = alloc_array(chip->ignores_count,
+				    sizeof(sensors_ignore));
+	for (i = 0; i < chip->ignores_count; i++) {
+		chip->ignores[i].name = get_str_nn(r);
+		get_line(r, &chip->ignores[i].line);
+	}
+
+	chip->maxage = get_double(r);
+	chip->maxage_auto = get_int(r);
+	get_line(r, &chip->line);
+}
+
+/* Decode the parsed configuration into the library tables, which are
+   expected to be empty */
+static int cache_decode_config(struct reader *r)
+{
+	int i;
+
+	sensors_config_files_count = sensors_config_files_max =
+		get_count(r, sizeof(int));
+	sensors_config_files = alloc_array(sensors_config_files_count,
+					   sizeof(char *));
+	for (i = 0; i < sensors_config_files_count; i++)
+		sensors_config_files[i] = get_str_nn(r);
+
+	sensors_config_busses_count = sensors_config_busses_max =
+		get_count(r, 5 * sizeof(int));
+	sensors_config_busses = alloc_array(sensors_config_busses_count,
+					    sizeof(sensors_bus));
+	for (i = 0; i < sensors_config_busses_count; i++) {
+		sensors_config_busses[i].adapter = get_str_nn(r);
+		sensors_config_busses[i].bus.type = get_int(r);
+		sensors_config_busses[i].bus.nr = get_int(r);
+		get_line(r, &sensors_config_busses[i].line);
+	}
+
+	sensors_config_chips_count = sensors_config_chips_max =
+		get_count(r, 7 * sizeof(int));
+	sensors_config_chips = alloc_array(sensors_config_chips_count,
+					   sizeof(sensors_chip));
+	for (i = 0; i < sensors_config_chips_count; i++)
+		get_config_chip(r, &sensors_config_chips[i]);
+	sensors_config_chips_subst = 0;
+
+	return r->err || r->p != r->end ? -1 : 0;
+}
+
+/* Decode the detected chips and busses into the library tables, which are
+   expected to be empty */
+static int cache_decode_system(struct reader *r)
+{
+	int i;
+
+	sensors_proc_bus_count = sensors_proc_bus_max =
+		get_count(r, 3 * sizeof(int));
+	sensors_proc_bus = alloc_array(sensors_proc_bus_count,
+				       sizeof(sensors_bus));
+	for (i = 0; i < sensors_proc_bus_count; i++) {
+		sensors_proc_bus[i].adapter = get_str_nn(r);
+		sensors_proc_bus[i].bus.type = get_int(r);
+		sensors_proc_bus[i].bus.nr = get_int(r);
+	}
+
+	sensors_proc_chips_count = sensors_proc_chips_max =
+		get_count(r, 8 * sizeof(int));
+	sensors_proc_chips = alloc_array(sensors_proc_chips_count,
+					 sizeof(sensors_chip_features *));
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		sensors_proc_chips[i] = alloc_array(1,
+					sizeof(sensors_chip_features));
+		get_proc_chip(r, sensors_proc_chips[i]);
+	}
+	sensors_hash_proc_chips();
+
+	return r->err || r->p != r->end ? -1 : 0;
+}
+
+/* Check that the next key in the cache matches */
+static int cache_check_key(struct reader *r, const sensors_cache_buf *key)
+{
+	if (get_int(r) != (int)key->len ||
+	    (size_t)(r->end - r->p) < key->len ||
+	    memcmp(r->p, key->data, key->len))
+		return -1;
+	r->p += key->len;
+	return 0;
+}
+
+int sensors_cache_load(const char *path, const sensors_cache_buf *config_key,
+		       const sensors_cache_buf *system_key)
+{
+	struct reader r, config;
+	struct stat st;
+	void *map;
+	int fd, len, res = -1;
+	size_t head = strlen(CACHE_MAGIC) + 2 * sizeof(int);
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+	    (size_t)st.st_size < head + config_key->len) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	r.p = map;
+	r.end = r.p + st.st_size;
+	r.err = 0;
+
+	/* Check the header and key before decoding anything */
+	if (memcmp(r.p, CACHE_MAGIC, strlen(CACHE_MAGIC)))
+		goto exit_unmap;
+	r.p += strlen(CACHE_MAGIC);
+	if (get_int(&r) != CACHE_ENDIAN || cache_check_key(&r, config_key))
+		goto exit_unmap;
+
+	len = get_count(&r, 1);
+	if (r.err)
+		goto exit_unmap;
+	config.p = r.p;
+	config.end = r.p + len;
+	config.err = 0;
+	r.p += len;
+	if (cache_decode_config(&config)) {
+		sensors_cleanup();
+		goto exit_unmap;
+	}
+
+	/* The configuration alone is still good if the system changed */
+	res = 1;
+	if (cache_check_key(&r, system_key))
+		goto exit_unmap;
+	if (cache_decode_system(&r)) {
+		sensors_cleanup();
+		res = -1;
+		goto exit_unmap;
+	}
+	res = 0;
+
+exit_unmap:
+	munmap(map, st.st_size);
+	return res;
+}
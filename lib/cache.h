@@ -0,0 +1,62 @@
+/*
+    cache.h - Part of libsensors, a Linux library for reading sensor data.
+    Copyright (C) 2026  lm-sensors contributors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#ifndef LIB_SENSORS_CACHE_H
+#define LIB_SENSORS_CACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* A growable byte buffer, used for the cache key and the cache contents */
+typedef struct sensors_cache_buf {
+	char *data;
+	size_t len;
+	size_t size;
+} sensors_cache_buf;
+
+void sensors_cache_buf_free(sensors_cache_buf *buf);
+
+/* Compute the key of the configuration: library version and configuration
+   files (or the given input file). Returns 0 on success, -1 if it can't be
+   cached. */
+int sensors_cache_config_key(sensors_cache_buf *key, FILE *input);
+
+/* Compute the key of the current system state: hwmon and i2c adapter
+   devices. Returns 0 on success, -1 if this state can't be cached. */
+int sensors_cache_system_key(sensors_cache_buf *key);
+
+/* Encode the parsed configuration, which must not be bus substituted yet,
+   for sensors_cache_save() */
+void sensors_cache_encode_config(sensors_cache_buf *buf);
+
+/* Load the configuration from a cache file if its configuration key
+   matches, and the chips and busses too if its system key matches. The
+   configuration isn't bus substituted. Returns 0 if everything was loaded,
+   1 if only the configuration was, and -1 if nothing was. */
+int sensors_cache_load(const char *path, const sensors_cache_buf *config_key,
+		       const sensors_cache_buf *system_key);
+
+/* Save the encoded configuration, chips and busses to a cache file,
+   atomically. Errors are ignored, the cache is only an optimization. */
+void sensors_cache_save(const char *path, const sensors_cache_buf *config_key,
+			const sensors_cache_buf *system_key,
+			const sensors_cache_buf *config);
+
+#endif /* def LIB_SENSORS_CACHE_H */
@@ -100,6 +100,7 @@ static sensors_chip *current_chip = NULL;
 %token <line> CHIP
 %token <line> COMPUTE
 %token <line> IGNORE
+%token <line> MAXAGE
 %token <value> FLOAT
 %token <name> NAME
 %token <nothing> ERROR
@@ -126,6 +127,7 @@ line:	  bus_statement EOL
 	| chip_statement EOL
 	| compute_statement EOL
 	| ignore_statement EOL
+	| maxage_statement EOL
 	| error	EOL
 ;
 
@@ -198,6 +200,31 @@ ignore_statement:	IGNORE function_name
 			}
 ;
 
+maxage_statement:	MAXAGE FLOAT
+			{ if (!current_chip) {
+			    sensors_yyerror("Maxage statement before first chip statement");
+			    YYERROR;
+			  }
+			  current_chip->maxage = $2;
+			  current_chip->maxage_auto = 0;
+			}
+			| MAXAGE NAME FLOAT
+			{ if (!current_chip) {
+			    sensors_yyerror("Maxage statement before first chip statement");
+			    free($2);
+			    YYERROR;
+			  }
+			  if (strcmp($2, "auto")) {
+			    sensors_yyerror("Maxage statement with invalid mode");
+			    free($2);
+			    YYERROR;
+			  }
+			  free($2);
+			  current_chip->maxage = $3;
+			  current_chip->maxage_auto = 1;
+			}
+;
+
 chip_statement:	  CHIP chip_name_list
 		  { sensors_chip new_el;
 		    new_el.line = $1;
@@ -209,6 +236,8 @@ chip_statement:	  CHIP chip_name_list
 		    new_el.sets_count = new_el.sets_max = 0;
 		    new_el.computes_count = new_el.computes_max = 0;
 		    new_el.ignores_count = new_el.ignores_max = 0;
+		    new_el.maxage = -1;
+		    new_el.maxage_auto = 0;
 		    new_el.chips = $2;
 		    chip_add_el(&new_el);
 		    current_chip = sensors_config_chips + 
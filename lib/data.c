@@ -22,6 +22,7 @@
 /* this define needed for strndup() */
 #define _GNU_SOURCE
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -33,26 +34,87 @@
 
 const char *libsensors_version = LM_VERSION;
 
-char **sensors_config_files = NULL;
-int sensors_config_files_count = 0;
-int sensors_config_files_max = 0;
+static sensors_context sensors_default_context;
 
-sensors_chip *sensors_config_chips = NULL;
-int sensors_config_chips_count = 0;
-int sensors_config_chips_subst = 0;
-int sensors_config_chips_max = 0;
+/* Threads start with the default context */
+__thread sensors_context *sensors_current_context = &sensors_default_context;
 
-sensors_bus *sensors_config_busses = NULL;
-int sensors_config_busses_count = 0;
-int sensors_config_busses_max = 0;
+unsigned int sensors_flags = 0;
 
-sensors_chip_features *sensors_proc_chips = NULL;
-int sensors_proc_chips_count = 0;
-int sensors_proc_chips_max = 0;
+sensors_context *sensors_context_new(void)
+{
+	return calloc(1, sizeof(sensors_context));
+}
+
+void sensors_context_free(sensors_context *ctx)
+{
+	sensors_context *prev;
+
+	if (!ctx || ctx == &sensors_default_context)
+		return;
+
+	prev = sensors_context_use(ctx);
+	sensors_cleanup();
+	sensors_context_use(prev == ctx ? NULL : prev);
+	free(ctx);
+}
+
+sensors_context *sensors_context_use(sensors_context *ctx)
+{
+	sensors_context *prev = sensors_current_context;
+
+	sensors_current_context = ctx ? ctx : &sensors_default_context;
+	return prev == &sensors_default_context ? NULL : prev;
+}
+
+static unsigned int hash_chip_name(const sensors_chip_name *name)
+{
+	return (unsigned int) ((uintptr_t) name / sizeof(void *)) *
+	       2654435761U;
+}
 
-sensors_bus *sensors_proc_bus = NULL;
-int sensors_proc_bus_count = 0;
-int sensors_proc_bus_max = 0;
+void sensors_hash_proc_chips(void)
+{
+	sensors_chip_features **hash;
+	unsigned int h, mask;
+	int i, size;
+
+	for (size = 1; size < 2 * sensors_proc_chips_count; size <<= 1)
+		;
+	if (size > sensors_proc_chips_hash_size) {
+		hash = realloc(sensors_proc_chips_hash, size * sizeof(*hash));
+		if (!hash)
+			sensors_fatal_error(__func__, "Out of memory");
+		sensors_proc_chips_hash = hash;
+		sensors_proc_chips_hash_size = size;
+	}
+
+	mask = sensors_proc_chips_hash_size - 1;
+	memset(sensors_proc_chips_hash, 0,
+	       sensors_proc_chips_hash_size * sizeof(*hash));
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		h = hash_chip_name(&sensors_proc_chips[i]->chip);
+		while (sensors_proc_chips_hash[h & mask])
+			h++;
+		sensors_proc_chips_hash[h & mask] = sensors_proc_chips[i];
+	}
+}
+
+sensors_chip_features *sensors_find_proc_chip(const sensors_chip_name *name)
+{
+	sensors_chip_features *chip;
+	unsigned int h, mask;
+
+	if (!sensors_proc_chips_hash_size)
+		return NULL;
+
+	mask = sensors_proc_chips_hash_size - 1;
+	for (h = hash_chip_name(name);
+	     (chip = sensors_proc_chips_hash[h & mask]); h++)
+		if (&chip->chip == name)
+			return chip;
+	return NULL;
+}
 
 void sensors_free_chip_name(sensors_chip_name *chip)
 {
@@ -225,63 +287,91 @@ int sensors_parse_bus_id(const char *name, sensors_bus_id *bus)
 }
 
 static int sensors_substitute_chip(sensors_chip_name *name,
+				   const int *bus_nr, int first, int last,
 				   const char *filename, int lineno)
 {
-	int i, j;
-	for (i = 0; i < sensors_config_busses_count; i++)
+	int i;
+
+	for (i = first; i < last; i++)
 		if (sensors_config_busses[i].bus.type == name->bus.type &&
 		    sensors_config_busses[i].bus.nr == name->bus.nr)
 			break;
 
-	if (i == sensors_config_busses_count) {
+	if (i == last) {
 		sensors_parse_error_wfn("Undeclared bus id referenced",
 					filename, lineno);
 		name->bus.nr = SENSORS_BUS_NR_IGNORE;
 		return -SENSORS_ERR_BUS_NAME;
 	}
 
-	/* Compare the adapter names */
-	for (j = 0; j < sensors_proc_bus_count; j++) {
-		if (!strcmp(sensors_config_busses[i].adapter,
-			    sensors_proc_bus[j].adapter)) {
-			name->bus.nr = sensors_proc_bus[j].bus.nr;
-			return 0;
-		}
-	}
-
-	/* We did not find a matching bus name, simply ignore this chip
-	   config entry. */
-	name->bus.nr = SENSORS_BUS_NR_IGNORE;
+	/* If we did not find a matching bus name, this is
+	   SENSORS_BUS_NR_IGNORE, and this chip config entry is ignored */
+	name->bus.nr = bus_nr[i];
 	return 0;
 }
 
-/* Bus substitution is on a per-configuration file basis, so we keep
-   memory (in sensors_config_chips_subst) of which chip entries have been
-   already substituted. */
+/* Bus substitution is on a per-configuration file basis: a bus statement
+   only applies to the chip statements of the same file. This is done once
+   all the configuration files are loaded, rather than after each of them,
+   and we keep memory (in sensors_config_chips_subst) of which chip entries
+   have been already substituted. */
 int sensors_substitute_busses(void)
 {
-	int err, i, j, lineno;
+	int err, i, j, f, b, first, lineno;
+	int *bus_nr = NULL;
 	sensors_chip_name_list *chips;
 	const char *filename;
 	int res = 0;
 
-	for (i = sensors_config_chips_subst;
-	     i < sensors_config_chips_count; i++) {
-		filename = sensors_config_chips[i].line.filename;
-		lineno = sensors_config_chips[i].line.lineno;
-		chips = &sensors_config_chips[i].chips;
-		for (j = 0; j < chips->fits_count; j++) {
-			/* We can only substitute if a specific bus number
-			   is given. */
-			if (chips->fits[j].bus.nr == SENSORS_BUS_NR_ANY)
-				continue;
-
-			err = sensors_substitute_chip(&chips->fits[j],
-						      filename, lineno);
-			if (err)
-				res = err;
+	/* Look up the adapter name of each bus statement once */
+	if (sensors_config_busses_count) {
+		bus_nr = malloc(sensors_config_busses_count * sizeof(int));
+		if (!bus_nr)
+			sensors_fatal_error(__func__, "Out of memory");
+	}
+	for (b = 0; b < sensors_config_busses_count; b++) {
+		bus_nr[b] = SENSORS_BUS_NR_IGNORE;
+		for (j = 0; j < sensors_proc_bus_count; j++) {
+			if (!strcmp(sensors_config_busses[b].adapter,
+				    sensors_proc_bus[j].adapter)) {
+				bus_nr[b] = sensors_proc_bus[j].bus.nr;
+				break;
+			}
 		}
 	}
+
+	/* The bus and chip statements are both in file order, so go through
+	   the files and take their statements in turn. The file name is
+	   NULL if the configuration was passed to sensors_init(). */
+	i = sensors_config_chips_subst;
+	b = 0;
+	for (f = -1; f < sensors_config_files_count; f++) {
+		filename = f < 0 ? NULL : sensors_config_files[f];
+		first = b;
+		while (b < sensors_config_busses_count &&
+		       sensors_config_busses[b].line.filename == filename)
+			b++;
+
+		for (; i < sensors_config_chips_count &&
+		       sensors_config_chips[i].line.filename == filename; i++) {
+			lineno = sensors_config_chips[i].line.lineno;
+			chips = &sensors_config_chips[i].chips;
+			for (j = 0; j < chips->fits_count; j++) {
+				/* We can only substitute if a specific bus
+				   number is given. */
+				if (chips->fits[j].bus.nr == SENSORS_BUS_NR_ANY)
+					continue;
+
+				err = sensors_substitute_chip(&chips->fits[j],
+							      bus_nr, first, b,
+							      filename, lineno);
+				if (err)
+					res = err;
+			}
+		}
+	}
+	free(bus_nr);
+
 	sensors_config_chips_subst = sensors_config_chips_count;
 	return res;
 }
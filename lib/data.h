@@ -60,6 +60,32 @@ typedef struct sensors_expr {
 	} data;
 } sensors_expr;
 
+/* Instructions of a compiled expression. Compiled expressions are postfix
+   programs: constants, the raw value and variables are pushed on a stack,
+   operators replace their operand(s) on the top of the stack with the
+   result. */
+typedef enum sensors_insn_code {
+	sensors_insn_val, sensors_insn_source, sensors_insn_var,
+	sensors_insn_add, sensors_insn_sub, sensors_insn_multiply,
+	sensors_insn_divide, sensors_insn_negate, sensors_insn_exp,
+	sensors_insn_log,
+} sensors_insn_code;
+
+typedef struct sensors_insn {
+	sensors_insn_code code;
+	union {
+		double val;
+		int subfeat_nr;		/* -1 if the variable is unknown */
+	} data;
+} sensors_insn;
+
+typedef struct sensors_prog {
+	sensors_insn *insn;
+	int insn_count;
+	int insn_max;
+	int stack_size;		/* evaluation stack size needed */
+} sensors_prog;
+
 /* Config file line reference */
 typedef struct sensors_config_line {
 	const char *filename;
@@ -119,6 +145,8 @@ typedef struct sensors_chip {
 	sensors_ignore *ignores;
 	int ignores_count;
 	int ignores_max;
+	double maxage;		/* seconds, < 0 if no maxage statement */
+	int maxage_auto;
 	sensors_config_line line;
 } sensors_chip;
 
@@ -130,43 +158,163 @@ typedef struct sensors_bus {
 	sensors_config_line line;
 } sensors_bus;
 
-/* Internal data about all features and subfeatures of a chip */
+/* Configuration statements applying to a detected feature, resolved once
+   the configuration is loaded. A NULL label means no label statement, NULL
+   programs mean no compute statement. */
+typedef struct sensors_feature_config {
+	const char *label;
+	int ignored;
+	sensors_prog *from_proc;
+	sensors_prog *to_proc;
+} sensors_feature_config;
+
+/* The last value read of a subfeature. seq is odd while the entry is
+   being updated. The times are CLOCK_MONOTONIC nanoseconds; read_ns is 0
+   if no value is cached, changed_ns is 0 until the value was seen
+   changing, and the values of the reads started before forgot_ns aren't
+   cached, as they may predate a write. */
+typedef struct sensors_cached_value {
+	unsigned int seq;
+	double value;
+	long long read_ns;
+	long long changed_ns;
+	long long forgot_ns;
+} sensors_cached_value;
+
+/* The values of a chip with a maxage statement, indexed by subfeature
+   number. With auto, learned_ns is the shortest interval seen between two
+   changes of a value, 0 until one was seen. */
+typedef struct sensors_value_cache {
+	long long maxage_ns;
+	int learn;
+	long long learned_ns;
+	sensors_cached_value *values;
+} sensors_value_cache;
+
+/* Internal data about all features and subfeatures of a chip.
+   subfeature_fd holds the cached file descriptor of each subfeature's
+   sysfs attribute (indexed by subfeature number), or -1 if none, followed
+   by the cached file descriptor of the chip directory. fd_users counts the
+   threads using these descriptors, stale ones are only closed when it
+   drops to 0.
+   subfeature_hash is an open-addressing hash table of subfeature numbers
+   (-1 for empty slots) keyed on subfeature names; its size is a power
+   of 2. subfeature_scale is the number of decimals of the integer each
+   subfeature's attribute holds (0, 3 or 6), indexed by subfeature
+   number. feature_config is indexed by feature number. config_chips lists
+   the configuration chip blocks matching this chip, latest first.
+   feature, subfeature, subfeature_fd, fd_users, subfeature_hash,
+   subfeature_scale and all feature and subfeature names live in a single
+   allocation, arena. subfeature_stats is indexed by subfeature number, and
+   only allocated with SENSORS_FLAG_STATS.
+   value_cache is only allocated for chips with a maxage statement.
+   discovered is 0 until the features of the chip are read, for the chips
+   detected lazily; all the other fields are empty until then. */
 typedef struct sensors_chip_features {
 	struct sensors_chip_name chip;
+	void *arena;
 	struct sensors_feature *feature;
 	struct sensors_subfeature *subfeature;
+	int *subfeature_fd;
+	int *fd_users;
+	int *subfeature_hash;
+	int subfeature_hash_size;
+	int *subfeature_scale;
+	sensors_subfeature_stats *subfeature_stats;
+	sensors_value_cache *value_cache;
+	sensors_feature_config *feature_config;
+	sensors_chip **config_chips;
+	int config_chips_count;
+	int config_chips_max;
 	int feature_count;
 	int subfeature_count;
+	int discovered;
 } sensors_chip_features;
 
-extern char **sensors_config_files;
-extern int sensors_config_files_count;
-extern int sensors_config_files_max;
+/* Library behavior flags (SENSORS_FLAG_*) */
+extern unsigned int sensors_flags;
+
+/* The tables set up by sensors_init(). The library works on the context
+   of the calling thread, which is the default context unless another one
+   was set with sensors_context_use(), and the names below refer to the
+   tables of that context. */
+struct sensors_context {
+	char **config_files;
+	int config_files_count;
+	int config_files_max;
+
+	sensors_chip *config_chips;
+	int config_chips_count;
+	int config_chips_subst;
+	int config_chips_max;
+
+	sensors_bus *config_busses;
+	int config_busses_count;
+	int config_busses_max;
+
+	sensors_chip_features **proc_chips;
+	int proc_chips_count;
+	int proc_chips_max;
+	sensors_chip_features **proc_chips_hash;
+	int proc_chips_hash_size;
+
+	sensors_bus *proc_bus;
+	int proc_bus_count;
+	int proc_bus_max;
+};
+
+extern __thread sensors_context *sensors_current_context;
+
+#define sensors_config_files (sensors_current_context->config_files)
+#define sensors_config_files_count \
+	(sensors_current_context->config_files_count)
+#define sensors_config_files_max (sensors_current_context->config_files_max)
 
 #define sensors_add_config_files(el) sensors_add_array_el( \
 	(el), &sensors_config_files, &sensors_config_files_count, \
 	&sensors_config_files_max, sizeof(char *))
 
-extern sensors_chip *sensors_config_chips;
-extern int sensors_config_chips_count;
-extern int sensors_config_chips_subst;
-extern int sensors_config_chips_max;
-
-extern sensors_bus *sensors_config_busses;
-extern int sensors_config_busses_count;
-extern int sensors_config_busses_max;
-
-extern sensors_chip_features *sensors_proc_chips;
-extern int sensors_proc_chips_count;
-extern int sensors_proc_chips_max;
+#define sensors_config_chips (sensors_current_context->config_chips)
+#define sensors_config_chips_count \
+	(sensors_current_context->config_chips_count)
+#define sensors_config_chips_subst \
+	(sensors_current_context->config_chips_subst)
+#define sensors_config_chips_max (sensors_current_context->config_chips_max)
+
+#define sensors_config_busses (sensors_current_context->config_busses)
+#define sensors_config_busses_count \
+	(sensors_current_context->config_busses_count)
+#define sensors_config_busses_max \
+	(sensors_current_context->config_busses_max)
+
+/* The detected chips are allocated one by one, so that they don't move
+   when chips are added or removed */
+#define sensors_proc_chips (sensors_current_context->proc_chips)
+#define sensors_proc_chips_count (sensors_current_context->proc_chips_count)
+#define sensors_proc_chips_max (sensors_current_context->proc_chips_max)
 
 #define sensors_add_proc_chips(el) sensors_add_array_el( \
 	(el), &sensors_proc_chips, &sensors_proc_chips_count,\
-	&sensors_proc_chips_max, sizeof(struct sensors_chip_features))
-
-extern sensors_bus *sensors_proc_bus;
-extern int sensors_proc_bus_count;
-extern int sensors_proc_bus_max;
+	&sensors_proc_chips_max, sizeof(struct sensors_chip_features *))
+
+/* An open-addressing hash table of the detected chips (NULL for empty
+   slots), keyed on the address of their name, to find the chip of a name
+   returned by sensors_get_detected_chips() in constant time. Its size is
+   a power of 2, at least twice the number of chips. */
+#define sensors_proc_chips_hash (sensors_current_context->proc_chips_hash)
+#define sensors_proc_chips_hash_size \
+	(sensors_current_context->proc_chips_hash_size)
+
+/* Rebuild the hash table after adding or removing detected chips */
+void sensors_hash_proc_chips(void);
+
+/* Find the detected chip a name belongs to, or NULL if the name isn't one
+   of the detected chips */
+sensors_chip_features *sensors_find_proc_chip(const sensors_chip_name *name);
+
+#define sensors_proc_bus (sensors_current_context->proc_bus)
+#define sensors_proc_bus_count (sensors_current_context->proc_bus_count)
+#define sensors_proc_bus_max (sensors_current_context->proc_bus_max)
 
 #define sensors_add_proc_bus(el) sensors_add_array_el( \
 	(el), &sensors_proc_bus, &sensors_proc_bus_count,\
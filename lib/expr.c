@@ -0,0 +1,177 @@
+/*
+    expr.c - Part of libsensors, a Linux library for reading sensor data.
+    Copyright (C) 2026  lm-sensors contributors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "sensors.h"
+#include "data.h"
+#include "error.h"
+#include "access.h"
+#include "expr.h"
+
+#define sensors_add_prog_insn(prog, el) sensors_add_array_el( \
+	(el), &(prog)->insn, &(prog)->insn_count, \
+	&(prog)->insn_max, sizeof(sensors_insn))
+
+/* Replace the instructions of an operation starting at index start with
+   a single constant, if all its operands are constants. Operations which
+   would fail at run-time are left alone, so that the error is reported
+   when the value is read. */
+static void sensors_fold_insn(sensors_prog *prog, int start)
+{
+	sensors_insn *insn = prog->insn + start;
+	int count = prog->insn_count - start;
+	double res;
+
+	if (count == 2 && insn[0].code == sensors_insn_val) {
+		double a = insn[0].data.val;
+
+		switch (insn[1].code) {
+		case sensors_insn_negate:
+			res = -a;
+			break;
+		case sensors_insn_exp:
+			res = exp(a);
+			break;
+		case sensors_insn_log:
+			if (a < 0.0)
+				return;
+			res = log(a);
+			break;
+		default:
+			return;
+		}
+	} else if (count == 3 && insn[0].code == sensors_insn_val &&
+		   insn[1].code == sensors_insn_val) {
+		double a = insn[0].data.val, b = insn[1].data.val;
+
+		switch (insn[2].code) {
+		case sensors_insn_add:
+			res = a + b;
+			break;
+		case sensors_insn_sub:
+			res = a - b;
+			break;
+		case sensors_insn_multiply:
+			res = a * b;
+			break;
+		case sensors_insn_divide:
+			if (b == 0.0)
+				return;
+			res = a / b;
+			break;
+		default:
+			return;
+		}
+	} else
+		return;
+
+	insn[0].data.val = res;
+	prog->insn_count = start + 1;
+}
+
+/* Append the instructions of an expression to a program. Returns the
+   stack size needed to evaluate this expression. */
+static int sensors_compile_subexpr(const sensors_chip_features *chip,
+				   const sensors_expr *expr,
+				   sensors_prog *prog)
+{
+	const sensors_subfeature *subfeature;
+	sensors_insn insn;
+	int start, size1, size2 = 0;
+
+	switch (expr->kind) {
+	case sensors_kind_val:
+		insn.code = sensors_insn_val;
+		insn.data.val = expr->data.val;
+		sensors_add_prog_insn(prog, &insn);
+		return 1;
+	case sensors_kind_source:
+		insn.code = sensors_insn_source;
+		sensors_add_prog_insn(prog, &insn);
+		return 1;
+	case sensors_kind_var:
+		subfeature = sensors_lookup_subfeature_name(chip,
+							    expr->data.var);
+		insn.code = sensors_insn_var;
+		insn.data.subfeat_nr = subfeature ? subfeature->number : -1;
+		sensors_add_prog_insn(prog, &insn);
+		return 1;
+	case sensors_kind_sub:
+		break;
+	}
+
+	start = prog->insn_count;
+	size1 = sensors_compile_subexpr(chip, expr->data.subexpr.sub1, prog);
+	if (expr->data.subexpr.sub2)
+		size2 = 1 + sensors_compile_subexpr(chip,
+						    expr->data.subexpr.sub2,
+						    prog);
+
+	switch (expr->data.subexpr.op) {
+	case sensors_add:
+		insn.code = sensors_insn_add;
+		break;
+	case sensors_sub:
+		insn.code = sensors_insn_sub;
+		break;
+	case sensors_multiply:
+		insn.code = sensors_insn_multiply;
+		break;
+	case sensors_divide:
+		insn.code = sensors_insn_divide;
+		break;
+	case sensors_negate:
+		insn.code = sensors_insn_negate;
+		break;
+	case sensors_exp:
+		insn.code = sensors_insn_exp;
+		break;
+	case sensors_log:
+		insn.code = sensors_insn_log;
+		break;
+	}
+	sensors_add_prog_insn(prog, &insn);
+	sensors_fold_insn(prog, start);
+
+	return size1 > size2 ? size1 : size2;
+}
+
+sensors_prog *sensors_compile_expr(const sensors_chip_features *chip,
+				   const sensors_expr *expr)
+{
+	sensors_prog *prog;
+
+	prog = calloc(1, sizeof(sensors_prog));
+	if (!prog)
+		sensors_fatal_error(__func__, "Out of memory");
+
+	prog->stack_size = sensors_compile_subexpr(chip, expr, prog);
+
+	return prog;
+}
+
+void sensors_free_prog(sensors_prog *prog)
+{
+	if (!prog)
+		return;
+	free(prog->insn);
+	free(prog);
+}
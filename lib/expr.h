@@ -0,0 +1,35 @@
+/*
+    expr.h - Part of libsensors, a Linux library for reading sensor data.
+    Copyright (C) 2026  lm-sensors contributors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#ifndef LIB_SENSORS_EXPR_H
+#define LIB_SENSORS_EXPR_H
+
+#include "data.h"
+
+/* Compile an expression into a postfix program for the given chip.
+   Variable names are resolved to the chip's subfeature numbers, and
+   constant subexpressions are folded. Returns a newly allocated program,
+   free it with sensors_free_prog(). */
+sensors_prog *sensors_compile_expr(const sensors_chip_features *chip,
+				   const sensors_expr *expr);
+
+void sensors_free_prog(sensors_prog *prog);
+
+#endif /* def LIB_SENSORS_EXPR_H */
@@ -83,3 +83,14 @@ void sensors_add_array_els(const void *els, int nr_els, void *list,
 	memcpy(((char *)*my_list) + *num_el * el_size, els, el_size * nr_els);
 	*num_el += nr_els;
 }
+
+unsigned int sensors_hash_string(const char *s)
+{
+	unsigned int h = 2166136261U;
+
+	while (*s) {
+		h ^= (unsigned char) *s++;
+		h *= 16777619U;
+	}
+	return h;
+}
@@ -34,6 +34,9 @@ void sensors_add_array_el(const void *el, void *list, int *num_el,
 void sensors_add_array_els(const void *els, int nr_els, void *list,
 			   int *num_el, int *max_el, int el_size);
 
+/* Hash a string, for use in hash tables (FNV-1a) */
+unsigned int sensors_hash_string(const char *s);
+
 #define ARRAY_SIZE(arr)	(int)(sizeof(arr) / sizeof((arr)[0]))
 
 #endif /* def LIB_SENSORS_GENERAL_H */
@@ -30,6 +30,7 @@
 #include <string.h>
 #include <errno.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <unistd.h>
 #include "sensors.h"
 #include "data.h"
@@ -39,10 +40,14 @@
 #include "sysfs.h"
 #include "scanner.h"
 #include "init.h"
+#include "cache.h"
 
-#define DEFAULT_CONFIG_FILE	ETCDIR "/sensors3.conf"
-#define ALT_CONFIG_FILE		ETCDIR "/sensors.conf"
-#define DEFAULT_CONFIG_DIR	ETCDIR "/sensors.d"
+/* Snapshot cache file, NULL if disabled */
+static char *sensors_cache_file;
+
+/* The configuration parser isn't reentrant, so different contexts can't
+   be initialized at the same time */
+static pthread_mutex_t sensors_init_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Wrapper around sensors_yyparse(), which clears the locale so that
    the decimal numbers are always parsed properly. */
@@ -102,22 +107,16 @@ static int parse_config(FILE *input, const char *name)
 	} else
 		name_copy = NULL;
 
-	if (sensors_scanner_init(input, name_copy)) {
-		err = -SENSORS_ERR_PARSE;
-		goto exit_cleanup;
-	}
+	if (sensors_scanner_init(input, name_copy))
+		return -SENSORS_ERR_PARSE;
 	err = sensors_parse();
 	sensors_scanner_exit();
-	if (err) {
-		err = -SENSORS_ERR_PARSE;
-		goto exit_cleanup;
-	}
-
-	err = sensors_substitute_busses();
+	if (err)
+		return -SENSORS_ERR_PARSE;
 
-exit_cleanup:
-	free_config_busses();
-	return err;
+	/* The bus statements are kept for sensors_substitute_busses(), once
+	   all the configuration files are loaded */
+	return 0;
 }
 
 static int config_file_filter(const struct dirent *entry)
@@ -175,51 +174,119 @@ static int add_config_from_dir(const char *dir)
 	return res;
 }
 
-/* Ideally, initialization and configuraton file loading should be exposed
-   separately, to make it possible to load several configuration files. */
-int sensors_init(FILE *input)
+void sensors_set_cache_file(const char *path)
+{
+	char *copy = NULL;
+
+	if (path) {
+		copy = strdup(path);
+		if (!copy)
+			sensors_fatal_error(__func__, "Out of memory");
+	}
+	free(sensors_cache_file);
+	sensors_cache_file = copy;
+}
+
+/* Parse the given configuration file, or the default ones */
+static int load_config(FILE *input)
 {
+	const char* name;
 	int res;
 
-	if (!sensors_init_sysfs())
-		return -SENSORS_ERR_KERNEL;
-	if ((res = sensors_read_sysfs_bus()) ||
-	    (res = sensors_read_sysfs_chips()))
-		goto exit_cleanup;
+	if (input)
+		return parse_config(input, NULL);
 
+	/* No configuration provided, use default */
+	input = fopen(name = DEFAULT_CONFIG_FILE, "r");
+	if (!input && errno == ENOENT)
+		input = fopen(name = ALT_CONFIG_FILE, "r");
 	if (input) {
-		res = parse_config(input, NULL);
+		res = parse_config(input, name);
+		fclose(input);
 		if (res)
-			goto exit_cleanup;
-	} else {
-		const char* name;
-
-		/* No configuration provided, use default */
-		input = fopen(name = DEFAULT_CONFIG_FILE, "r");
-		if (!input && errno == ENOENT)
-			input = fopen(name = ALT_CONFIG_FILE, "r");
-		if (input) {
-			res = parse_config(input, name);
-			fclose(input);
-			if (res)
-				goto exit_cleanup;
+			return res;
 
-		} else if (errno != ENOENT) {
-			sensors_parse_error_wfn(strerror(errno), name, 0);
-			res = -SENSORS_ERR_PARSE;
-			goto exit_cleanup;
-		}
+	} else if (errno != ENOENT) {
+		sensors_parse_error_wfn(strerror(errno), name, 0);
+		return -SENSORS_ERR_PARSE;
+	}
 
-		/* Also check for files in default directory */
-		res = add_config_from_dir(DEFAULT_CONFIG_DIR);
-		if (res)
-			goto exit_cleanup;
+	/* Also check for files in default directory */
+	return add_config_from_dir(DEFAULT_CONFIG_DIR);
+}
+
+static int sensors_init_context(FILE *input)
+{
+	int i, res, cached = -1;
+	sensors_cache_buf config_key = { NULL, 0, 0 };
+	sensors_cache_buf system_key = { NULL, 0, 0 };
+	sensors_cache_buf config = { NULL, 0, 0 };
+
+	if (!sensors_init_sysfs())
+		return -SENSORS_ERR_KERNEL;
+
+	/* Use the snapshot of a previous initialization if the system and
+	   configuration didn't change since, or at least its parsed
+	   configuration if only the system changed */
+	if (sensors_cache_file) {
+		if (!sensors_cache_config_key(&config_key, input) &&
+		    !sensors_cache_system_key(&system_key))
+			cached = sensors_cache_load(sensors_cache_file,
+						    &config_key, &system_key);
+		else
+			sensors_cache_buf_free(&config_key);
 	}
 
-	return 0;
+	if (cached != 0 &&
+	    ((res = sensors_read_sysfs_bus()) ||
+	     (res = sensors_read_sysfs_chips())))
+		goto exit_cleanup;
+
+	if (cached < 0 && (res = load_config(input)))
+		goto exit_cleanup;
+
+	/* The cache holds the configuration before bus substitution */
+	if (config_key.data && cached != 0)
+		sensors_cache_encode_config(&config);
+
+	res = sensors_substitute_busses();
+	free_config_busses();
+	if (res)
+		goto exit_cleanup;
+
+	sensors_resolve_config();
+	for (i = 0; i < sensors_proc_chips_count; i++)
+		sensors_init_chip_stats(sensors_proc_chips[i]);
+
+	if (config.data) {
+		/* The snapshot holds the features of all the chips */
+		for (i = sensors_proc_chips_count - 1; i >= 0; i--)
+			if (!sensors_discover_chip(sensors_proc_chips[i]))
+				sensors_remove_chip(&sensors_proc_chips[i]->chip);
+		sensors_cache_save(sensors_cache_file, &config_key,
+				   &system_key, &config);
+	}
+	res = 0;
 
 exit_cleanup:
-	sensors_cleanup();
+	sensors_cache_buf_free(&config_key);
+	sensors_cache_buf_free(&system_key);
+	sensors_cache_buf_free(&config);
+	if (res)
+		sensors_cleanup();
+	return res;
+}
+
+/* Ideally, initialization and configuraton file loading should be exposed
+   separately, to make it possible to load several configuration files. */
+int sensors_init(FILE *input)
+{
+	int res;
+
+	pthread_mutex_lock(&sensors_init_lock);
+	res = sensors_init_context(input);
+	pthread_mutex_unlock(&sensors_init_lock);
+
 	return res;
 }
 
@@ -231,14 +298,10 @@ static void free_chip_name(sensors_chip_name *name)
 
 static void free_chip_features(sensors_chip_features *features)
 {
-	int i;
-
-	for (i = 0; i < features->subfeature_count; i++)
-		free(features->subfeature[i].name);
-	free(features->subfeature);
-	for (i = 0; i < features->feature_count; i++)
-		free(features->feature[i].name);
-	free(features->feature);
+	sensors_close_sysfs_attrs(features);
+	sensors_free_feature_config(features);
+	free(features->arena);
+	free(features->subfeature_stats);
 }
 
 static void free_label(sensors_label *label)
@@ -308,17 +371,65 @@ static void free_chip(sensors_chip *chip)
 	chip->ignores_count = chip->ignores_max = 0;
 }
 
+void sensors_set_flags(unsigned int flags)
+{
+	int i;
+
+	/* Release the cached file descriptors if caching gets disabled */
+	if ((sensors_flags & SENSORS_FLAG_CACHE_FD) &&
+	    !(flags & SENSORS_FLAG_CACHE_FD))
+		for (i = 0; i < sensors_proc_chips_count; i++)
+			sensors_close_sysfs_attrs(sensors_proc_chips[i]);
+
+	sensors_flags = flags;
+	for (i = 0; i < sensors_proc_chips_count; i++)
+		sensors_init_chip_stats(sensors_proc_chips[i]);
+}
+
+unsigned int sensors_get_flags(void)
+{
+	return sensors_flags;
+}
+
+int sensors_remove_chip(const sensors_chip_name *chip)
+{
+	int i;
+
+	for (i = 0; i < sensors_proc_chips_count; i++)
+		if (&sensors_proc_chips[i]->chip == chip)
+			break;
+	if (i == sensors_proc_chips_count)
+		return -SENSORS_ERR_NO_ENTRY;
+
+	free_chip_name(&sensors_proc_chips[i]->chip);
+	free_chip_features(sensors_proc_chips[i]);
+	free(sensors_proc_chips[i]);
+
+	/* Keep the detection order of the other chips */
+	memmove(&sensors_proc_chips[i], &sensors_proc_chips[i + 1],
+		(sensors_proc_chips_count - i - 1) *
+		sizeof(sensors_chip_features *));
+	sensors_proc_chips_count--;
+	sensors_hash_proc_chips();
+
+	return 0;
+}
+
 void sensors_cleanup(void)
 {
 	int i;
 
 	for (i = 0; i < sensors_proc_chips_count; i++) {
-		free_chip_name(&sensors_proc_chips[i].chip);
-		free_chip_features(&sensors_proc_chips[i]);
+		free_chip_name(&sensors_proc_chips[i]->chip);
+		free_chip_features(sensors_proc_chips[i]);
+		free(sensors_proc_chips[i]);
 	}
 	free(sensors_proc_chips);
 	sensors_proc_chips = NULL;
 	sensors_proc_chips_count = sensors_proc_chips_max = 0;
+	free(sensors_proc_chips_hash);
+	sensors_proc_chips_hash = NULL;
+	sensors_proc_chips_hash_size = 0;
 
 	for (i = 0; i < sensors_config_chips_count; i++)
 		free_chip(&sensors_config_chips[i]);
@@ -326,6 +437,7 @@ void sensors_cleanup(void)
 	sensors_config_chips = NULL;
 	sensors_config_chips_count = sensors_config_chips_max = 0;
 	sensors_config_chips_subst = 0;
+	free_config_busses();
 
 	for (i = 0; i < sensors_proc_bus_count; i++)
 		free_bus(&sensors_proc_bus[i]);
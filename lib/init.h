@@ -23,6 +23,10 @@
 
 #include "data.h"
 
+#define DEFAULT_CONFIG_FILE	ETCDIR "/sensors3.conf"
+#define ALT_CONFIG_FILE		ETCDIR "/sensors.conf"
+#define DEFAULT_CONFIG_DIR	ETCDIR "/sensors.d"
+
 void sensors_free_expr(sensors_expr *expr);
 
 #endif /* def LIB_SENSORS_INIT_H */
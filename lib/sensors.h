@@ -31,7 +31,7 @@
    when the API + ABI breaks), the third digit is incremented to track small
    API additions like new flags / enum values. The second digit is for tracking
    larger additions like new methods. */
-#define SENSORS_API_VERSION		0x440
+#define SENSORS_API_VERSION		0x450
 
 #define SENSORS_CHIP_NAME_PREFIX_ANY	NULL
 #define SENSORS_CHIP_NAME_ADDR_ANY	(-1)
@@ -49,6 +49,11 @@
 #define SENSORS_BUS_NR_ANY		(-1)
 #define SENSORS_BUS_NR_IGNORE		(-2)
 
+/* Library behavior flags, see sensors_set_flags() */
+#define SENSORS_FLAG_CACHE_FD		(1 << 0)
+#define SENSORS_FLAG_PARALLEL_INIT	(1 << 1)
+#define SENSORS_FLAG_STATS		(1 << 2)
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -72,13 +77,87 @@ typedef struct sensors_chip_name {
    returns a value unequal to zero, you are in trouble; you can not
    assume anything will be initialized properly. If you want to
    reload the configuration file, call sensors_cleanup() below before
-   calling sensors_init() again. */
+   calling sensors_init() again. Unless SENSORS_FLAG_PARALLEL_INIT is
+   set, the features of each chip are only read when the chip is first
+   accessed, and the chips without any are skipped from then on. */
 int sensors_init(FILE *input);
 
 /* Clean-up function: You can't access anything after
    this, until the next sensors_init() call! */
 void sensors_cleanup(void);
 
+/* A library context holds the detected chips and the configuration. All
+   the functions of this library work on the context of the calling thread,
+   which is a default context shared by all threads unless another one was
+   set with sensors_context_use(). So a program can hold several
+   configurations at once, and load a new one while other threads keep
+   reading with the old one.
+   The read functions (sensors_get_detected_chips, sensors_get_features,
+   sensors_get_all_subfeatures, sensors_get_subfeature, sensors_get_label,
+   sensors_get_value and sensors_get_values) can be called from several
+   threads at once on the same context. They take no lock, except briefly
+   to drop the cached files of a device which went away, and except the
+   first time they use a chip whose features weren't read at
+   initialization (without SENSORS_FLAG_PARALLEL_INIT): its features are
+   then read from sysfs under a global lock, which other threads reading a
+   chip the first time wait for. The functions changing a context
+   (sensors_init, sensors_cleanup, sensors_add_hwmon, sensors_remove_chip)
+   must not run while other threads use it. */
+typedef struct sensors_context sensors_context;
+
+/* Allocate a new, empty context. Use it, then call sensors_init() to load
+   the configuration and detected chips into it. Returns NULL if out of
+   memory. */
+sensors_context *sensors_context_new(void);
+
+/* Clean up and free a context, which no thread may be using anymore */
+void sensors_context_free(sensors_context *ctx);
+
+/* Make the calling thread use the given context, or the default one if
+   ctx is NULL. Returns the context used before, NULL for the default
+   one. */
+sensors_context *sensors_context_use(sensors_context *ctx);
+
+/* Set the library behavior flags. With SENSORS_FLAG_CACHE_FD, the sysfs
+   attribute files are kept open after the first read, and subsequent reads
+   of the same subfeature are done without reopening the file. This is
+   meant for long-running programs which read the same values over and
+   over again; it costs one file descriptor per subfeature read. Writable
+   attributes are opened for writing too if permitted, and their file
+   descriptors are reused by sensors_set_value() and sensors_do_chip_sets().
+   Clearing the flag closes all the cached file descriptors of the current
+   context. The cached file descriptors of a device which went away are
+   only closed once no other thread is reading from that device anymore,
+   so that their numbers don't get reused while still in use.
+   With SENSORS_FLAG_PARALLEL_INIT, sensors_init() reads the hwmon devices
+   and all their features using several threads. This speeds up
+   initialization on systems with many hwmon devices, for programs which
+   access all the chips. The chips are listed in the same order either
+   way.
+   With SENSORS_FLAG_STATS, the reads and writes of every subfeature are
+   counted and timed, see sensors_get_stats(). Set it before sensors_init()
+   or while no other thread uses the context, as this allocates the
+   statistics of the chips. Clearing it stops the counting, the statistics
+   are kept until sensors_cleanup().
+   The flags are preserved across sensors_cleanup() and sensors_init()
+   calls. */
+void sensors_set_flags(unsigned int flags);
+
+/* Return the library behavior flags currently set */
+unsigned int sensors_get_flags(void);
+
+/* Set the path of a snapshot cache file for sensors_init(), or NULL to
+   disable it (the default). When set, sensors_init() saves the detected
+   chips and the parsed configuration to this file, and later calls load
+   them from there instead of scanning sysfs and parsing the configuration
+   again, as long as the hwmon devices, i2c adapters and configuration
+   files did not change. If only the devices changed, the parsed
+   configuration is still loaded from there. The directory must be
+   writable for the cache to
+   be created; errors accessing the cache file are not reported. The path
+   is preserved across sensors_cleanup() and sensors_init() calls. */
+void sensors_set_cache_file(const char *path);
+
 /* Parse a chip name to the internal representation. Return 0 on success, <0
    on error. */
 int sensors_parse_chip_name(const char *orig_name, sensors_chip_name *res);
@@ -108,10 +187,130 @@ char *sensors_get_label(const sensors_chip_name *name,
 
 /* Read the value of a subfeature of a certain chip. Note that chip should not
    contain wildcard values! This function will return 0 on success, and <0
-   on failure.  */
+   on failure. For chips with a maxage statement, a value read recently
+   enough is returned again instead of being read. */
 int sensors_get_value(const sensors_chip_name *name, int subfeat_nr,
 		      double *value);
 
+/* Read the values of several subfeatures of a certain chip at once. Note
+   that chip should not contain wildcard values! subfeat_nr points to an
+   array of count subfeature numbers; if it is NULL, all the subfeatures
+   of the chip are read, by subfeature number, up to count. For every
+   entry, the value is stored in values and, if errors is not NULL, 0 or a
+   negative error code (as sensors_get_value() would return it) is stored
+   in errors. Subfeatures which are not readable get -SENSORS_ERR_ACCESS_R.
+   This function returns the number of entries (if subfeat_nr is NULL,
+   the number of subfeatures of the chip, which may be more than count),
+   or <0 on failure. */
+int sensors_get_values(const sensors_chip_name *name, const int *subfeat_nr,
+		       int count, double *values, int *errors);
+
+/* Read the integer the kernel reports for a subfeature of a certain chip,
+   before scaling, and store in scale its decimal exponent: the value is
+   value * 10^scale, with scale 0, -3 or -6. The compute statements of the
+   configuration file are not applied. Note that chip should not contain
+   wildcard values! This function will return 0 on success, and <0 on
+   failure. */
+int sensors_get_value_raw(const sensors_chip_name *name, int subfeat_nr,
+			  long long *value, int *scale);
+
+/* Convert count raw values sharing the same scale, as returned by
+   sensors_get_value_raw(), to the values sensors_get_value() would
+   return without compute statements. */
+void sensors_scale_values(const long long *raw, int scale, double *values,
+			  int count);
+
+/* A subfeature to be read as part of a batch, see sensors_submit_reads().
+   name and subfeat_nr are set by the caller, value and error (0 or a
+   negative error code, as sensors_get_value() would return it) by the
+   library. */
+typedef struct sensors_read_request {
+	const sensors_chip_name *name;
+	int subfeat_nr;
+	double value;
+	int error;
+} sensors_read_request;
+
+typedef struct sensors_read_batch sensors_read_batch;
+
+/* Start reading the values of count subfeatures, of any chips, all at the
+   same time rather than one after the other, so that reading them takes
+   about as long as reading the slowest one. On Linux 5.6 and later, all the
+   reads are submitted at once with io_uring, otherwise they are done by
+   worker threads. The chip names should not contain wildcard values!
+   requests must stay valid until sensors_complete_reads() is called, and
+   the current context must be neither cleaned up nor changed by
+   sensors_init(), sensors_add_hwmon() or sensors_remove_chip() meanwhile.
+   This is best used together with SENSORS_FLAG_CACHE_FD, which saves
+   opening the attribute files. On success, *batch is set and 0 is
+   returned, <0 on failure. */
+int sensors_submit_reads(sensors_read_request *requests, int count,
+			 sensors_read_batch **batch);
+
+/* Return a file descriptor which gets readable (POLLIN) once all the reads
+   of a batch are done, so as to wait for them in an event loop. It is
+   closed by sensors_complete_reads(). */
+int sensors_get_batch_fd(const sensors_read_batch *batch);
+
+/* Wait for the reads of a batch to be done if they aren't yet, and store
+   the values of the requests, with their compute statements applied, and
+   their errors. The batch is freed. Returns the number of requests which
+   failed. */
+int sensors_complete_reads(sensors_read_batch *batch);
+
+/* Open a file descriptor to be notified of the changes of an alarm or fault
+   subfeature (any readable subfeature whose type has bit 7 set, that is
+   without compute mapping), and store its current value in *value. Note
+   that chip should not contain wildcard values! The descriptor signals
+   POLLPRI (EPOLLPRI with epoll; POLLERR is signaled as well) when the
+   driver notifies a change, then sensors_read_poll() must be called to
+   read the new value and acknowledge the notification. Not all drivers
+   notify changes, so callers should still read the values periodically.
+   The caller closes the descriptor. Returns the file descriptor, or <0 on
+   error. */
+int sensors_open_poll(const sensors_chip_name *name, int subfeat_nr,
+		      double *value);
+
+/* Read the value of a subfeature from a descriptor returned by
+   sensors_open_poll(), after it was signaled. Returns 0 on success, <0 on
+   failure. */
+int sensors_read_poll(const sensors_chip_name *name, int subfeat_nr, int fd,
+		      double *value);
+
+/* Number of buckets of the latency histograms. Bucket 0 counts the
+   operations which took less than 2 microseconds, bucket i those which
+   took from 2^i to 2^(i+1) microseconds, and the last bucket those which
+   took longer. */
+#define SENSORS_STATS_BUCKETS		20
+
+/* Statistics of the reads or the writes of a subfeature. io_errors counts
+   the failures with -SENSORS_ERR_IO, access_errors those with
+   -SENSORS_ERR_ACCESS_R (or -SENSORS_ERR_ACCESS_W for writes), and
+   kernel_errors those where the attribute file couldn't be opened. The
+   latencies are in nanoseconds. */
+typedef struct sensors_io_stats {
+	unsigned long long count;
+	unsigned long long io_errors;
+	unsigned long long access_errors;
+	unsigned long long kernel_errors;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+	unsigned long long histogram[SENSORS_STATS_BUCKETS];
+} sensors_io_stats;
+
+typedef struct sensors_subfeature_stats {
+	sensors_io_stats read;
+	sensors_io_stats write;
+} sensors_subfeature_stats;
+
+/* Get the statistics of the reads and writes of a subfeature of a certain
+   chip since it was detected, which are only recorded with
+   SENSORS_FLAG_STATS (all zero otherwise). Note that chip should not
+   contain wildcard values! This function will return 0 on success, and
+   <0 on failure. */
+int sensors_get_stats(const sensors_chip_name *name, int subfeat_nr,
+		      sensors_subfeature_stats *stats);
+
 /* Set the value of a subfeature of a certain chip. Note that chip should not
    contain wildcard values! This function will return 0 on success, and <0
    on failure. */
@@ -119,7 +318,8 @@ int sensors_set_value(const sensors_chip_name *name, int subfeat_nr,
 		      double value);
 
 /* Execute all set statements for this particular chip. The chip may contain
-   wildcards!  This function will return 0 on success, and <0 on failure. */
+   wildcards!  Values which the attributes already hold are not written
+   again. This function will return 0 on success, and <0 on failure. */
 int sensors_do_chip_sets(const sensors_chip_name *name);
 
 /* This function returns all detected chips that match a given chip name,
@@ -130,6 +330,24 @@ int sensors_do_chip_sets(const sensors_chip_name *name);
 const sensors_chip_name *sensors_get_detected_chips(const sensors_chip_name
 						    *match, int *nr);
 
+/* Add the chip of a hwmon class device (for example "hwmon3") to the
+   detected chips, typically after its "add" uevent. *chip is set to the
+   new chip, to the existing chip if the device was known already, or to
+   NULL if the device has no sensors. Returns 0 on success, <0 on error.
+   The chips detected before are not affected, and the chip names
+   previously returned by sensors_get_detected_chips() stay valid. */
+int sensors_add_hwmon(const char *classdev, const sensors_chip_name **chip);
+
+/* Return the detected chip of a hwmon class device, or NULL if none */
+const sensors_chip_name *sensors_get_hwmon_chip(const char *classdev);
+
+/* Remove a chip from the detected chips, typically after the "remove"
+   uevent of its hwmon class device. chip must have been returned by
+   sensors_get_detected_chips() or one of the functions above, and is no
+   longer valid afterwards; the other chip names stay valid. Returns 0 on
+   success, <0 on error. */
+int sensors_remove_chip(const sensors_chip_name *chip);
+
 /* These defines are used in the flags field of sensors_subfeature */
 #define SENSORS_MODE_R			1
 #define SENSORS_MODE_W			2
@@ -26,11 +26,16 @@
 #include <sys/stat.h>
 #include <sys/vfs.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
 #include <errno.h>
+#include <math.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include "data.h"
 #include "error.h"
 #include "access.h"
@@ -40,8 +45,8 @@
 
 /****************************************************************************/
 
-#define ATTR_MAX	128
 #define SYSFS_MAGIC	0x62656572
+#define MAX_SCAN_THREADS	16
 
 /*
  * Read an attribute from sysfs
@@ -137,41 +142,54 @@ static int sysfs_foreach_busdev(const char *bus_type,
 /****************************************************************************/
 
 char sensors_sysfs_mount[NAME_MAX];
+const char *sensors_sysfs_root;
 
+/* Number of decimals of the attribute values, per subfeature type */
 static
-int get_type_scaling(sensors_subfeature_type type)
+int get_type_scale(sensors_subfeature_type type)
 {
-	/* Multipliers for subfeatures */
+	/* Scales for subfeatures */
 	switch (type & 0xFF80) {
 	case SENSORS_SUBFEATURE_IN_INPUT:
 	case SENSORS_SUBFEATURE_TEMP_INPUT:
 	case SENSORS_SUBFEATURE_CURR_INPUT:
 	case SENSORS_SUBFEATURE_HUMIDITY_INPUT:
-		return 1000;
+		return 3;
 	case SENSORS_SUBFEATURE_FAN_INPUT:
-		return 1;
+		return 0;
 	case SENSORS_SUBFEATURE_POWER_AVERAGE:
 	case SENSORS_SUBFEATURE_ENERGY_INPUT:
-		return 1000000;
+		return 6;
 	}
 
-	/* Multipliers for second class subfeatures
-	   that need their own multiplier */
+	/* Scales for second class subfeatures
+	   that need their own scale */
 	switch (type) {
 	case SENSORS_SUBFEATURE_POWER_AVERAGE_INTERVAL:
 	case SENSORS_SUBFEATURE_VID:
 	case SENSORS_SUBFEATURE_TEMP_OFFSET:
-		return 1000;
+		return 3;
 	default:
-		return 1;
+		return 0;
 	}
 }
 
-static
-char *get_feature_name(sensors_feature_type ftype, char *sfname)
+/* Divisors of the attribute values, by number of decimals */
+static const double sysfs_scaling[] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000
+};
+
+/* The divisor turning the attribute value of a subfeature into its value */
+static inline double get_scaling(const sensors_chip_features *chip,
+				 const sensors_subfeature *subfeature)
 {
-	char *name, *underscore;
+	return sysfs_scaling[chip->subfeature_scale[subfeature->number]];
+}
 
+/* Length of the name of the feature a subfeature belongs to */
+static size_t get_feature_name_len(sensors_feature_type ftype,
+				   const char *sfname)
+{
 	switch (ftype) {
 	case SENSORS_FEATURE_IN:
 	case SENSORS_FEATURE_FAN:
@@ -181,19 +199,10 @@ char *get_feature_name(sensors_feature_type ftype, char *sfname)
 	case SENSORS_FEATURE_CURR:
 	case SENSORS_FEATURE_HUMIDITY:
 	case SENSORS_FEATURE_INTRUSION:
-		underscore = strchr(sfname, '_');
-		name = strndup(sfname, underscore - sfname);
-		if (!name)
-			sensors_fatal_error(__func__, "Out of memory");
-
-		break;
+		return strchr(sfname, '_') - sfname;
 	default:
-		name = strdup(sfname);
-		if (!name)
-			sensors_fatal_error(__func__, "Out of memory");
+		return strlen(sfname);
 	}
-
-	return name;
 }
 
 /* Static mappings for use by sensors_subfeature_get_type() */
@@ -399,14 +408,25 @@ static int sensors_compute_max_sf(void)
 	return max;
 }
 
-static int sensors_get_attr_mode(const char *device, const char *attr)
+/* Set once, before any chip is read */
+static int max_subfeatures, feature_size;
+
+/* Dynamically figure out the max number of subfeatures */
+static void sensors_init_max_sf(void)
+{
+	if (!max_subfeatures) {
+		max_subfeatures = sensors_compute_max_sf();
+		feature_size = max_subfeatures * 2;
+	}
+}
+
+/* Get the access mode of an attribute, dir_fd is the device directory */
+static int sensors_get_attr_mode(int dir_fd, const char *attr)
 {
-	char path[NAME_MAX];
 	struct stat st;
 	int mode = 0;
 
-	snprintf(path, NAME_MAX, "%s/%s", device, attr);
-	if (!stat(path, &st)) {
+	if (!fstatat(dir_fd, attr, &st, 0)) {
 		if (st.st_mode & S_IRUSR)
 			mode |= SENSORS_MODE_R;
 		if (st.st_mode & S_IWUSR)
@@ -415,39 +435,108 @@ static int sensors_get_attr_mode(const char *device, const char *attr)
 	return mode;
 }
 
+/* Hash table size for subfeature lookups by name, at most half full */
+static int hash_table_size(int sfnum)
+{
+	int size;
+
+	for (size = 1; size < 2 * sfnum; size <<= 1)
+		;
+	return size;
+}
+
+char *sensors_alloc_chip_arena(sensors_chip_features *chip, int fnum,
+			       int sfnum, size_t names_size)
+{
+	int hash_size = hash_table_size(sfnum);
+	char *arena;
+
+	/* Largest alignment first: structures with pointers, then ints,
+	   then the names */
+	arena = malloc(fnum * sizeof(sensors_feature) +
+		       sfnum * sizeof(sensors_subfeature) +
+		       (2 * sfnum + 2 + hash_size) * sizeof(int) + names_size);
+	if (!arena)
+		sensors_fatal_error(__func__, "Out of memory");
+
+	chip->arena = arena;
+	chip->feature = (sensors_feature *)arena;
+	chip->feature_count = fnum;
+	chip->subfeature = (sensors_subfeature *)(chip->feature + fnum);
+	chip->subfeature_count = sfnum;
+	chip->subfeature_fd = (int *)(chip->subfeature + sfnum);
+	chip->fd_users = chip->subfeature_fd + sfnum + 1;
+	chip->subfeature_hash = chip->fd_users + 1;
+	chip->subfeature_hash_size = hash_size;
+	chip->subfeature_scale = chip->subfeature_hash + hash_size;
+
+	return (char *)(chip->subfeature_scale + sfnum);
+}
+
+void sensors_init_chip_tables(sensors_chip_features *chip)
+{
+	int i, size = chip->subfeature_hash_size;
+
+	for (i = 0; i <= chip->subfeature_count; i++)
+		chip->subfeature_fd[i] = -1;
+	*chip->fd_users = 0;
+
+	for (i = 0; i < size; i++)
+		chip->subfeature_hash[i] = -1;
+	for (i = 0; i < chip->subfeature_count; i++) {
+		unsigned int h = sensors_hash_string(chip->subfeature[i].name);
+
+		while (chip->subfeature_hash[h & (size - 1)] >= 0)
+			h++;
+		chip->subfeature_hash[h & (size - 1)] = i;
+	}
+
+	for (i = 0; i < chip->subfeature_count; i++)
+		chip->subfeature_scale[i] =
+			get_type_scale(chip->subfeature[i].type);
+
+	chip->feature_config = NULL;
+	chip->subfeature_stats = NULL;
+	chip->value_cache = NULL;
+	chip->config_chips = NULL;
+	chip->config_chips_count = chip->config_chips_max = 0;
+}
+
+/* Subfeature found while scanning a chip directory */
+struct sysfs_attr {
+	int name;		/* offset in the names buffer + 1, 0 if unused */
+	sensors_subfeature_type type;
+	unsigned int flags;
+};
+
 static int sensors_read_dynamic_chip(sensors_chip_features *chip,
 				     const char *dev_path)
 {
 	int i, fnum = 0, sfnum = 0, prev_slot;
-	static int max_subfeatures, feature_size;
 	DIR *dir;
 	struct dirent *ent;
 	struct {
 		int count;
-		sensors_subfeature *sf;
+		struct sysfs_attr *sf;
 	} all_types[SENSORS_FEATURE_MAX];
-	sensors_subfeature *dyn_subfeatures;
-	sensors_feature *dyn_features;
+	char *names = NULL, *arena_names;
+	size_t names_len = 0, names_max = 0, names_size;
 	sensors_feature_type ftype;
 	sensors_subfeature_type sftype;
 
 	if (!(dir = opendir(dev_path)))
 		return -errno;
 
-	/* Dynamically figure out the max number of subfeatures */
-	if (!max_subfeatures) {
-		max_subfeatures = sensors_compute_max_sf();
-		feature_size = max_subfeatures * 2;
-	}
-
 	/* We use a set of large sparse tables at first (one per main
 	   feature type present) to store all found subfeatures, so that we
-	   can store them sorted and then later create a dense sorted table. */
+	   can store them sorted and then later create a dense sorted table.
+	   The subfeature names are collected in a single buffer. */
 	memset(&all_types, 0, sizeof(all_types));
 
 	while ((ent = readdir(dir))) {
 		char *name;
 		int nr;
+		size_t len;
 
 		/* Skip directories and symlinks */
 		if (ent->d_type != DT_REG)
@@ -496,12 +585,12 @@ static int sensors_read_dynamic_chip(sensors_chip_features *chip,
 			all_types[ftype].sf = realloc(all_types[ftype].sf,
 						all_types[ftype].count *
 						feature_size *
-						sizeof(sensors_subfeature));
+						sizeof(struct sysfs_attr));
 			if (!all_types[ftype].sf)
 				sensors_fatal_error(__func__, "Out of memory");
 			memset(all_types[ftype].sf + old_count * feature_size,
 			       0, (all_types[ftype].count - old_count) *
-				  feature_size * sizeof(sensors_subfeature));
+				  feature_size * sizeof(struct sysfs_attr));
 		}
 
 		/* "calculate" a place to store the subfeature in our sparse,
@@ -520,17 +609,28 @@ static int sensors_read_dynamic_chip(sensors_chip_features *chip,
 			continue;
 		}
 
+		/* Store the name */
+		len = strlen(name) + 1;
+		if (names_len + len > names_max) {
+			names_max = names_max ? 2 * names_max : 1024;
+			while (names_len + len > names_max)
+				names_max *= 2;
+			names = realloc(names, names_max);
+			if (!names)
+				sensors_fatal_error(__func__, "Out of memory");
+		}
+		memcpy(names + names_len, name, len);
+
 		/* fill in the subfeature members */
 		all_types[ftype].sf[i].type = sftype;
-		all_types[ftype].sf[i].name = strdup(name);
-		if (!all_types[ftype].sf[i].name)
-			sensors_fatal_error(__func__, "Out of memory");
+		all_types[ftype].sf[i].name = names_len + 1;
+		names_len += len;
 
 		/* Other and misc subfeatures are never scaled */
 		if (sftype < SENSORS_SUBFEATURE_VID && !(sftype & 0x80))
 			all_types[ftype].sf[i].flags |= SENSORS_COMPUTE_MAPPING;
 		all_types[ftype].sf[i].flags |=
-					sensors_get_attr_mode(dev_path, name);
+					sensors_get_attr_mode(dirfd(dir), name);
 
 		sfnum++;
 	}
@@ -538,10 +638,12 @@ static int sensors_read_dynamic_chip(sensors_chip_features *chip,
 
 	if (!sfnum) { /* No subfeature */
 		chip->subfeature = NULL;
+		chip->arena = NULL;
 		goto exit_free;
 	}
 
-	/* How many main features? */
+	/* How many main features, and how long are their names? */
+	names_size = names_len;
 	for (ftype = 0; ftype < SENSORS_FEATURE_MAX; ftype++) {
 		prev_slot = -1;
 		for (i = 0; i < all_types[ftype].count * feature_size; i++) {
@@ -551,14 +653,18 @@ static int sensors_read_dynamic_chip(sensors_chip_features *chip,
 			if (i / feature_size != prev_slot) {
 				fnum++;
 				prev_slot = i / feature_size;
+				names_size += get_feature_name_len(ftype,
+					names + all_types[ftype].sf[i].name - 1)
+					+ 1;
 			}
 		}
 	}
 
-	dyn_subfeatures = calloc(sfnum, sizeof(sensors_subfeature));
-	dyn_features = calloc(fnum, sizeof(sensors_feature));
-	if (!dyn_subfeatures || !dyn_features)
-		sensors_fatal_error(__func__, "Out of memory");
+	/* One allocation for all tables and names of the chip. The
+	   subfeature names keep their offsets, the feature names follow. */
+	arena_names = sensors_alloc_chip_arena(chip, fnum, sfnum, names_size);
+	memcpy(arena_names, names, names_len);
+	names_size = names_len;
 
 	/* Copy from the sparse array to the compact array */
 	sfnum = 0;
@@ -566,39 +672,52 @@ static int sensors_read_dynamic_chip(sensors_chip_features *chip,
 	for (ftype = 0; ftype < SENSORS_FEATURE_MAX; ftype++) {
 		prev_slot = -1;
 		for (i = 0; i < all_types[ftype].count * feature_size; i++) {
-			if (!all_types[ftype].sf[i].name)
+			struct sysfs_attr *attr = &all_types[ftype].sf[i];
+			sensors_subfeature *sf;
+
+			if (!attr->name)
 				continue;
 
 			/* New main feature? */
 			if (i / feature_size != prev_slot) {
+				sensors_feature *feature;
+				size_t len;
+
 				fnum++;
 				prev_slot = i / feature_size;
 
-				dyn_features[fnum].name =
-					get_feature_name(ftype,
-						all_types[ftype].sf[i].name);
-				dyn_features[fnum].number = fnum;
-				dyn_features[fnum].first_subfeature = sfnum;
-				dyn_features[fnum].type = ftype;
+				feature = &chip->feature[fnum];
+				len = get_feature_name_len(ftype,
+						arena_names + attr->name - 1);
+				feature->name = arena_names + names_size;
+				memcpy(feature->name,
+				       arena_names + attr->name - 1, len);
+				feature->name[len] = '\0';
+				names_size += len + 1;
+				feature->number = fnum;
+				feature->first_subfeature = sfnum;
+				feature->type = ftype;
+				feature->padding1 = 0;
 			}
 
-			dyn_subfeatures[sfnum] = all_types[ftype].sf[i];
-			dyn_subfeatures[sfnum].number = sfnum;
+			sf = &chip->subfeature[sfnum];
+			sf->name = arena_names + attr->name - 1;
+			sf->number = sfnum;
+			sf->type = attr->type;
 			/* Back to the feature */
-			dyn_subfeatures[sfnum].mapping = fnum;
+			sf->mapping = fnum;
+			sf->flags = attr->flags;
 
 			sfnum++;
 		}
 	}
 
-	chip->subfeature = dyn_subfeatures;
-	chip->subfeature_count = sfnum;
-	chip->feature = dyn_features;
-	chip->feature_count = ++fnum;
+	sensors_init_chip_tables(chip);
 
 exit_free:
 	for (ftype = 0; ftype < SENSORS_FEATURE_MAX; ftype++)
 		free(all_types[ftype].sf);
+	free(names);
 	return 0;
 }
 
@@ -607,6 +726,12 @@ int sensors_init_sysfs(void)
 {
 	struct statfs statfsbuf;
 
+	if (sensors_sysfs_root) {
+		snprintf(sensors_sysfs_mount, NAME_MAX, "%s",
+			 sensors_sysfs_root);
+		return 1;
+	}
+
 	snprintf(sensors_sysfs_mount, NAME_MAX, "%s", "/sys");
 	if (statfs(sensors_sysfs_mount, &statfsbuf) < 0
 	 || statfsbuf.f_type != SYSFS_MAGIC)
@@ -616,9 +741,15 @@ int sensors_init_sysfs(void)
 }
 
 /* returns: number of devices added (0 or 1) if successful, <0 otherwise */
+/*
+ * Read a chip out of sysfs into entry. With lazy set, only the chip name
+ * is read, its features are left for sensors_discover_chip().
+ * Returns 1 if the chip was read, 0 if it was ignored, <0 on error.
+ */
 static int sensors_read_one_sysfs_chip(const char *dev_path,
 				       const char *dev_name,
-				       const char *hwmon_path)
+				       const char *hwmon_path,
+				       sensors_chip_features *chip, int lazy)
 {
 	int domain, bus, slot, fn, vendor, product, id;
 	int err = -SENSORS_ERR_KERNEL;
@@ -629,6 +760,8 @@ static int sensors_read_one_sysfs_chip(const char *dev_path,
 	int sub_len;
 	sensors_chip_features entry;
 
+	memset(&entry, 0, sizeof(entry));
+
 	/* ignore any device without name attribute */
 	if (!(entry.chip.prefix = sysfs_read_attr(hwmon_path, "name")))
 		return 0;
@@ -741,13 +874,19 @@ static int sensors_read_one_sysfs_chip(const char *dev_path,
 	}
 
 done:
+	if (lazy) {
+		*chip = entry;
+		return 1;
+	}
+
 	if (sensors_read_dynamic_chip(&entry, hwmon_path) < 0)
 		goto exit_free;
 	if (!entry.subfeature) { /* No subfeature, discard chip */
 		err = 0;
 		goto exit_free;
 	}
-	sensors_add_proc_chips(&entry);
+	entry.discovered = 1;
+	*chip = entry;
 
 	return 1;
 
@@ -757,14 +896,33 @@ exit_free:
 	return err;
 }
 
+/* Add a copy of a detected chip to the list */
+static sensors_chip_features *
+sensors_add_proc_chip(const sensors_chip_features *entry)
+{
+	sensors_chip_features *chip;
+
+	chip = malloc(sizeof(sensors_chip_features));
+	if (!chip)
+		sensors_fatal_error(__func__, "Out of memory");
+	*chip = *entry;
+	sensors_add_proc_chips(&chip);
+	sensors_hash_proc_chips();
+
+	return chip;
+}
+
 static int sensors_add_hwmon_device_compat(const char *path,
 					   const char *dev_name)
 {
+	sensors_chip_features entry;
 	int err;
 
-	err = sensors_read_one_sysfs_chip(path, dev_name, path);
+	err = sensors_read_one_sysfs_chip(path, dev_name, path, &entry, 0);
 	if (err < 0)
 		return err;
+	if (err)
+		sensors_add_proc_chip(&entry);
 	return 0;
 }
 
@@ -780,40 +938,271 @@ static int sensors_read_sysfs_chips_compat(void)
 	return 0;
 }
 
-static int sensors_add_hwmon_device(const char *path, const char *classdev)
+/*
+ * Read the chip behind a hwmon class device into entry, see
+ * sensors_read_one_sysfs_chip() for lazy.
+ * Returns 1 if the chip was read, 0 if it was ignored, <0 on error.
+ */
+static int sensors_read_hwmon_device(const char *path,
+				     sensors_chip_features *entry, int lazy)
 {
 	char linkpath[NAME_MAX];
 	char device[NAME_MAX], *device_p;
 	int dev_len, err;
-	(void)classdev; /* hide warning */
 
 	snprintf(linkpath, NAME_MAX, "%s/device", path);
 	dev_len = readlink(linkpath, device, NAME_MAX - 1);
 	if (dev_len < 0) {
 		/* No device link? Treat as virtual */
-		err = sensors_read_one_sysfs_chip(NULL, NULL, path);
+		err = sensors_read_one_sysfs_chip(NULL, NULL, path, entry,
+						  lazy);
 	} else {
 		device[dev_len] = '\0';
 		device_p = strrchr(device, '/') + 1;
 
 		/* The attributes we want might be those of the hwmon class
-		   device, or those of the device itself. */
-		err = sensors_read_one_sysfs_chip(linkpath, device_p, path);
+		   device, or those of the device itself. When lazy, the one
+		   with a name attribute is assumed to have them. */
+		err = sensors_read_one_sysfs_chip(linkpath, device_p, path,
+						  entry, lazy);
 		if (err == 0)
 			err = sensors_read_one_sysfs_chip(linkpath, device_p,
-							  linkpath);
+							  linkpath, entry,
+							  lazy);
 	}
+	return err;
+}
+
+static int sensors_add_hwmon_device(const char *path, const char *classdev)
+{
+	sensors_chip_features entry;
+	int err;
+	(void)classdev; /* hide warning */
+
+	err = sensors_read_hwmon_device(path, &entry, 1);
 	if (err < 0)
 		return err;
+	if (err)
+		sensors_add_proc_chip(&entry);
 	return 0;
 }
 
+/* Look up the chip of a hwmon class device. Its attributes are either
+   those of the class device or those of the device itself. */
+static sensors_chip_features *sensors_lookup_hwmon(const char *path)
+{
+	size_t len = strlen(path);
+	const char *p;
+	int i;
+
+	for (i = 0; i < sensors_proc_chips_count; i++) {
+		p = sensors_proc_chips[i]->chip.path;
+		if (!strncmp(p, path, len) &&
+		    (p[len] == '\0' || !strcmp(p + len, "/device")))
+			return sensors_proc_chips[i];
+	}
+	return NULL;
+}
+
+const sensors_chip_name *sensors_get_hwmon_chip(const char *classdev)
+{
+	char path[PATH_MAX];
+	sensors_chip_features *chip;
+
+	/* A truncated path could match another device */
+	if (snprintf(path, PATH_MAX, "%s/class/hwmon/%s", sensors_sysfs_mount,
+		     classdev) >= PATH_MAX)
+		return NULL;
+	chip = sensors_lookup_hwmon(path);
+	/* A chip not discovered yet is known, unless it is found empty */
+	if (!chip ||
+	    (__atomic_load_n(&chip->discovered, __ATOMIC_ACQUIRE) &&
+	     !chip->subfeature_count))
+		return NULL;
+	return &chip->chip;
+}
+
+int sensors_add_hwmon(const char *classdev, const sensors_chip_name **chip)
+{
+	char path[PATH_MAX];
+	sensors_chip_features entry, *features;
+	int err;
+
+	*chip = NULL;
+	if (strchr(classdev, '/') || classdev[0] == '.' ||
+	    snprintf(path, PATH_MAX, "%s/class/hwmon/%s", sensors_sysfs_mount,
+		     classdev) >= PATH_MAX)
+		return -SENSORS_ERR_NO_ENTRY;
+
+	/* Already known, for example after a duplicate event */
+	features = sensors_lookup_hwmon(path);
+	if (features) {
+		if (sensors_discover_chip(features))
+			*chip = &features->chip;
+		return 0;
+	}
+
+	sensors_init_max_sf();
+	err = sensors_read_hwmon_device(path, &entry, 0);
+	if (err < 0)
+		return err;
+	if (!err)
+		return 0;	/* No sensors */
+
+	features = sensors_add_proc_chip(&entry);
+	sensors_resolve_chip_config(features);
+	sensors_init_chip_stats(features);
+	*chip = &features->chip;
+	return 0;
+}
+
+/* State shared by the threads reading hwmon devices in parallel. Each
+   thread picks the next device to read, and stores the result in the slot
+   of that device, so that the chips can be added in directory order. */
+struct sysfs_scan {
+	pthread_mutex_t lock;
+	int next;
+	int count;
+	char **paths;
+	struct {
+		int err;
+		sensors_chip_features entry;
+	} *results;
+};
+
+static void *sensors_scan_thread(void *arg)
+{
+	struct sysfs_scan *scan = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&scan->lock);
+		i = scan->next++;
+		pthread_mutex_unlock(&scan->lock);
+		if (i >= scan->count)
+			break;
+
+		scan->results[i].err =
+			sensors_read_hwmon_device(scan->paths[i],
+						  &scan->results[i].entry, 0);
+	}
+	return NULL;
+}
+
+/*
+ * Read all hwmon class devices, using several threads.
+ * Returns 0 on success, a positive errno for local errors, or a negative
+ * error value if reading any device failed.
+ */
+static int sensors_read_sysfs_chips_parallel(void)
+{
+	char path[NAME_MAX], *p;
+	pthread_t threads[MAX_SCAN_THREADS];
+	struct sysfs_scan scan;
+	int path_off, max = 0, ret = 0, i, nthreads;
+	long ncpus;
+	DIR *dir;
+	struct dirent *ent;
+
+	path_off = snprintf(path, NAME_MAX, "%s/class/hwmon",
+			    sensors_sysfs_mount);
+	if (!(dir = opendir(path)))
+		return errno;
+
+	memset(&scan, 0, sizeof(scan));
+	while ((ent = readdir(dir))) {
+		if (ent->d_name[0] == '.')	/* skip hidden entries */
+			continue;
+
+		snprintf(path + path_off, NAME_MAX - path_off, "/%s",
+			 ent->d_name);
+		if (!(p = strdup(path)))
+			sensors_fatal_error(__func__, "Out of memory");
+		sensors_add_array_el(&p, &scan.paths, &scan.count, &max,
+				     sizeof(char *));
+	}
+	closedir(dir);
+
+	if (!scan.count)
+		return 0;
+
+	scan.results = calloc(scan.count, sizeof(*scan.results));
+	if (!scan.results)
+		sensors_fatal_error(__func__, "Out of memory");
+	pthread_mutex_init(&scan.lock, NULL);
+
+	/* The calling thread does its share of the work, so we're fine
+	   even if no thread can be created */
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = scan.count - 1;
+	if (nthreads > ncpus - 1)
+		nthreads = ncpus - 1;
+	if (nthreads > MAX_SCAN_THREADS)
+		nthreads = MAX_SCAN_THREADS;
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&threads[i], NULL, sensors_scan_thread,
+				   &scan))
+			break;
+	nthreads = i;
+
+	sensors_scan_thread(&scan);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&scan.lock);
+
+	/* Merge in directory order. On error, the chips are still added,
+	   so that they get freed by sensors_cleanup(). */
+	for (i = 0; i < scan.count; i++) {
+		if (scan.results[i].err < 0 && !ret)
+			ret = scan.results[i].err;
+		else if (scan.results[i].err > 0)
+			sensors_add_proc_chip(&scan.results[i].entry);
+		free(scan.paths[i]);
+	}
+	free(scan.results);
+	free(scan.paths);
+
+	return ret;
+}
+
+/* Serializes the discovery of the chips detected lazily, which happens
+   while other threads may read the same context */
+static pthread_mutex_t sensors_discover_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int sensors_discover_chip(sensors_chip_features *chip)
+{
+	if (!__atomic_load_n(&chip->discovered, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&sensors_discover_lock);
+		if (!chip->discovered) {
+			/* A chip which can't be read is as good as empty */
+			if (sensors_read_dynamic_chip(chip, chip->chip.path) >= 0
+			    && chip->subfeature) {
+				sensors_resolve_chip_config(chip);
+				sensors_init_chip_stats(chip);
+			}
+			__atomic_store_n(&chip->discovered, 1,
+					 __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&sensors_discover_lock);
+	}
+	return chip->subfeature_count > 0;
+}
+
+/* The hwmon devices are read in parallel with SENSORS_FLAG_PARALLEL_INIT,
+   as the caller then wants all of them. Otherwise only their names are
+   read, and their features the first time they are used. */
 /* returns 0 if successful, !0 otherwise */
 int sensors_read_sysfs_chips(void)
 {
 	int ret;
 
-	ret = sysfs_foreach_classdev("hwmon", sensors_add_hwmon_device);
+	sensors_init_max_sf();
+
+	if (sensors_flags & SENSORS_FLAG_PARALLEL_INIT)
+		ret = sensors_read_sysfs_chips_parallel();
+	else
+		ret = sysfs_foreach_classdev("hwmon",
+					     sensors_add_hwmon_device);
 	if (ret == ENOENT) {
 		/* compatibility function for kernel 2.6.n where n <= 13 */
 		return sensors_read_sysfs_chips_compat();
@@ -860,69 +1249,831 @@ int sensors_read_sysfs_bus(void)
 	return 0;
 }
 
-int sensors_read_sysfs_attr(const sensors_chip_name *name,
+/*
+ * Parse the contents of a sysfs attribute file holding a plain integer,
+ * as attribute values are in all but exotic cases.
+ * Returns 0 on success, -1 if buf holds anything else, or an integer which
+ * doesn't fit in a long long.
+ */
+static int sysfs_parse_int(const char *buf, long long *value)
+{
+	const char *p = buf;
+	unsigned long long v = 0, max = LLONG_MAX;
+	int digits = 0, digit, neg = 0;
+
+	if (*p == '-') {
+		neg = 1;
+		max++;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9') {
+		digit = *p++ - '0';
+		if (v > (max - digit) / 10)
+			return -1;
+		v = v * 10 + digit;
+		digits++;
+	}
+	if (!digits || (*p != '\n' && *p != '\0'))
+		return -1;
+
+	*value = neg && v ? -(long long)(v - 1) - 1 : (long long)v;
+	return 0;
+}
+
+/*
+ * Parse the contents of a sysfs attribute file, falling back to strtod()
+ * for anything but an integer.
+ * Returns 0 on success, -1 if no value could be parsed.
+ */
+static int sysfs_parse_value(const char *buf, double *value)
+{
+	long long v;
+	char *end;
+
+	if (!sysfs_parse_int(buf, &v)) {
+		*value = v;
+		return 0;
+	}
+
+	*value = strtod(buf, &end);
+	if (end == buf)
+		return -1;
+	return 0;
+}
+
+/* Same as sysfs_parse_value(), rounding anything but an integer. Values
+   out of the range of a long long are an error. */
+static int sysfs_parse_raw(const char *buf, long long *value)
+{
+	double v;
+
+	if (!sysfs_parse_int(buf, value))
+		return 0;
+
+	if (sysfs_parse_value(buf, &v) || !(fabs(v) < 9e18))
+		return -1;
+	*value = llround(v);
+	return 0;
+}
+
+/*
+ * A stale descriptor dropped from the cache may still be in use by another
+ * thread which loaded it before, and closing it would let open() reuse its
+ * number for another file right away. So it is only closed once no thread
+ * holds the cached descriptors of its chip, see sysfs_hold_fds(). Until
+ * then, it waits in this list, protected by sysfs_stale_lock. It is only
+ * filled when devices go away, so it is usually empty.
+ */
+struct sysfs_stale_fd {
+	const int *users;	/* fd_users of the chip */
+	int fd;
+};
+
+static pthread_mutex_t sysfs_stale_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sysfs_stale_fd *sysfs_stale;
+static int sysfs_stale_count, sysfs_stale_max;
+
+/* Close the stale descriptors of a chip, with sysfs_stale_lock held */
+static void sysfs_close_stale(const int *users)
+{
+	int i;
+
+	for (i = sysfs_stale_count - 1; i >= 0; i--) {
+		if (sysfs_stale[i].users != users)
+			continue;
+		close(sysfs_stale[i].fd);
+		sysfs_stale[i] = sysfs_stale[sysfs_stale_count - 1];
+		__atomic_store_n(&sysfs_stale_count, sysfs_stale_count - 1,
+				 __ATOMIC_SEQ_CST);
+	}
+}
+
+/* Close the cached attribute file descriptors of a chip, including the
+   one of the directory */
+void sensors_close_sysfs_attrs(sensors_chip_features *chip)
+{
+	int i;
+
+	if (!chip->subfeature_fd)
+		return;
+
+	for (i = 0; i <= chip->subfeature_count; i++) {
+		if (chip->subfeature_fd[i] >= 0) {
+			close(chip->subfeature_fd[i]);
+			chip->subfeature_fd[i] = -1;
+		}
+	}
+
+	pthread_mutex_lock(&sysfs_stale_lock);
+	sysfs_close_stale(chip->fd_users);
+	pthread_mutex_unlock(&sysfs_stale_lock);
+}
+
+/* Must be called before loading a descriptor from the cache of a chip,
+   and sysfs_release_fds() once done with it */
+static void sysfs_hold_fds(const sensors_chip_features *chip)
+{
+	__atomic_add_fetch(chip->fd_users, 1, __ATOMIC_SEQ_CST);
+}
+
+/* The last thread to release the descriptors of a chip closes the stale
+   ones, as no other thread can still use them */
+static void sysfs_release_fds(const sensors_chip_features *chip)
+{
+	if (__atomic_sub_fetch(chip->fd_users, 1, __ATOMIC_SEQ_CST) ||
+	    !__atomic_load_n(&sysfs_stale_count, __ATOMIC_SEQ_CST))
+		return;
+
+	pthread_mutex_lock(&sysfs_stale_lock);
+	/* Unless another thread took them in the meantime */
+	if (!__atomic_load_n(chip->fd_users, __ATOMIC_SEQ_CST))
+		sysfs_close_stale(chip->fd_users);
+	pthread_mutex_unlock(&sysfs_stale_lock);
+}
+
+/*
+ * The descriptor cache is shared by the threads reading the same context,
+ * without a lock: a newly opened descriptor is only stored if the slot is
+ * still empty, otherwise the one stored by another thread is used instead.
+ * The caller holds the descriptors of the chip. Returns the descriptor to
+ * use.
+ */
+static int sysfs_cache_fd(int *slot, int fd)
+{
+	int cached = -1;
+
+	if (__atomic_compare_exchange_n(slot, &cached, fd, 0, __ATOMIC_ACQ_REL,
+					__ATOMIC_ACQUIRE))
+		return fd;
+	close(fd);
+	return cached;
+}
+
+/* Drop a stale descriptor from the cache, unless another thread already
+   did. The caller holds the descriptors of the chip, so the descriptor
+   gets closed at the latest when it releases them. */
+static void sysfs_uncache_fd(const sensors_chip_features *chip, int *slot,
+			     int fd)
+{
+	struct sysfs_stale_fd stale;
+	int count;
+
+	if (!__atomic_compare_exchange_n(slot, &fd, -1, 0, __ATOMIC_ACQ_REL,
+					 __ATOMIC_RELAXED))
+		return;
+
+	stale.users = chip->fd_users;
+	stale.fd = fd;
+	pthread_mutex_lock(&sysfs_stale_lock);
+	/* The count is read without the lock by sysfs_release_fds() */
+	count = sysfs_stale_count;
+	sensors_add_array_el(&stale, &sysfs_stale, &count, &sysfs_stale_max,
+			     sizeof(stale));
+	__atomic_store_n(&sysfs_stale_count, count, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&sysfs_stale_lock);
+}
+
+/*
+ * Open the attribute file of a subfeature, flags being O_RDONLY, O_WRONLY
+ * or O_RDWR. If cached is set, the chip directory is kept open, and the
+ * file is opened relative to it, which saves the kernel from resolving the
+ * whole path every time.
+ * Returns the file descriptor, or -1 on error.
+ */
+static int sysfs_open_attr(const sensors_chip_features *chip,
+			   const sensors_subfeature *subfeature, int cached,
+			   int flags)
+{
+	char n[NAME_MAX];
+	int *slot, dir_fd, fd;
+
+	if (cached) {
+		slot = &chip->subfeature_fd[chip->subfeature_count];
+		sysfs_hold_fds(chip);
+		dir_fd = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+		if (dir_fd < 0) {
+			dir_fd = open(chip->chip.path,
+				      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (dir_fd >= 0)
+				dir_fd = sysfs_cache_fd(slot, dir_fd);
+		}
+		if (dir_fd >= 0) {
+			fd = openat(dir_fd, subfeature->name,
+				    flags | O_CLOEXEC);
+			if (fd < 0 && errno != EACCES)
+				/* The directory may be stale, don't keep it */
+				sysfs_uncache_fd(chip, slot, dir_fd);
+			else {
+				sysfs_release_fds(chip);
+				return fd;
+			}
+		}
+		sysfs_release_fds(chip);
+	}
+
+	snprintf(n, NAME_MAX, "%s/%s", chip->chip.path, subfeature->name);
+	return open(n, flags | O_CLOEXEC);
+}
+
+/* Open the attribute file of a subfeature for the cache. Writable
+   attributes are opened for writing as well if permitted, so that the
+   same file descriptor serves sensors_set_value() too. */
+static int sysfs_open_cached(const sensors_chip_features *chip,
+			     const sensors_subfeature *subfeature)
+{
+	int fd = -1;
+
+	if (subfeature->flags & SENSORS_MODE_W)
+		fd = sysfs_open_attr(chip, subfeature, 1, O_RDWR);
+	if (fd < 0)
+		fd = sysfs_open_attr(chip, subfeature, 1, O_RDONLY);
+	return fd;
+}
+
+/* The error of a failed read, len being -errno, or 0 if the read
+   succeeded. buf must have room for one more byte than read, it gets
+   terminated. */
+static int sysfs_read_error(char *buf, ssize_t len)
+{
+	if (len < 0)
+		return len == -EIO ? -SENSORS_ERR_IO : -SENSORS_ERR_ACCESS_R;
+	buf[len] = '\0';
+	return 0;
+}
+
+/* Parse the raw, unscaled value read from an attribute file, len being
+   the number of bytes read into buf (which must have room for one more),
+   or -errno if the read failed. Returns 0 on success, <0 on error. */
+static int sysfs_parse_read(char *buf, ssize_t len, double *value)
+{
+	int res;
+
+	if ((res = sysfs_read_error(buf, len)))
+		return res;
+	if (sysfs_parse_value(buf, value))
+		return -SENSORS_ERR_ACCESS_R;
+
+	return 0;
+}
+
+/* Same as sysfs_parse_read(), for the integer itself */
+static int sysfs_parse_read_raw(char *buf, ssize_t len, long long *value)
+{
+	int res;
+
+	if ((res = sysfs_read_error(buf, len)))
+		return res;
+	if (sysfs_parse_raw(buf, value))
+		return -SENSORS_ERR_ACCESS_R;
+
+	return 0;
+}
+
+/* Read the contents of an open attribute file into buf, which must be
+   ATTR_MAX bytes large. Returns the number of bytes read, or -errno. */
+static ssize_t sysfs_read_buf(int fd, char *buf)
+{
+	ssize_t len;
+
+	len = pread(fd, buf, ATTR_MAX - 1, 0);
+	return len < 0 ? -errno : len;
+}
+
+/* Read and parse the raw, unscaled value of an open attribute file.
+   Returns 0 on success, <0 on error, with the errno of a failed read in
+   *err. */
+static int sysfs_read_fd(int fd, double *value, int *err)
+{
+	char buf[ATTR_MAX];
+	ssize_t len;
+
+	len = sysfs_read_buf(fd, buf);
+	*err = len < 0 ? -len : 0;
+	return sysfs_parse_read(buf, len, value);
+}
+
+/* Get a file descriptor to read a subfeature, from the file descriptor
+   cache if enabled, in which case *cached_fd is set to its slot and the
+   descriptors of the chip are held, until the caller releases them.
+   Otherwise *cached_fd is set to NULL and the caller closes the descriptor.
+   Returns the file descriptor, or -1 on error. */
+static int sysfs_get_read_fd(const sensors_chip_features *chip,
+			     const sensors_subfeature *subfeature,
+			     int **cached_fd)
+{
+	int fd;
+
+	*cached_fd = NULL;
+	if (!chip->subfeature_fd || !(sensors_flags & SENSORS_FLAG_CACHE_FD))
+		return sysfs_open_attr(chip, subfeature, 0, O_RDONLY);
+
+	*cached_fd = &chip->subfeature_fd[subfeature->number];
+	sysfs_hold_fds(chip);
+	fd = __atomic_load_n(*cached_fd, __ATOMIC_ACQUIRE);
+	if (fd < 0) {
+		fd = sysfs_open_cached(chip, subfeature);
+		if (fd >= 0)
+			fd = sysfs_cache_fd(*cached_fd, fd);
+		else
+			sysfs_release_fds(chip);
+	}
+	return fd;
+}
+
+/* Read the attribute file of a subfeature into buf (ATTR_MAX bytes),
+   through the file descriptor cache if enabled, and set *len to the
+   number of bytes read, or -errno. Returns 0 on success, <0 if the file
+   couldn't be opened. */
+static int sysfs_read_attr_buf(const sensors_chip_features *chip,
+			       const sensors_subfeature *subfeature,
+			       char *buf, ssize_t *len)
+{
+	int *cached_fd;
+	int fd;
+
+	fd = sysfs_get_read_fd(chip, subfeature, &cached_fd);
+	if (fd < 0)
+		return -SENSORS_ERR_KERNEL;
+
+	*len = sysfs_read_buf(fd, buf);
+
+	if (!cached_fd) {
+		close(fd);
+	} else {
+		/* The device is gone, don't keep a stale descriptor */
+		if (*len == -ENODEV)
+			sysfs_uncache_fd(chip, cached_fd, fd);
+		sysfs_release_fds(chip);
+	}
+
+	return 0;
+}
+
+/* Read the raw value of a subfeature, through the file descriptor cache
+   if enabled */
+static int sysfs_read_raw(const sensors_chip_features *chip,
+			  const sensors_subfeature *subfeature,
+			  double *value)
+{
+	char buf[ATTR_MAX];
+	ssize_t len;
+	int res;
+
+	if ((res = sysfs_read_attr_buf(chip, subfeature, buf, &len)))
+		return res;
+	return sysfs_parse_read(buf, len, value);
+}
+
+void sensors_init_chip_stats(sensors_chip_features *chip)
+{
+	if (!(sensors_flags & SENSORS_FLAG_STATS) || chip->subfeature_stats ||
+	    !chip->subfeature_count)
+		return;
+
+	chip->subfeature_stats = calloc(chip->subfeature_count,
+					sizeof(sensors_subfeature_stats));
+	if (!chip->subfeature_stats)
+		sensors_fatal_error(__func__, "Out of memory");
+}
+
+/* The statistics to record an operation in, or NULL if not enabled */
+static sensors_io_stats *sysfs_stats(const sensors_chip_features *chip,
+				     const sensors_subfeature *subfeature,
+				     int write)
+{
+	sensors_subfeature_stats *stats;
+
+	if (!chip->subfeature_stats || !(sensors_flags & SENSORS_FLAG_STATS))
+		return NULL;
+	stats = &chip->subfeature_stats[subfeature->number];
+	return write ? &stats->write : &stats->read;
+}
+
+/* Record an operation which started at start and returned res. Several
+   threads may record at the same time, so the counters are updated
+   atomically, but independently of each other. */
+static void sysfs_record(sensors_io_stats *stats,
+			 const struct timespec *start, int res)
+{
+	struct timespec end;
+	unsigned long long ns, us, max;
+	int bucket;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = (end.tv_sec - start->tv_sec) * 1000000000ULL + end.tv_nsec -
+	     start->tv_nsec;
+
+	__atomic_fetch_add(&stats->count, 1, __ATOMIC_RELAXED);
+	if (res == -SENSORS_ERR_IO)
+		__atomic_fetch_add(&stats->io_errors, 1, __ATOMIC_RELAXED);
+	else if (res == -SENSORS_ERR_ACCESS_R || res == -SENSORS_ERR_ACCESS_W)
+		__atomic_fetch_add(&stats->access_errors, 1, __ATOMIC_RELAXED);
+	else if (res == -SENSORS_ERR_KERNEL)
+		__atomic_fetch_add(&stats->kernel_errors, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->total_ns, ns, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&stats->max_ns, __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&stats->max_ns, &max, ns, 1,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	us = ns / 1000;
+	bucket = us < 2 ? 0 : 63 - __builtin_clzll(us);
+	if (bucket >= SENSORS_STATS_BUCKETS)
+		bucket = SENSORS_STATS_BUCKETS - 1;
+	__atomic_fetch_add(&stats->histogram[bucket], 1, __ATOMIC_RELAXED);
+}
+
+void sensors_init_value_cache(sensors_chip_features *chip, double maxage,
+			      int learn)
+{
+	sensors_value_cache *cache;
+
+	if (!(maxage > 0) || !chip->subfeature_count)
+		return;
+
+	if (!(cache = calloc(1, sizeof(*cache))) ||
+	    !(cache->values = calloc(chip->subfeature_count,
+				     sizeof(sensors_cached_value))))
+		sensors_fatal_error(__func__, "Out of memory");
+	cache->maxage_ns = maxage * 1e9;
+	cache->learn = learn;
+	chip->value_cache = cache;
+}
+
+static long long sysfs_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* Get the cached value of a subfeature if it is recent enough, returns 0
+   if there is one. With auto, values are only cached for the interval at
+   which some value of the chip was seen changing, once one was. */
+static int sysfs_cache_get(const sensors_chip_features *chip,
+			   const sensors_subfeature *subfeature,
+			   long long now, double *value)
+{
+	sensors_value_cache *cache = chip->value_cache;
+	sensors_cached_value *entry = &cache->values[subfeature->number];
+	long long maxage = cache->maxage_ns, learned, read_ns;
+	unsigned int seq;
+	double val;
+
+	if (cache->learn) {
+		learned = __atomic_load_n(&cache->learned_ns,
+					  __ATOMIC_RELAXED);
+		if (learned < maxage)
+			maxage = learned;
+	}
+
+	/* Other threads may be updating the entry, retry rather than wait */
+	seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+	if (seq & 1)
+		return -1;
+	read_ns = __atomic_load_n(&entry->read_ns, __ATOMIC_RELAXED);
+	__atomic_load(&entry->value, &val, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq ||
+	    !read_ns || now - read_ns >= maxage)
+		return -1;
+
+	*value = val;
+	return 0;
+}
+
+/* Store a value read at time now. If another thread is updating the
+   entry, its value is as good. */
+static void sysfs_cache_put(const sensors_chip_features *chip,
+			    const sensors_subfeature *subfeature,
+			    long long now, double value)
+{
+	sensors_value_cache *cache = chip->value_cache;
+	sensors_cached_value *entry = &cache->values[subfeature->number];
+	long long changed, interval, learned;
+	unsigned int seq;
+
+	seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+	if ((seq & 1) ||
+	    !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	/* Only ever returned by a slower read started earlier, or by a read
+	   started before a write */
+	if (now < entry->read_ns || now < entry->forgot_ns)
+		goto unlock;
+
+	/* A value changing for the second time tells how often the driver
+	   refreshes it, at most */
+	changed = entry->changed_ns;
+	if (entry->read_ns && value != entry->value) {
+		interval = now - changed;
+		learned = __atomic_load_n(&cache->learned_ns,
+					  __ATOMIC_RELAXED);
+		while (changed && cache->learn &&
+		       (!learned || interval < learned) &&
+		       !__atomic_compare_exchange_n(&cache->learned_ns,
+						    &learned, interval, 1,
+						    __ATOMIC_RELAXED,
+						    __ATOMIC_RELAXED))
+			;
+		changed = now;
+	}
+
+	__atomic_store_n(&entry->changed_ns, changed, __ATOMIC_RELAXED);
+	__atomic_store(&entry->value, &value, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->read_ns, now, __ATOMIC_RELAXED);
+unlock:
+	__atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Forget the cached value of a subfeature, as well as the values of the
+   reads started until now. Unlike storing a value, this can't be skipped,
+   so wait for the other threads updating the entry. */
+static void sysfs_cache_forget(const sensors_chip_features *chip,
+			       const sensors_subfeature *subfeature)
+{
+	sensors_value_cache *cache = chip->value_cache;
+	sensors_cached_value *entry = &cache->values[subfeature->number];
+	long long now = sysfs_now();
+	unsigned int seq;
+
+	seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+	while ((seq & 1) ||
+	       !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, 1,
+					    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		sched_yield();
+		seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+	}
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	entry->forgot_ns = now;
+	__atomic_store_n(&entry->changed_ns, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->read_ns, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int sensors_read_sysfs_attr(const sensors_chip_features *chip,
 			    const sensors_subfeature *subfeature,
 			    double *value)
 {
-	char n[NAME_MAX];
-	FILE *f;
+	sensors_io_stats *stats = sysfs_stats(chip, subfeature, 0);
+	struct timespec start;
+	long long now = 0;
+	int res;
+
+	if (chip->value_cache) {
+		now = sysfs_now();
+		if (!sysfs_cache_get(chip, subfeature, now, value))
+			return 0;
+	}
 
-	snprintf(n, NAME_MAX, "%s/%s", name->path, subfeature->name);
-	if ((f = fopen(n, "r"))) {
-		int res, err = 0;
-
-		errno = 0;
-		res = fscanf(f, "%lf", value);
-		if (res == EOF && errno == EIO)
-			err = -SENSORS_ERR_IO;
-		else if (res != 1)
-			err = -SENSORS_ERR_ACCESS_R;
-		res = fclose(f);
-		if (err)
-			return err;
-
-		if (res == EOF) {
-			if (errno == EIO)
-				return -SENSORS_ERR_IO;
-			else 
-				return -SENSORS_ERR_ACCESS_R;
+	if (stats)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	res = sysfs_read_raw(chip, subfeature, value);
+	if (stats)
+		sysfs_record(stats, &start, res);
+
+	if (!res) {
+		*value /= get_scaling(chip, subfeature);
+		if (chip->value_cache)
+			sysfs_cache_put(chip, subfeature, now, *value);
+	}
+	return res;
+}
+
+int sensors_read_sysfs_attr_raw(const sensors_chip_features *chip,
+				const sensors_subfeature *subfeature,
+				long long *value)
+{
+	sensors_io_stats *stats = sysfs_stats(chip, subfeature, 0);
+	struct timespec start;
+	long long now = 0;
+	char buf[ATTR_MAX];
+	ssize_t len;
+	double cached;
+	int res;
+
+	/* The cache holds scaled values, which are exact enough to get the
+	   integers back */
+	if (chip->value_cache) {
+		now = sysfs_now();
+		if (!sysfs_cache_get(chip, subfeature, now, &cached)) {
+			*value = llround(cached * get_scaling(chip, subfeature));
+			return 0;
 		}
-		*value /= get_type_scaling(subfeature->type);
-	} else
-		return -SENSORS_ERR_KERNEL;
+	}
+
+	if (stats)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	res = sysfs_read_attr_buf(chip, subfeature, buf, &len);
+	if (!res)
+		res = sysfs_parse_read_raw(buf, len, value);
+	if (stats)
+		sysfs_record(stats, &start, res);
+
+	if (!res && chip->value_cache)
+		sysfs_cache_put(chip, subfeature, now,
+				*value / get_scaling(chip, subfeature));
+	return res;
+}
+
+int sensors_open_sysfs_read(const sensors_chip_features *chip,
+			    const sensors_subfeature *subfeature,
+			    struct sensors_sysfs_read *read, double *value)
+{
+	sensors_io_stats *stats = sysfs_stats(chip, subfeature, 0);
+
+	read->len = 0;
+	read->time_ns = 0;
+	if (chip->value_cache) {
+		read->time_ns = sysfs_now();
+		if (!sysfs_cache_get(chip, subfeature, read->time_ns, value)) {
+			read->fd = -1;
+			return 1;
+		}
+	}
 
+	/* The latency of a batch read is from submission to completion */
+	if (stats)
+		clock_gettime(CLOCK_MONOTONIC, &read->start);
+	read->fd = sysfs_get_read_fd(chip, subfeature, &read->cached_fd);
+	if (read->fd < 0) {
+		if (stats)
+			sysfs_record(stats, &read->start, -SENSORS_ERR_KERNEL);
+		return -SENSORS_ERR_KERNEL;
+	}
 	return 0;
 }
 
-int sensors_write_sysfs_attr(const sensors_chip_name *name,
-			     const sensors_subfeature *subfeature,
-			     double value)
+int sensors_finish_sysfs_read(const sensors_chip_features *chip,
+			      const sensors_subfeature *subfeature,
+			      struct sensors_sysfs_read *read, double *value)
 {
-	char n[NAME_MAX];
-	FILE *f;
+	sensors_io_stats *stats = sysfs_stats(chip, subfeature, 0);
+	int res;
+
+	res = sysfs_parse_read(read->buf, read->len, value);
+	if (stats)
+		sysfs_record(stats, &read->start, res);
+	if (!res) {
+		*value /= get_scaling(chip, subfeature);
+		if (chip->value_cache)
+			sysfs_cache_put(chip, subfeature, read->time_ns,
+					*value);
+	}
+
+	if (!read->cached_fd) {
+		close(read->fd);
+	} else {
+		if (read->len == -ENODEV)
+			sysfs_uncache_fd(chip, read->cached_fd, read->fd);
+		sysfs_release_fds(chip);
+	}
+	read->fd = -1;
+
+	return res;
+}
+
+int sensors_open_sysfs_poll(const sensors_chip_features *chip,
+			    const sensors_subfeature *subfeature,
+			    double *value)
+{
+	sensors_io_stats *stats = sysfs_stats(chip, subfeature, 0);
+	struct timespec start;
+	int fd, err, res;
+
+	if (stats)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	fd = sysfs_open_attr(chip, subfeature, 0, O_RDONLY);
+	if (fd < 0) {
+		if (stats)
+			sysfs_record(stats, &start, -SENSORS_ERR_KERNEL);
+		return -SENSORS_ERR_KERNEL;
+	}
+
+	/* Reading the value once is what arms the notification */
+	res = sysfs_read_fd(fd, value, &err);
+	if (stats)
+		sysfs_record(stats, &start, res);
+	if (res) {
+		close(fd);
+		return res;
+	}
+	*value /= get_scaling(chip, subfeature);
+	return fd;
+}
+
+int sensors_read_sysfs_poll(const sensors_chip_features *chip, int fd,
+			    const sensors_subfeature *subfeature,
+			    double *value)
+{
+	sensors_io_stats *stats = sysfs_stats(chip, subfeature, 0);
+	struct timespec start;
+	int err, res;
+
+	if (stats)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	res = sysfs_read_fd(fd, value, &err);
+	if (stats)
+		sysfs_record(stats, &start, res);
+	if (!res)
+		*value /= get_scaling(chip, subfeature);
+	return res;
+}
+
+/* Write a buffer to an open attribute file. Returns 0 on success, or the
+   errno of the failed write. */
+static int sysfs_write_fd(int fd, const char *buf, int len)
+{
+	ssize_t res;
 
-	snprintf(n, NAME_MAX, "%s/%s", name->path, subfeature->name);
-	if ((f = fopen(n, "w"))) {
-		int res, err = 0;
-
-		value *= get_type_scaling(subfeature->type);
-		res = fprintf(f, "%d", (int) value);
-		if (res == -EIO)
-			err = -SENSORS_ERR_IO;
-		else if (res < 0)
-			err = -SENSORS_ERR_ACCESS_W;
-		res = fclose(f);
-		if (err)
-			return err;
-
-		if (res == EOF) {
-			if (errno == EIO)
-				return -SENSORS_ERR_IO;
-			else 
-				return -SENSORS_ERR_ACCESS_W;
+	res = pwrite(fd, buf, len, 0);
+	if (res < 0)
+		return errno;
+	return res == len ? 0 : EIO;
+}
+
+static int sysfs_write_error(int err)
+{
+	if (!err)
+		return 0;
+	return err == EIO ? -SENSORS_ERR_IO : -SENSORS_ERR_ACCESS_W;
+}
+
+static int sysfs_write_attr(const sensors_chip_features *chip,
+			    const sensors_subfeature *subfeature,
+			    double value, int only_changed)
+{
+	char buf[16];
+	int *cached_fd = NULL;
+	int fd, len, raw, err;
+	double current;
+
+	if (chip->subfeature_fd && (sensors_flags & SENSORS_FLAG_CACHE_FD))
+		cached_fd = &chip->subfeature_fd[subfeature->number];
+
+	raw = (int) (value * get_scaling(chip, subfeature));
+
+	/* Writing a limit can be a slow bus transaction, don't write the
+	   value the attribute already holds */
+	if (only_changed && (subfeature->flags & SENSORS_MODE_R) &&
+	    !sysfs_read_raw(chip, subfeature, &current) && current == raw)
+		return 0;
+
+	len = snprintf(buf, sizeof(buf), "%d", raw);
+
+	if (cached_fd) {
+		sysfs_hold_fds(chip);
+		fd = __atomic_load_n(cached_fd, __ATOMIC_ACQUIRE);
+		if (fd < 0) {
+			fd = sysfs_open_cached(chip, subfeature);
+			if (fd >= 0)
+				fd = sysfs_cache_fd(cached_fd, fd);
 		}
-	} else
+		err = EBADF;
+		if (fd >= 0) {
+			err = sysfs_write_fd(fd, buf, len);
+			if (err == ENODEV)
+				sysfs_uncache_fd(chip, cached_fd, fd);
+		}
+		sysfs_release_fds(chip);
+		/* Unless it could only be opened for reading */
+		if (err != EBADF)
+			return sysfs_write_error(err);
+	}
+
+	fd = sysfs_open_attr(chip, subfeature, cached_fd != NULL,
+			     O_WRONLY | O_TRUNC);
+	if (fd < 0)
 		return -SENSORS_ERR_KERNEL;
+	err = sysfs_write_fd(fd, buf, len);
+	close(fd);
 
-	return 0;
+	return sysfs_write_error(err);
+}
+
+int sensors_write_sysfs_attr(const sensors_chip_features *chip,
+			     const sensors_subfeature *subfeature,
+			     double value, int only_changed)
+{
+	sensors_io_stats *stats = sysfs_stats(chip, subfeature, 1);
+	struct timespec start;
+	int res;
+
+	if (stats)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+	res = sysfs_write_attr(chip, subfeature, value, only_changed);
+	if (stats)
+		sysfs_record(stats, &start, res);
+
+	/* Whatever happened, the cached value may not be valid anymore */
+	if (chip->value_cache)
+		sysfs_cache_forget(chip, subfeature);
+	return res;
 }
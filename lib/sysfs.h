@@ -22,22 +22,102 @@
 #ifndef LIB_SENSORS_SYSFS_H
 #define LIB_SENSORS_SYSFS_H
 
+#include <time.h>
+
+/* The size of the buffer attribute files are read into */
+#define ATTR_MAX	128
+
 extern char sensors_sysfs_mount[];
 
+/* If set, the directory used instead of /sys, without checking that it is
+   a sysfs mount. This lets the benchmark run on a synthetic tree. */
+extern const char *sensors_sysfs_root;
+
 int sensors_init_sysfs(void);
 
 int sensors_read_sysfs_chips(void);
 
+/* Read the features of a chip detected without them, if not done yet.
+   Returns whether the chip has any subfeature; the empty ones are
+   skipped as if they hadn't been detected. */
+int sensors_discover_chip(sensors_chip_features *chip);
+
 int sensors_read_sysfs_bus(void);
 
-/* Read a value out of a sysfs attribute file */
-int sensors_read_sysfs_attr(const sensors_chip_name *name,
+/* Read a value out of a sysfs attribute file, or out of the value cache of
+   the chip if it was read recently enough */
+int sensors_read_sysfs_attr(const sensors_chip_features *chip,
+			    const sensors_subfeature *subfeature,
+			    double *value);
+
+/* Same as sensors_read_sysfs_attr(), for the integer the attribute file
+   holds, before scaling */
+int sensors_read_sysfs_attr_raw(const sensors_chip_features *chip,
+				const sensors_subfeature *subfeature,
+				long long *value);
+
+/* An attribute file read as part of a batch, see batch.h */
+struct sensors_sysfs_read {
+	int fd;
+	int *cached_fd;		/* cache slot of fd, NULL if it gets closed */
+	int len;		/* bytes read into buf, or -errno */
+	long long time_ns;	/* when submitted, for the value cache */
+	struct timespec start;	/* when submitted, for the statistics */
+	char buf[ATTR_MAX];
+};
+
+/* Get the attribute file of a subfeature ready to be read as part of a
+   batch. Returns 0 on success, 1 if the value was taken from the value
+   cache of the chip and stored in value instead, <0 on error. */
+int sensors_open_sysfs_read(const sensors_chip_features *chip,
+			    const sensors_subfeature *subfeature,
+			    struct sensors_sysfs_read *read, double *value);
+
+/* Parse the value of a batch read once it completed, and release its
+   file. Returns 0 on success, <0 on error. */
+int sensors_finish_sysfs_read(const sensors_chip_features *chip,
+			      const sensors_subfeature *subfeature,
+			      struct sensors_sysfs_read *read, double *value);
+
+/* Open a sysfs attribute file to be polled, and read its value. Returns
+   the file descriptor, or <0 on error. */
+int sensors_open_sysfs_poll(const sensors_chip_features *chip,
+			    const sensors_subfeature *subfeature,
+			    double *value);
+
+/* Read a value again from a file opened by sensors_open_sysfs_poll(),
+   which also acknowledges the notification */
+int sensors_read_sysfs_poll(const sensors_chip_features *chip, int fd,
 			    const sensors_subfeature *subfeature,
 			    double *value);
 
-/* Write a value to a sysfs attribute file */
-int sensors_write_sysfs_attr(const sensors_chip_name *name,
+/* Write a value to a sysfs attribute file. With only_changed set, the
+   current value is read first, and the write skipped if it matches. */
+int sensors_write_sysfs_attr(const sensors_chip_features *chip,
 			     const sensors_subfeature *subfeature,
-			     double value);
+			     double value, int only_changed);
+
+/* Allocate the arena of a chip, for fnum features, sfnum subfeatures and
+   names_size bytes of names, and point the chip tables into it. Returns
+   the space reserved for the names. */
+char *sensors_alloc_chip_arena(sensors_chip_features *chip, int fnum,
+			       int sfnum, size_t names_size);
+
+/* Initialize the lookup tables and file descriptor cache of a chip, once
+   its features and subfeatures are set */
+void sensors_init_chip_tables(sensors_chip_features *chip);
+
+/* Allocate the statistics of a chip if SENSORS_FLAG_STATS is set and
+   they aren't allocated yet */
+void sensors_init_chip_stats(sensors_chip_features *chip);
+
+/* Allocate the value cache of a chip, for a maxage statement of maxage
+   seconds, learning the refresh interval of the driver if learn is set.
+   Nothing is allocated if maxage is 0. */
+void sensors_init_value_cache(sensors_chip_features *chip, double maxage,
+			      int learn);
+
+/* Close the cached attribute file descriptors of a chip */
+void sensors_close_sysfs_attrs(sensors_chip_features *chip);
 
 #endif /* def LIB_SENSORS_SYSFS_H */
@@ -13,12 +13,28 @@ LIB_TEST_SCANNER_OBJS := \
 $(LIB_TEST_DIR)/test-scanner: $(LIB_TEST_SCANNER_OBJS)
 	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_SCANNER_OBJS) -Llib
 
+# The benchmark is linked with the library objects, as it points the
+# library at its synthetic sysfs tree through an internal variable
+LIB_TEST_BENCH_OBJS := \
+	$(LIB_TEST_DIR)/bench.ro \
+	$(LIB_TEST_DIR)/syscount.ro \
+	$(LIBSTOBJECTS)
+
+$(LIB_TEST_DIR)/bench: $(LIB_TEST_BENCH_OBJS)
+	$(CC) $(EXLDFLAGS) -o $@ $(LIB_TEST_BENCH_OBJS) -lm -lpthread -ldl
+
+# Options can be passed with BENCHFLAGS, such as BENCHFLAGS="-c 64 -f 16"
+bench: $(LIB_TEST_DIR)/bench
+	$(LIB_TEST_DIR)/bench $(BENCHFLAGS)
+
 all-lib-test: $(LIB_TEST_TARGETS)
 user :: all-lib-test
 
 $(LIB_TEST_DIR)/test-scanner.ro: $(LIB_DIR)/data.h $(LIB_DIR)/conf.h $(LIB_DIR)/conf-parse.h $(LIB_DIR)/scanner.h
+$(LIB_TEST_DIR)/bench.ro: $(LIB_DIR)/sensors.h $(LIB_DIR)/data.h $(LIB_DIR)/sysfs.h $(LIB_TEST_DIR)/syscount.h
+$(LIB_TEST_DIR)/syscount.ro: $(LIB_TEST_DIR)/syscount.h
 
 clean-lib-test:
 	$(RM) $(LIB_TEST_DIR)/*.rd $(LIB_TEST_DIR)/*.ro 
-	$(RM) $(LIB_TEST_TARGETS)
+	$(RM) $(LIB_TEST_TARGETS) $(LIB_TEST_DIR)/bench
 clean :: clean-lib-test
@@ -0,0 +1,424 @@
+/*
+    bench.c - Microbenchmarks of the libsensors hot paths
+    Copyright (C) 2026  lm-sensors contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * The benchmark generates a sysfs tree of virtual hwmon devices, with a
+ * number of temperature, voltage and fan channels each, and a configuration
+ * file with labels, compute and set statements for them, plus statements
+ * for many chips which aren't present. libsensors is pointed at the tree
+ * through sensors_sysfs_root, and the results are given in nanoseconds and
+ * in system calls (see syscount.c) per operation.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../sensors.h"
+#include "../data.h"
+#include "../sysfs.h"
+#include "syscount.h"
+
+static int chips = 16;		/* synthetic hwmon devices */
+static int channels = 8;	/* channels of each type per device */
+static int absent = 200;	/* chip statements for absent chips */
+static int iterations = 20000;	/* operations per read benchmark */
+static int inits = 20;		/* calls of sensors_init() */
+
+static char root[] = "/tmp/sensors-bench.XXXXXX";
+static char config[PATH_MAX];
+
+/* The subfeature numbers of the tempN_input and fanN_input subfeatures,
+   for every chip */
+static const sensors_chip_name **chip_names;
+static int *temp_nr, *fan_nr;
+
+struct bench {
+	struct timespec start;
+	unsigned long syscalls;
+};
+
+static void bench_start(struct bench *b)
+{
+	b->syscalls = bench_syscalls;
+	clock_gettime(CLOCK_MONOTONIC, &b->start);
+}
+
+static void bench_report(const struct bench *b, const char *name, long ops)
+{
+	struct timespec end;
+	double ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns = (end.tv_sec - b->start.tv_sec) * 1e9 +
+	     (end.tv_nsec - b->start.tv_nsec);
+	printf("%-34s %12.1f ns/op %10.2f syscalls/op\n", name, ns / ops,
+	       (double) (bench_syscalls - b->syscalls) / ops);
+}
+
+static void write_file(const char *path, const char *fmt, int value)
+{
+	FILE *f;
+
+	if (!(f = fopen(path, "w"))) {
+		perror(path);
+		exit(1);
+	}
+	fprintf(f, fmt, value);
+	fputc('\n', f);
+	fclose(f);
+}
+
+static void write_attr(const char *dir, const char *attr, int nr,
+		       const char *fmt, int value)
+{
+	char name[32], path[PATH_MAX];
+
+	snprintf(name, sizeof(name), attr, nr);
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	write_file(path, fmt, value);
+}
+
+static void make_tree(void)
+{
+	char dir[PATH_MAX];
+	int i, j;
+
+	if (!mkdtemp(root)) {
+		perror(root);
+		exit(1);
+	}
+	snprintf(dir, sizeof(dir), "%s/class", root);
+	mkdir(dir, 0755);
+	snprintf(dir, sizeof(dir), "%s/class/hwmon", root);
+	mkdir(dir, 0755);
+
+	for (i = 0; i < chips; i++) {
+		snprintf(dir, sizeof(dir), "%s/class/hwmon/hwmon%d", root, i);
+		if (mkdir(dir, 0755)) {
+			perror(dir);
+			exit(1);
+		}
+		/* Virtual devices of the same name would get the same chip
+		   name */
+		write_attr(dir, "name", i, "bench%d", i);
+		for (j = 1; j <= channels; j++) {
+			write_attr(dir, "temp%d_input", j, "%d", 40000 + j * 100);
+			write_attr(dir, "temp%d_max", j, "%d", 80000);
+			write_attr(dir, "temp%d_crit", j, "%d", 95000);
+			write_attr(dir, "temp%d_label", j, "Temp %d", j);
+			write_attr(dir, "in%d_input", j, "%d", 1200 + j);
+			write_attr(dir, "in%d_min", j, "%d", 1000);
+			write_attr(dir, "in%d_max", j, "%d", 1400);
+			write_attr(dir, "fan%d_input", j, "%d", 2000 + j);
+			write_attr(dir, "fan%d_min", j, "%d", 500);
+		}
+	}
+}
+
+static void remove_dir(const char *path)
+{
+	char entry[PATH_MAX];
+	struct dirent *ent;
+	DIR *dir;
+
+	if ((dir = opendir(path))) {
+		while ((ent = readdir(dir))) {
+			if (!strcmp(ent->d_name, ".") ||
+			    !strcmp(ent->d_name, ".."))
+				continue;
+			snprintf(entry, sizeof(entry), "%s/%s", path,
+				 ent->d_name);
+			if (unlink(entry))
+				remove_dir(entry);
+		}
+		closedir(dir);
+	}
+	rmdir(path);
+}
+
+/* The set statements write the values the attributes already hold, as
+   sensors -s would most of the time */
+static void make_config(void)
+{
+	FILE *f;
+	int i, j;
+
+	snprintf(config, sizeof(config), "%s/sensors.conf", root);
+	if (!(f = fopen(config, "w"))) {
+		perror(config);
+		exit(1);
+	}
+
+	fprintf(f, "chip");
+	for (i = 0; i < chips; i++)
+		fprintf(f, " \"bench%d-*\"", i);
+	fputc('\n', f);
+	for (j = 1; j <= channels; j++) {
+		fprintf(f, "    label in%d \"Voltage %d\"\n", j, j);
+		fprintf(f, "    compute in%d @*2, @/2\n", j);
+		fprintf(f, "    set in%d_min 2\n", j);
+		fprintf(f, "    label temp%d \"Sensor %d\"\n", j, j);
+		fprintf(f, "    compute temp%d @*1.5-10, (@+10)/1.5\n", j);
+		fprintf(f, "    set temp%d_max 110\n", j);
+	}
+
+	for (i = 0; i < absent; i++) {
+		fprintf(f, "\nchip \"absent%d-*\"\n", i);
+		for (j = 1; j <= channels; j++) {
+			fprintf(f, "    label temp%d \"Absent %d\"\n", j, j);
+			fprintf(f, "    compute temp%d @+%d, @-%d\n", j, i, i);
+			fprintf(f, "    ignore fan%d\n", j);
+		}
+	}
+	fclose(f);
+}
+
+static void init_sensors(void)
+{
+	FILE *f;
+
+	if (!(f = fopen(config, "r"))) {
+		perror(config);
+		exit(1);
+	}
+	if (sensors_init(f)) {
+		fprintf(stderr, "sensors_init() failed\n");
+		exit(1);
+	}
+	fclose(f);
+}
+
+static void find_subfeatures(void)
+{
+	const sensors_chip_name *name;
+	const sensors_feature *feature;
+	const sensors_subfeature *sub;
+	int nr = 0, i, f, n;
+
+	chip_names = malloc(chips * sizeof(*chip_names));
+	temp_nr = malloc(chips * channels * sizeof(int));
+	fan_nr = malloc(chips * channels * sizeof(int));
+	if (!chip_names || !temp_nr || !fan_nr) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < chips; i++) {
+		if (!(name = sensors_get_detected_chips(NULL, &nr))) {
+			fprintf(stderr, "Chip %d not detected\n", i);
+			exit(1);
+		}
+		chip_names[i] = name;
+		f = 0;
+		while ((feature = sensors_get_features(name, &f))) {
+			if (sscanf(feature->name, "temp%d", &n) == 1 &&
+			    (sub = sensors_get_subfeature(name, feature,
+					SENSORS_SUBFEATURE_TEMP_INPUT)))
+				temp_nr[i * channels + n - 1] = sub->number;
+			else if (sscanf(feature->name, "fan%d", &n) == 1 &&
+				 (sub = sensors_get_subfeature(name, feature,
+					SENSORS_SUBFEATURE_FAN_INPUT)))
+				fan_nr[i * channels + n - 1] = sub->number;
+		}
+	}
+}
+
+static void bench_init(void)
+{
+	struct bench b;
+	int i;
+
+	bench_start(&b);
+	for (i = 0; i < inits; i++) {
+		init_sensors();
+		sensors_cleanup();
+	}
+	bench_report(&b, "sensors_init+cleanup", inits);
+}
+
+static void bench_iterate(void)
+{
+	const sensors_chip_name *name;
+	const sensors_feature *feature;
+	const sensors_subfeature *sub;
+	struct bench b;
+	int i, nr, f, s;
+	long count = 0;
+
+	bench_start(&b);
+	for (i = 0; i < iterations / chips; i++) {
+		nr = 0;
+		while ((name = sensors_get_detected_chips(NULL, &nr))) {
+			f = 0;
+			while ((feature = sensors_get_features(name, &f))) {
+				s = 0;
+				while ((sub = sensors_get_all_subfeatures(name,
+							feature, &s)))
+					count += sub->number;
+			}
+		}
+	}
+	bench_report(&b, "iterate chip features", i * chips);
+	if (count < 0)
+		printf("%ld\n", count);
+}
+
+static void bench_labels(void)
+{
+	const sensors_feature *feature;
+	struct bench b;
+	long ops = 0;
+	int i, f;
+
+	bench_start(&b);
+	for (i = 0; ops < iterations; i = (i + 1) % chips) {
+		f = 0;
+		while ((feature = sensors_get_features(chip_names[i], &f))) {
+			free(sensors_get_label(chip_names[i], feature));
+			ops++;
+		}
+	}
+	bench_report(&b, "sensors_get_label", ops);
+}
+
+static void bench_values(const char *name, const int *subfeat_nr)
+{
+	struct bench b;
+	double value;
+	int i, n = chips * channels;
+
+	bench_start(&b);
+	for (i = 0; i < iterations; i++)
+		if (sensors_get_value(chip_names[i % n / channels],
+				      subfeat_nr[i % n], &value)) {
+			fprintf(stderr, "Reading failed\n");
+			exit(1);
+		}
+	bench_report(&b, name, iterations);
+}
+
+static void bench_raw_values(const char *name, const int *subfeat_nr)
+{
+	struct bench b;
+	long long value;
+	int i, scale, n = chips * channels;
+
+	bench_start(&b);
+	for (i = 0; i < iterations; i++)
+		if (sensors_get_value_raw(chip_names[i % n / channels],
+					  subfeat_nr[i % n], &value, &scale)) {
+			fprintf(stderr, "Reading failed\n");
+			exit(1);
+		}
+	bench_report(&b, name, iterations);
+}
+
+static void bench_sets(const char *name)
+{
+	struct bench b;
+	int i;
+
+	bench_start(&b);
+	for (i = 0; i < iterations / channels; i++)
+		if (sensors_do_chip_sets(chip_names[i % chips])) {
+			fprintf(stderr, "Setting failed\n");
+			exit(1);
+		}
+	bench_report(&b, name, i);
+}
+
+static void usage(void)
+{
+	printf("Usage: bench [-c CHIPS] [-f CHANNELS] [-a ABSENT] [-n OPS] "
+	       "[-i INITS]\n"
+	       "  -c  Number of synthetic chips (default 16)\n"
+	       "  -f  Channels of each type per chip (default 8)\n"
+	       "  -a  Chip statements for absent chips (default 200)\n"
+	       "  -n  Operations per benchmark (default 20000)\n"
+	       "  -i  Calls of sensors_init() (default 20)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "c:f:a:n:i:h")) != -1) {
+		switch (c) {
+		case 'c':
+			chips = atoi(optarg);
+			break;
+		case 'f':
+			channels = atoi(optarg);
+			break;
+		case 'a':
+			absent = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'i':
+			inits = atoi(optarg);
+			break;
+		default:
+			usage();
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (chips < 1 || channels < 1 || absent < 0 || iterations < chips ||
+	    inits < 1) {
+		usage();
+		return 1;
+	}
+
+	make_tree();
+	make_config();
+	sensors_sysfs_root = root;
+	printf("%d chips, %d channels of each type, %d absent chip "
+	       "statements\n", chips, channels, absent);
+
+	bench_init();
+
+	init_sensors();
+	find_subfeatures();
+	bench_iterate();
+	bench_labels();
+	bench_values("sensors_get_value", fan_nr);
+	bench_values("sensors_get_value compute", temp_nr);
+	bench_raw_values("sensors_get_value_raw", fan_nr);
+	bench_sets("sensors_do_chip_sets");
+
+	/* The same with the attribute files kept open */
+	sensors_set_flags(SENSORS_FLAG_CACHE_FD);
+	bench_values("sensors_get_value cached", fan_nr);
+	bench_values("sensors_get_value compute cached", temp_nr);
+	bench_raw_values("sensors_get_value_raw cached", fan_nr);
+	bench_sets("sensors_do_chip_sets cached");
+	sensors_cleanup();
+
+	remove_dir(root);
+	return 0;
+}
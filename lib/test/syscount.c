@@ -0,0 +1,144 @@
+/*
+    syscount.c - Count the system calls made through the C library
+    Copyright (C) 2026  lm-sensors contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * Each function below is defined with the name and the calling convention
+ * of the C library function, counts the call, and forwards it to the C
+ * library. The headers declaring them aren't included, as they would
+ * redirect some of the names with _FORTIFY_SOURCE or _FILE_OFFSET_BITS;
+ * the variants these produce are wrapped as well instead. Pointers to
+ * structures are passed as void pointers. Only the functions used by
+ * libsensors are counted, and readdir() counts as one system call although
+ * the C library reads several entries at once.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <dlfcn.h>
+#include "syscount.h"
+
+unsigned long bench_syscalls;
+
+static void *real(const char *name)
+{
+	return dlsym(RTLD_NEXT, name);
+}
+
+#define WRAP(ret, name, params, args)					\
+ret name params;							\
+ret name params								\
+{									\
+	static ret (*fn) params;					\
+									\
+	bench_syscalls++;						\
+	if (!fn)							\
+		fn = (ret (*) params) real(#name);			\
+	return fn args;							\
+}
+
+/* open() and friends only get a mode with O_CREAT or O_TMPFILE, which
+   libsensors doesn't use, so it is passed as is */
+#define WRAP_OPEN(name)							\
+int name(const char *path, int flags, ...);				\
+int name(const char *path, int flags, ...)				\
+{									\
+	static int (*fn)(const char *, int, ...);			\
+	va_list ap;							\
+	int mode;							\
+									\
+	bench_syscalls++;						\
+	if (!fn)							\
+		fn = (int (*)(const char *, int, ...)) real(#name);	\
+	va_start(ap, flags);						\
+	mode = va_arg(ap, int);						\
+	va_end(ap);							\
+	return fn(path, flags, mode);					\
+}
+
+#define WRAP_OPENAT(name)						\
+int name(int dir_fd, const char *path, int flags, ...);			\
+int name(int dir_fd, const char *path, int flags, ...)			\
+{									\
+	static int (*fn)(int, const char *, int, ...);			\
+	va_list ap;							\
+	int mode;							\
+									\
+	bench_syscalls++;						\
+	if (!fn)							\
+		fn = (int (*)(int, const char *, int, ...)) real(#name);\
+	va_start(ap, flags);						\
+	mode = va_arg(ap, int);						\
+	va_end(ap);							\
+	return fn(dir_fd, path, flags, mode);				\
+}
+
+WRAP_OPEN(open)
+WRAP_OPEN(open64)
+WRAP_OPENAT(openat)
+WRAP_OPENAT(openat64)
+WRAP(int, __open_2, (const char *path, int flags), (path, flags))
+WRAP(int, __open64_2, (const char *path, int flags), (path, flags))
+WRAP(int, __openat_2, (int dir_fd, const char *path, int flags),
+     (dir_fd, path, flags))
+WRAP(int, __openat64_2, (int dir_fd, const char *path, int flags),
+     (dir_fd, path, flags))
+WRAP(int, close, (int fd), (fd))
+
+WRAP(ssize_t, read, (int fd, void *buf, size_t len), (fd, buf, len))
+WRAP(ssize_t, __read_chk, (int fd, void *buf, size_t len, size_t size),
+     (fd, buf, len, size))
+WRAP(ssize_t, pread, (int fd, void *buf, size_t len, off_t off),
+     (fd, buf, len, off))
+WRAP(ssize_t, pread64, (int fd, void *buf, size_t len, off64_t off),
+     (fd, buf, len, off))
+WRAP(ssize_t, __pread_chk, (int fd, void *buf, size_t len, off_t off,
+			    size_t size), (fd, buf, len, off, size))
+WRAP(ssize_t, __pread64_chk, (int fd, void *buf, size_t len, off64_t off,
+			      size_t size), (fd, buf, len, off, size))
+WRAP(ssize_t, write, (int fd, const void *buf, size_t len), (fd, buf, len))
+WRAP(ssize_t, pwrite, (int fd, const void *buf, size_t len, off_t off),
+     (fd, buf, len, off))
+WRAP(ssize_t, pwrite64, (int fd, const void *buf, size_t len, off64_t off),
+     (fd, buf, len, off))
+
+WRAP(int, stat, (const char *path, void *st), (path, st))
+WRAP(int, stat64, (const char *path, void *st), (path, st))
+WRAP(int, fstat, (int fd, void *st), (fd, st))
+WRAP(int, fstat64, (int fd, void *st), (fd, st))
+WRAP(int, fstatat, (int dir_fd, const char *path, void *st, int flags),
+     (dir_fd, path, st, flags))
+WRAP(int, fstatat64, (int dir_fd, const char *path, void *st, int flags),
+     (dir_fd, path, st, flags))
+WRAP(int, statfs, (const char *path, void *st), (path, st))
+WRAP(int, statfs64, (const char *path, void *st), (path, st))
+WRAP(ssize_t, readlink, (const char *path, char *buf, size_t len),
+     (path, buf, len))
+WRAP(ssize_t, __readlink_chk, (const char *path, char *buf, size_t len,
+			       size_t size), (path, buf, len, size))
+
+WRAP(void *, fopen, (const char *path, const char *mode), (path, mode))
+WRAP(void *, fopen64, (const char *path, const char *mode), (path, mode))
+WRAP(int, fclose, (void *f), (f))
+WRAP(void *, opendir, (const char *path), (path))
+WRAP(void *, readdir, (void *dir), (dir))
+WRAP(void *, readdir64, (void *dir), (dir))
+WRAP(int, closedir, (void *dir), (dir))
@@ -0,0 +1,29 @@
+/*
+    syscount.h - Count the system calls made through the C library
+    Copyright (C) 2026  lm-sensors contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#ifndef LIB_TEST_SYSCOUNT_H
+#define LIB_TEST_SYSCOUNT_H
+
+/* Incremented by every call to one of the C library functions which wrap a
+   system call and are used by libsensors. The program linking syscount.o
+   overrides these functions, so this counts the calls libsensors makes,
+   not the ones the C library makes internally. */
+extern unsigned long bench_syscalls;
+
+#endif /* def LIB_TEST_SYSCOUNT_H */
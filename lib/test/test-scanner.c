@@ -78,6 +78,10 @@ int main(void)
 				printf("IGNORE\n");
 				break;
 	
+			case MAXAGE:
+				printf("MAXAGE\n");
+				break;
+	
 			case FLOAT:
 				printf("FLOAT: %f\n", sensors_yylval.value);
 				break;
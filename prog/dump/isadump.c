@@ -27,6 +27,8 @@
 	isadump 0x2e 0x2f 0x09		Super-I/O, logical device 9
 	isadump -f 0x5000		Flat address space dump like for Via 686a
 	isadump -f 0xecf0 0x10 1	PC87366, temperature channel 2
+	isadump -B 0x2e 0x2f 0-15	Super-I/O, logical devices 0 to 15,
+					binary dump
 */
 
 #include <sys/io.h>
@@ -45,15 +47,56 @@ static void help(void)
 {
 	fprintf(stderr,
 	        "Syntax for I2C-like access:\n"
-	        "  isadump [OPTIONS] [-k V1,V2...] ADDRREG DATAREG [BANK [BANKREG]]\n"
+	        "  isadump [OPTIONS] [-k V1,V2...] ADDRREG DATAREG [BANKS [BANKREG]]\n"
 	        "Syntax for flat address space:\n"
-	        "  isadump -f [OPTIONS] ADDRESS [RANGE [BANK [BANKREG]]]\n"
+	        "  isadump -f [OPTIONS] ADDRESS [RANGE [BANKS [BANKREG]]]\n"
 		"Options:\n"
 		"  -k	Super-I/O configuration access key\n"
 		"  -f	Enable flat address space mode\n"
 		"  -y	Assume affirmative answer to all questions\n"
 		"  -W	Read and display word (16-bit) values\n"
-		"  -L	Read and display long (32-bit) values\n");
+		"  -L	Read and display long (32-bit) values\n"
+		"  -r	Only dump the given registers (e.g. 0x20-0x2f,0x60)\n"
+		"  -B	Write the values in binary instead of a hex table\n"
+		"  -P	Access the registers through /dev/port\n"
+		"BANKS is a bank number or a list of them (e.g. 0-3,5)\n");
+}
+
+/*
+ * Parse a comma-separated list of numbers and ranges of numbers, such as
+ * "0-3,5", setting sel[i] for every number i listed, i being between 0
+ * and max-1.
+ * Returns the number of values listed, -1 on syntax error, -2 if a value
+ * is out of range.
+ */
+static int parse_list(const char *s, int max, unsigned char *sel)
+{
+	int first, last, count = 0;
+	char *end;
+
+	memset(sel, 0, max);
+	while (1) {
+		first = last = strtol(s, &end, 0);
+		if (end == s)
+			return -1;
+		if (*end == '-') {
+			s = end + 1;
+			last = strtol(s, &end, 0);
+			if (end == s)
+				return -1;
+		}
+		if (*end != ',' && *end != '\0')
+			return -1;
+		if (first < 0 || last >= max || first > last)
+			return -2;
+
+		for (; first <= last; first++, count++)
+			sel[first] = 1;
+
+		if (*end == '\0')
+			return count;
+		s = end + 1;
+	}
 }
 
 static int default_bankreg(int flat, int addrreg, int datareg)
@@ -76,31 +119,139 @@ static int set_bank(int flat, int addrreg, int datareg, int bank, int bankreg)
 	int oldbank;
 
 	if (flat) {
-		oldbank = inb(addrreg+bankreg);
-		outb(bank, addrreg+bankreg);
+		oldbank = inx(addrreg+bankreg, 1);
+		outx(bank, addrreg+bankreg, 1);
 	} else {
-		outb(bankreg, addrreg);
-		oldbank = inb(datareg);
-		outb(bank, datareg);
+		outx(bankreg, addrreg, 1);
+		oldbank = inx(datareg, 1);
+		outx(bank, datareg, 1);
 	}
 
 	return oldbank;
 }
 
+/*
+ * Read the selected registers of the current bank into values, indexed by
+ * register. Nothing is printed before all of them are read, so that the
+ * reads follow each other closely. Flat byte ranges are read in bursts,
+ * which take a single system call with /dev/port.
+ * Returns the number of registers of the chip, which can be lower than
+ * range.
+ */
+static int read_bank(int flat, int addrreg, int datareg, int range,
+		     int width, unsigned char *enter_key,
+		     const unsigned char *sel, unsigned long *values)
+{
+	unsigned char buf[256];
+	int i, j;
+
+	if (flat && width == 1) {
+		for (i = 0; i < range; i = j) {
+			for (j = i; j < range && sel[j] == sel[i]; j++)
+				;
+			if (!sel[i])
+				continue;
+			inb_range(addrreg + i, buf + i, j - i);
+			for (; i < j; i++)
+				values[i] = buf[i];
+		}
+		return range;
+	}
+
+	for (i = 0; i < range; i += 16) {
+		/* It was noticed that Winbond Super-I/O chips
+		   would leave the configuration mode after
+		   an arbitrary number of register reads,
+		   causing any subsequent read attempt to
+		   silently fail. Repeating the key every 16 reads
+		   prevents that. */
+		if (enter_key[0])
+			superio_write_key(addrreg, enter_key);
+
+		for (j = 0; j < 16; j += width) {
+			if (!sel[i+j])
+				continue;
+			if (flat) {
+				values[i+j] = inx(addrreg + i + j, width);
+			} else {	
+				outx(i+j, addrreg, 1);
+				if (i+j == 0 && inx(addrreg, 1) == 0x80) {
+					/* Bit 7 appears to be a busy flag */
+					range = 128;
+				}
+				values[i+j] = inx(datareg, width);
+			}
+		}
+	}
+
+	return range;
+}
+
+/* Print the selected registers as a table, XX standing for the others */
+static void print_bank(int flat, int addrreg, int range, int width,
+		       const unsigned char *sel, const unsigned long *values)
+{
+	int i, j;
+
+	/* print column headers */
+	printf("%*s", flat ? 5 : 3, "");
+	for (j = 0; j < 16; j += width)
+		printf(" %*x", width * 2, j);
+	printf("\n");
+
+	for (i = 0; i < range; i += 16) {
+		/* Skip the rows without any selected register */
+		for (j = 0; j < 16 && !sel[i+j]; j += width)
+			;
+		if (j == 16)
+			continue;
+
+		if (flat)
+			printf("%04x: ", addrreg + i);
+		else
+			printf("%02x: ", i);
+
+		for (j = 0; j < 16; j += width) {
+			if (sel[i+j])
+				printf("%0*lx ", width * 2, values[i+j]);
+			else
+				printf("%.*s ", width * 2, "XXXXXXXX");
+		}
+		printf("\n");
+	}
+}
+
+/* Write the selected registers in order, each as width bytes, least
+   significant first */
+static void write_bank(int range, int width, const unsigned char *sel,
+		       const unsigned long *values)
+{
+	int i, k;
+
+	for (i = 0; i < range; i += width) {
+		if (!sel[i])
+			continue;
+		for (k = 0; k < width; k++)
+			putchar((values[i] >> (8 * k)) & 0xff);
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	int addrreg;        /* address in flat mode */
 	int datareg = 0;    /* unused in flat mode */
 	int range = 256;    /* can be changed only in flat mode */
-	int bank = -1;      /* -1 means no bank operation */
+	int banks = 0;      /* number of banks, 0 means no bank operation */
 	int bankreg;
-	int oldbank = 0;
-	int i, j;
-	unsigned long res;
+	int oldbank = -1;
+	int first, last;
+	int i, res, dumped = 0;
 	int flags = 0;
-	int flat = 0, yes = 0, width = 1;
-	char *end;
+	int flat = 0, yes = 0, width = 1, binary = 0, use_port = 0;
+	char *end, *regs = NULL;
 	unsigned char enter_key[SUPERIO_MAX_KEY+1];
+	unsigned char bank_sel[32], reg_sel[256];
+	unsigned long values[256];
 
 	enter_key[0] = 0;
 
@@ -120,6 +271,17 @@ int main(int argc, char *argv[])
 			break;
 		case 'W': width = 2; break;
 		case 'L': width = 4; break;
+		case 'r':
+			if (2+flags >= argc) {
+				fprintf(stderr, "Missing register list\n");
+				help();
+				exit(1);
+			}
+			regs = argv[2+flags];
+			flags++;
+			break;
+		case 'B': binary = 1; break;
+		case 'P': use_port = 1; break;
 		default:
 			fprintf(stderr, "Warning: Unsupported flag "
 				"\"-%c\"!\n", argv[1+flags][1]);
@@ -135,6 +297,12 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	/* /dev/port can only do byte accesses */
+	if (use_port && width != 1) {
+		fprintf(stderr, "Error: Cannot use -W or -L with -P\n");
+		exit(1);
+	}
+
 	/* verify that the argument count is correct */
 	if ((!flat && argc < 1+flags+2)
 	 || (flat && argc < 1+flags+1)) {
@@ -187,13 +355,13 @@ int main(int argc, char *argv[])
 	bankreg = default_bankreg(flat, addrreg, datareg);
 
 	if (1+flags+2 < argc) {
-		bank = strtol(argv[1+flags+2], &end, 0);
-		if (*end) {
+		banks = parse_list(argv[1+flags+2], 32, bank_sel);
+		if (banks == -1) {
 			fprintf(stderr, "Error: Invalid bank number!\n");
 			help();
 			exit(1);
 		}
-		if ((bank < 0) || (bank > 31)) {
+		if (banks < 0) {
 			fprintf(stderr, "Error: bank out of range (0-31)!\n");
 			help();
 			exit(1);
@@ -216,6 +384,16 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (!regs) {
+		memset(reg_sel, 1, range);
+	} else if (parse_list(regs, range, reg_sel) < 0) {
+		fprintf(stderr, "Error: Invalid register list!\n"
+		        "Hint: Registers must be between 0x00 and 0x%02x.\n",
+		        range-1);
+		help();
+		exit(1);
+	}
+
 	if (geteuid()) {
 		fprintf(stderr, "Error: Can only be run as root (or make it "
 		        "suid root)\n");
@@ -233,9 +411,10 @@ int main(int argc, char *argv[])
 			fprintf(stderr, "I will probe address register 0x%x "
 			        "and data register 0x%x.\n", addrreg, datareg);
 
-		if (bank>=0) 	
-			fprintf(stderr, "Probing bank %d using bank register "
-			        "0x%02x.\n", bank, bankreg);
+		if (banks)
+			fprintf(stderr, "Probing bank%s %s using bank "
+			        "register 0x%02x.\n", banks > 1 ? "s" : "",
+			        argv[1+flags+2], bankreg);
 
 		fprintf(stderr, "Continue? [Y/n] ");
 		fflush(stderr);
@@ -245,74 +424,79 @@ int main(int argc, char *argv[])
 		}
 	}
 
-#ifndef __powerpc__
-	if ((datareg < 0x400) && (addrreg < 0x400) && !flat) {
-		if (ioperm(datareg, 1, 1)) {
-			fprintf(stderr, "Error: Could not ioperm() data "
-			        "register!\n");
-			exit(1);
-		}
-		if (ioperm(addrreg, 1, 1)) {
-			fprintf(stderr, "Error: Could not ioperm() address "
-			        "register!\n");
+	if (use_port) {
+		if (io_use_port_file()) {
+			perror("/dev/port");
 			exit(1);
 		}
 	} else {
-		if (iopl(3)) {
-			fprintf(stderr, "Error: Could not do iopl(3)!\n");
-			exit(1);
+#ifndef __powerpc__
+		/* Request access to all the ports at once */
+		if (flat) {
+			first = addrreg;
+			last = addrreg + range - 1;
+			/* The bank register can be past the range dumped */
+			if (banks && addrreg + bankreg > last)
+				last = addrreg + bankreg;
+		} else {
+			first = addrreg < datareg ? addrreg : datareg;
+			last = (addrreg > datareg ? addrreg : datareg)
+			     + width - 1;
+		}
+		if (last < 0x400) {
+			if (ioperm(first, last - first + 1, 1)) {
+				fprintf(stderr, "Error: Could not ioperm() "
+				        "ports 0x%x-0x%x!\n", first, last);
+				exit(1);
+			}
+		} else {
+			if (iopl(3)) {
+				fprintf(stderr, "Error: Could not do "
+				        "iopl(3)!\n");
+				exit(1);
+			}
 		}
-	}
 #endif
+	}
 
-	/* Enter Super-I/O configuration mode */
-	if (enter_key[0])
-		superio_write_key(addrreg, enter_key);
-
-	if (bank >= 0)
-		oldbank = set_bank(flat, addrreg, datareg, bank, bankreg);
-
-	/* print column headers */
-	printf("%*s", flat ? 5 : 3, "");
-	for (j = 0; j < 16; j += width)
-		printf(" %*x", width * 2, j);
-	printf("\n");
-
-	for (i = 0; i < range; i += 16) {
-		if (flat)
-			printf("%04x: ", addrreg + i);
-		else
-			printf("%02x: ", i);
+	/* Each selected bank in turn, or the current one */
+	for (i = 0; i < 32; i++) {
+		if (banks && !bank_sel[i])
+			continue;
 
-		/* It was noticed that Winbond Super-I/O chips
-		   would leave the configuration mode after
-		   an arbitrary number of register reads,
-		   causing any subsequent read attempt to
-		   silently fail. Repeating the key every 16 reads
-		   prevents that. */
+		/* Enter Super-I/O configuration mode */
 		if (enter_key[0])
 			superio_write_key(addrreg, enter_key);
 
-		for (j = 0; j < 16; j += width) {
-			fflush(stdout);
-			if (flat) {
-				res = inx(addrreg + i + j, width);
-			} else {	
-				outb(i+j, addrreg);
-				if (i+j == 0 && inb(addrreg) == 0x80) {
-					/* Bit 7 appears to be a busy flag */
-					range = 128;
-				}
-				res = inx(datareg, width);
-			}
-			printf("%0*lx ", width * 2, res);
+		if (banks) {
+			res = set_bank(flat, addrreg, datareg, i, bankreg);
+			if (oldbank < 0)
+				oldbank = res;
 		}
-		printf("\n");
+
+		res = read_bank(flat, addrreg, datareg, range, width,
+				enter_key, reg_sel, values);
+
+		if (binary) {
+			write_bank(res, width, reg_sel, values);
+		} else {
+			/* Tables separated by an empty line */
+			if (banks > 1)
+				printf("%sbank %d:\n",
+				       dumped++ ? "\n" : "", i);
+			print_bank(flat, addrreg, res, width, reg_sel, values);
+		}
+
+		if (!banks)
+			break;
 	}
 
 	/* Restore the original bank value */
-	if (bank >= 0)
+	if (banks) {
+		if (enter_key[0])
+			superio_write_key(addrreg, enter_key);
 		set_bank(flat, addrreg, datareg, oldbank, bankreg);
+	}
 
 	/* Exit Super-I/O configuration mode */
 	if (enter_key[0])
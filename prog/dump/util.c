@@ -10,8 +10,14 @@
 
 #include <sys/io.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "util.h"
 
+/* File descriptor of /dev/port if used instead of direct I/O, else -1 */
+static int port_fd = -1;
+
 /* Return 1 if we should continue, 0 if we should abort */
 int user_ack(int def)
 {
@@ -47,9 +53,27 @@ int user_ack(int def)
 	return ret;
 }
 
+/* Do all I/O through /dev/port from now on, which doesn't need ioperm()
+   or iopl(). Only byte accesses are possible, as reading or writing
+   several bytes accesses consecutive ports. Returns 0 on success, -1 if
+   /dev/port couldn't be opened. */
+int io_use_port_file(void)
+{
+	port_fd = open("/dev/port", O_RDWR | O_CLOEXEC);
+	return port_fd < 0 ? -1 : 0;
+}
+
 /* I/O read of specified size */
 unsigned long inx(int addr, int width)
 {
+	unsigned char value;
+
+	if (port_fd >= 0) {
+		if (pread(port_fd, &value, 1, addr) != 1)
+			return 0xff;	/* What a missing device returns */
+		return value;
+	}
+
 	switch (width) {
 	case 2:
 		return inw(addr);
@@ -65,6 +89,14 @@ unsigned long inx(int addr, int width)
 /* I/O write of specified size */
 void outx(unsigned long value, int addr, int width)
 {
+	unsigned char byte = value;
+
+	if (port_fd >= 0) {
+		if (pwrite(port_fd, &byte, 1, addr) != 1)
+			perror("/dev/port");
+		return;
+	}
+
 	switch (width) {
 	case 2:
 		outw(value, addr);
@@ -76,3 +108,21 @@ void outx(unsigned long value, int addr, int width)
 		outb(value, addr);
 	}
 }
+
+/* Byte reads of len consecutive ports, in a single system call with
+   /dev/port */
+void inb_range(int addr, unsigned char *buf, int len)
+{
+	int i;
+
+	if (port_fd >= 0) {
+		if (pread(port_fd, buf, len, addr) != len) {
+			perror("/dev/port");
+			memset(buf, 0xff, len);
+		}
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+		buf[i] = inb(addr + i);
+}
@@ -12,7 +12,9 @@
 #define _UTIL_H
 
 extern int user_ack(int def);
+extern int io_use_port_file(void);
 extern unsigned long inx(int addr, int width);
 extern void outx(unsigned long value, int addr, int width);
+extern void inb_range(int addr, unsigned char *buf, int len);
 
 #endif /* _UTIL_H */
@@ -20,11 +20,20 @@ MODULE_DIR := prog/pwm
 PROGPWMDIR := $(MODULE_DIR)
 
 PROGPWMMAN8DIR := $(MANDIR)/man8
-PROGPWMMAN8FILES := $(MODULE_DIR)/fancontrol.8 $(MODULE_DIR)/pwmconfig.8
+PROGPWMMAN8FILES := $(MODULE_DIR)/fancontrol.8 $(MODULE_DIR)/fancontrold.8 \
+                    $(MODULE_DIR)/pwmconfig.8
 
 PROGPWMTARGETS := $(MODULE_DIR)/fancontrol \
                   $(MODULE_DIR)/pwmconfig
 
+# fancontrold is the only one which needs to be built
+PROGPWMCTARGETS := $(MODULE_DIR)/fancontrold
+PROGPWMSOURCES := $(MODULE_DIR)/fancontrold.c
+
+# Include all dependency files. We use '.rd' to indicate this will create
+# executables.
+INCLUDEFILES += $(PROGPWMSOURCES:.c=.rd)
+
 # The vt1211_pwm script is not installed by default, pass VT1211_PWM=1
 # to get it 
 ifeq ($(VT1211_PWM),1)
@@ -32,9 +41,17 @@ PROGPWMMAN8FILES += $(MODULE_DIR)/vt1211_pwm.8
 PROGPWMTARGETS += $(MODULE_DIR)/vt1211_pwm
 endif
 
+PROGPWMTARGETS += $(PROGPWMCTARGETS)
+
 REMOVEPWMBIN := $(patsubst $(MODULE_DIR)/%,$(DESTDIR)$(SBINDIR)/%,$(PROGPWMTARGETS))
 REMOVEPWMMAN := $(patsubst $(MODULE_DIR)/%,$(DESTDIR)$(PROGPWMMAN8DIR)/%,$(PROGPWMMAN8FILES))
 
+$(PROGPWMCTARGETS): $(PROGPWMSOURCES:.c=.ro) lib/$(LIBSHBASENAME)
+	$(CC) $(EXLDFLAGS) -o $@ $(PROGPWMSOURCES:.c=.ro) -Llib -lsensors
+
+all-prog-pwm: $(PROGPWMCTARGETS)
+user :: all-prog-pwm
+
 install-prog-pwm: $(PROGPWMTARGETS)
 	$(MKDIR) $(DESTDIR)$(SBINDIR) $(DESTDIR)$(PROGPWMMAN8DIR)
 	$(INSTALL) -m 755 $(PROGPWMTARGETS) $(DESTDIR)$(SBINDIR)
@@ -45,3 +62,8 @@ user_install :: install-prog-pwm
 user_uninstall::
 	$(RM) $(REMOVEPWMBIN)
 	$(RM) $(REMOVEPWMMAN)
+
+clean-prog-pwm:
+	$(RM) $(PROGPWMDIR)/*.rd $(PROGPWMDIR)/*.ro
+	$(RM) $(PROGPWMCTARGETS)
+clean :: clean-prog-pwm
@@ -0,0 +1,1061 @@
+/*
+    fancontrold.c - Temperature dependent fan speed control
+    Copyright (C) 2026  lm-sensors contributors
+
+    Based on the fancontrol script:
+    Copyright 2003 Marius Reiner <marius.reiner@hdev.de>
+    Copyright (C) 2007-2014 Jean Delvare <jdelvare@suse.de>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * This reads the same configuration file as fancontrol, and follows the
+ * same algorithm, without running a single process per read or write:
+ * the temperatures and fan speeds are read through libsensors, which keeps
+ * their attribute files open, the pwm outputs are kept open as well, and
+ * a pwm output is only written when its value changes.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include "lib/sensors.h"
+#include "lib/error.h"
+#include "version.h"
+
+#define DEFAULT_CONFIG	ETCDIR "/fancontrol"
+#define PIDFILE		"/var/run/fancontrol.pid"
+#define MAX		255
+#define START_TIME	1000	/* ms at MINSTART to start a stopped fan */
+
+struct input {
+	char *path;
+	const sensors_chip_name *chip;
+	int nr;
+};
+
+struct channel {
+	char *pwm;		/* path of the pwm output */
+	struct input temp;
+	struct input *fans;
+	int fan_count;
+
+	double min_temp, max_temp, hyst, kp, ki;
+	int min_start, min_stop, min_pwm, max_pwm;
+
+	int fd;			/* of the pwm output */
+	int saved;		/* whether the original state was saved */
+	int orig_enable, orig_pwm;
+
+	int have_ref;
+	double ref_temp;	/* temperature the output is computed from */
+	double integral;	/* state of the PI smoothing */
+	long long start_until;	/* ms, while starting a stopped fan */
+};
+
+static double interval;
+static struct channel *channels;
+static int channel_count;
+static int pidfile_created;
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = calloc(1, size);
+
+	if (!p) {
+		fprintf(stderr, "Error: Out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+static char *xstrdup(const char *s)
+{
+	return strcpy(xmalloc(strlen(s) + 1), s);
+}
+
+/*
+ * Configuration
+ */
+
+struct setting {
+	const char *name;
+	char *value;		/* NULL if not set */
+};
+
+enum { S_INTERVAL, S_DEVPATH, S_DEVNAME, S_FCTEMPS, S_MINTEMP, S_MAXTEMP,
+       S_MINSTART, S_MINSTOP, S_FCFANS, S_MINPWM, S_MAXPWM, S_HYSTERESIS,
+       S_KP, S_KI, S_MAX };
+
+static struct setting settings[S_MAX] = {
+	{ "INTERVAL", NULL }, { "DEVPATH", NULL }, { "DEVNAME", NULL },
+	{ "FCTEMPS", NULL }, { "MINTEMP", NULL }, { "MAXTEMP", NULL },
+	{ "MINSTART", NULL }, { "MINSTOP", NULL }, { "FCFANS", NULL },
+	{ "MINPWM", NULL }, { "MAXPWM", NULL }, { "HYSTERESIS", NULL },
+	{ "KP", NULL }, { "KI", NULL },
+};
+
+static void read_config(const char *path)
+{
+	char line[4096], *p;
+	size_t len;
+	FILE *f;
+	int i;
+
+	printf("Loading configuration from %s ...\n", path);
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Error: Can't read configuration file\n");
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		for (i = 0; i < S_MAX; i++) {
+			len = strlen(settings[i].name);
+			if (strncmp(line, settings[i].name, len) ||
+			    line[len] != '=')
+				continue;
+			p = line + len + 1;
+			while (*p == ' ')
+				p++;
+			/* The last occurrence wins */
+			free(settings[i].value);
+			settings[i].value = xstrdup(p);
+		}
+	}
+	fclose(f);
+}
+
+/* The value of a per pwm output setting, NULL if not set */
+static const char *pwm_value(int setting, const char *pwm, char *buf,
+			     size_t size)
+{
+	const char *p, *end;
+	size_t len = strlen(pwm);
+
+	if (!settings[setting].value)
+		return NULL;
+
+	for (p = settings[setting].value; *p; p = end) {
+		p += strspn(p, " \t");
+		end = p + strcspn(p, " \t");
+		if ((size_t)(end - p) > len && !strncmp(p, pwm, len) &&
+		    p[len] == '=' && (size_t)(end - p - len) <= size) {
+			memcpy(buf, p + len + 1, end - p - len - 1);
+			buf[end - p - len - 1] = '\0';
+			return buf;
+		}
+	}
+	return NULL;
+}
+
+static void config_error(const char *pwm, const char *msg)
+{
+	if (pwm)
+		fprintf(stderr, "Error in configuration file (%s):\n", pwm);
+	else
+		fprintf(stderr, "Error in configuration file:\n");
+	fprintf(stderr, "%s\n", msg);
+	exit(1);
+}
+
+static double pwm_double(int setting, const char *pwm, int mandatory,
+			 double def)
+{
+	char buf[64], msg[128], *end;
+	const char *s;
+	double value;
+
+	s = pwm_value(setting, pwm, buf, sizeof(buf));
+	if (!s) {
+		if (mandatory) {
+			snprintf(msg, sizeof(msg), "%s is missing",
+				 settings[setting].name);
+			config_error(pwm, msg);
+		}
+		return def;
+	}
+
+	value = strtod(s, &end);
+	if (end == s || *end) {
+		snprintf(msg, sizeof(msg), "%s value is not a number",
+			 settings[setting].name);
+		config_error(pwm, msg);
+	}
+	return value;
+}
+
+static int pwm_int(int setting, const char *pwm, int mandatory, int def)
+{
+	char buf[64], msg[128], *end;
+	const char *s;
+	long value;
+
+	s = pwm_value(setting, pwm, buf, sizeof(buf));
+	if (!s) {
+		if (mandatory) {
+			snprintf(msg, sizeof(msg), "%s is missing",
+				 settings[setting].name);
+			config_error(pwm, msg);
+		}
+		return def;
+	}
+
+	value = strtol(s, &end, 10);
+	if (end == s || *end || value < INT_MIN || value > INT_MAX) {
+		snprintf(msg, sizeof(msg), "%s value is not an integer",
+			 settings[setting].name);
+		config_error(pwm, msg);
+	}
+	return value;
+}
+
+static void load_channel(struct channel *ch, const char *pwm,
+			 const char *temp)
+{
+	char buf[4096], *p, *next;
+
+	ch->pwm = xstrdup(pwm);
+	ch->temp.path = xstrdup(temp);
+	ch->fd = -1;
+
+	/* A given pwm output can control several fans */
+	if (pwm_value(S_FCFANS, pwm, buf, sizeof(buf))) {
+		for (p = buf; p; p = next) {
+			next = strchr(p, '+');
+			if (next)
+				*next++ = '\0';
+			if (!*p)
+				continue;
+			ch->fans = realloc(ch->fans, (ch->fan_count + 1) *
+					   sizeof(struct input));
+			if (!ch->fans) {
+				fprintf(stderr, "Error: Out of memory\n");
+				exit(1);
+			}
+			memset(&ch->fans[ch->fan_count], 0,
+			       sizeof(struct input));
+			ch->fans[ch->fan_count++].path = xstrdup(p);
+		}
+	}
+
+	ch->min_temp = pwm_double(S_MINTEMP, pwm, 1, 0);
+	ch->max_temp = pwm_double(S_MAXTEMP, pwm, 1, 0);
+	ch->min_start = pwm_int(S_MINSTART, pwm, 1, 0);
+	ch->min_stop = pwm_int(S_MINSTOP, pwm, 1, 0);
+	ch->min_pwm = pwm_int(S_MINPWM, pwm, 0, 0);
+	ch->max_pwm = pwm_int(S_MAXPWM, pwm, 0, MAX);
+	ch->hyst = pwm_double(S_HYSTERESIS, pwm, 0, 0);
+	ch->kp = pwm_double(S_KP, pwm, 0, 0);
+	ch->ki = pwm_double(S_KI, pwm, 0, 0);
+
+	/* verify the validity of the settings */
+	if (ch->min_temp >= ch->max_temp)
+		config_error(pwm, "MINTEMP must be less than MAXTEMP");
+	if (ch->max_pwm > MAX)
+		config_error(pwm, "MAXPWM must be at most 255");
+	if (ch->min_stop >= ch->max_pwm)
+		config_error(pwm, "MINSTOP must be less than MAXPWM");
+	if (ch->min_stop < ch->min_pwm)
+		config_error(pwm, "MINSTOP must be greater than or equal to "
+			     "MINPWM");
+	if (ch->min_pwm < 0)
+		config_error(pwm, "MINPWM must be at least 0");
+	if (ch->hyst < 0)
+		config_error(pwm, "HYSTERESIS must be at least 0");
+	if (ch->kp < 0 || ch->kp > 1)
+		config_error(pwm, "KP must be between 0 and 1");
+	if (ch->ki < 0 || ch->ki * interval > 1)
+		config_error(pwm, "KI must be between 0 and 1/INTERVAL");
+	if (ch->kp && !ch->ki)
+		config_error(pwm, "KP requires KI");
+}
+
+static void load_config(const char *path)
+{
+	char *p, *end, *eq;
+	int i;
+
+	read_config(path);
+
+	/* Check whether all mandatory settings are set */
+	if (!settings[S_INTERVAL].value || !settings[S_FCTEMPS].value ||
+	    !settings[S_MINTEMP].value || !settings[S_MAXTEMP].value ||
+	    !settings[S_MINSTART].value || !settings[S_MINSTOP].value) {
+		fprintf(stderr, "Some mandatory settings missing, please "
+			"check your config file!\n");
+		exit(1);
+	}
+	interval = strtod(settings[S_INTERVAL].value, &end);
+	if (end == settings[S_INTERVAL].value || *end || !(interval > 0) ||
+	    interval > 86400)
+		config_error(NULL, "INTERVAL must be a positive number of "
+			     "seconds");
+
+	printf("\nCommon settings:\n");
+	printf("  INTERVAL=%s\n", settings[S_INTERVAL].value);
+
+	for (p = settings[S_FCTEMPS].value; *p; p = end) {
+		p += strspn(p, " \t");
+		if (!*p)
+			break;
+		end = p + strcspn(p, " \t");
+		if (*end)
+			*end++ = '\0';
+		eq = strchr(p, '=');
+		if (!eq || eq == p || !eq[1])
+			config_error(NULL, "FCTEMPS value is improperly "
+				     "formatted");
+		*eq = '\0';
+
+		channels = realloc(channels, (channel_count + 1) *
+				   sizeof(struct channel));
+		if (!channels) {
+			fprintf(stderr, "Error: Out of memory\n");
+			exit(1);
+		}
+		memset(&channels[channel_count], 0, sizeof(struct channel));
+		load_channel(&channels[channel_count], p, eq + 1);
+		channel_count++;
+	}
+	if (!channel_count)
+		config_error(NULL, "FCTEMPS is empty");
+
+	for (i = 0; i < channel_count; i++) {
+		struct channel *ch = &channels[i];
+		int j;
+
+		printf("\nSettings for %s:\n", ch->pwm);
+		printf("  Depends on %s\n", ch->temp.path);
+		printf("  Controls ");
+		for (j = 0; j < ch->fan_count; j++)
+			printf("%s%s", j ? "+" : "", ch->fans[j].path);
+		printf("\n");
+		printf("  MINTEMP=%g\n", ch->min_temp);
+		printf("  MAXTEMP=%g\n", ch->max_temp);
+		printf("  MINSTART=%d\n", ch->min_start);
+		printf("  MINSTOP=%d\n", ch->min_stop);
+		printf("  MINPWM=%d\n", ch->min_pwm);
+		printf("  MAXPWM=%d\n", ch->max_pwm);
+		if (ch->hyst)
+			printf("  HYSTERESIS=%g\n", ch->hyst);
+		if (ch->ki)
+			printf("  KP=%g\n  KI=%g\n", ch->kp, ch->ki);
+	}
+	printf("\n");
+}
+
+/*
+ * Device checks, same as fancontrol
+ */
+
+/* The first line of a file, with whitespace and '=' replaced by '_' */
+static int read_name(const char *path, char *buf, size_t size)
+{
+	FILE *f;
+	char *p;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (!fgets(buf, size, f)) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+	for (p = buf; *p; p++)
+		if (*p == ' ' || *p == '\t' || *p == '=')
+			*p = '_';
+	return 0;
+}
+
+static void device_path(const char *device, char *buf, size_t size)
+{
+	char link[PATH_MAX], path[PATH_MAX];
+	struct stat st;
+
+	buf[0] = '\0';
+	snprintf(link, sizeof(link), "%s/device", device);
+	if (lstat(link, &st) || !S_ISLNK(st.st_mode) || !realpath(link, path))
+		return;
+	snprintf(buf, size, "%s", strncmp(path, "/sys/", 5) ? path : path + 5);
+}
+
+static void device_name(const char *device, char *buf, size_t size)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/name", device);
+	if (!read_name(path, buf, size))
+		return;
+	snprintf(path, sizeof(path), "%s/device/name", device);
+	if (!read_name(path, buf, size))
+		return;
+	buf[0] = '\0';
+}
+
+/* Call fn for each device=value entry of a setting */
+static int for_each_device(int setting,
+			   int (*fn)(const char *device, const char *value))
+{
+	char entry[PATH_MAX], *eq;
+	const char *p, *end;
+	int ret = 0;
+
+	if (!settings[setting].value)
+		return 0;
+
+	for (p = settings[setting].value; *p; p = end) {
+		p += strspn(p, " \t");
+		if (!*p)
+			break;
+		end = p + strcspn(p, " \t");
+		snprintf(entry, sizeof(entry), "%.*s", (int)(end - p), p);
+		eq = strrchr(entry, '=');
+		if (!eq)
+			continue;
+		*eq = '\0';
+		ret |= fn(entry, eq + 1);
+	}
+	return ret;
+}
+
+static int check_device_path(const char *device, const char *path)
+{
+	char buf[PATH_MAX];
+
+	device_path(device, buf, sizeof(buf));
+	if (strcmp(buf, path)) {
+		fprintf(stderr, "Device path of %s has changed\n", device);
+		return 1;
+	}
+	return 0;
+}
+
+static int check_device_name(const char *device, const char *name)
+{
+	char buf[256];
+
+	device_name(device, buf, sizeof(buf));
+	if (strcmp(buf, name)) {
+		fprintf(stderr, "Device name of %s has changed\n", device);
+		return 1;
+	}
+	return 0;
+}
+
+/* Replace device/device with device in a path */
+static void fixup_path(char **path, const char *device)
+{
+	char old[PATH_MAX], *p, *fixed;
+	size_t len;
+
+	len = snprintf(old, sizeof(old), "%s/device", device);
+	p = strstr(*path, old);
+	if (!p)
+		return;
+
+	fixed = xmalloc(strlen(*path) + 1);
+	memcpy(fixed, *path, p - *path + strlen(device));
+	strcpy(fixed + (p - *path) + strlen(device), p + len);
+	printf("Adjusing %s -> %s\n", *path, fixed);
+	free(*path);
+	*path = fixed;
+}
+
+/* Some drivers moved their attributes from hard device to class device */
+static int fixup_device_files(const char *device, const char *value)
+{
+	char path[PATH_MAX];
+	int i, j;
+
+	(void) value;
+	snprintf(path, sizeof(path), "%s/name", device);
+	if (access(path, F_OK))
+		return 0;
+
+	for (i = 0; i < channel_count; i++) {
+		fixup_path(&channels[i].pwm, device);
+		fixup_path(&channels[i].temp.path, device);
+		for (j = 0; j < channels[i].fan_count; j++)
+			fixup_path(&channels[i].fans[j].path, device);
+	}
+	return 0;
+}
+
+/* Find the chip and subfeature of a sysfs attribute file */
+static int lookup_input(struct input *in)
+{
+	char path[PATH_MAX], chip_path[PATH_MAX], *base;
+	const sensors_chip_name *chip;
+	const sensors_feature *feature;
+	const sensors_subfeature *sub;
+	int nr = 0, a, b;
+
+	if (!realpath(in->path, path))
+		return -1;
+	base = strrchr(path, '/');
+	*base++ = '\0';
+
+	while ((chip = sensors_get_detected_chips(NULL, &nr))) {
+		if (!realpath(chip->path, chip_path) || strcmp(chip_path, path))
+			continue;
+		a = 0;
+		while ((feature = sensors_get_features(chip, &a))) {
+			b = 0;
+			while ((sub = sensors_get_all_subfeatures(chip, feature,
+								  &b))) {
+				if (strcmp(sub->name, base))
+					continue;
+				in->chip = chip;
+				in->nr = sub->number;
+				return 0;
+			}
+		}
+	}
+	return -1;
+}
+
+/* Check that all referenced sysfs files exist */
+static int check_files(void)
+{
+	int i, j, outdated = 0;
+
+	for (i = 0; i < channel_count; i++) {
+		struct channel *ch = &channels[i];
+
+		if (access(ch->pwm, W_OK)) {
+			fprintf(stderr, "Error: file %s doesn't exist\n",
+				ch->pwm);
+			outdated = 1;
+		}
+		if (access(ch->temp.path, R_OK)) {
+			fprintf(stderr, "Error: file %s doesn't exist\n",
+				ch->temp.path);
+			outdated = 1;
+		} else if (lookup_input(&ch->temp)) {
+			fprintf(stderr, "Error: file %s isn't known to "
+				"libsensors\n", ch->temp.path);
+			outdated = 1;
+		}
+		for (j = 0; j < ch->fan_count; j++) {
+			if (access(ch->fans[j].path, R_OK)) {
+				fprintf(stderr, "Error: file %s doesn't "
+					"exist\n", ch->fans[j].path);
+				outdated = 1;
+			} else if (lookup_input(&ch->fans[j])) {
+				fprintf(stderr, "Error: file %s isn't known to "
+					"libsensors\n", ch->fans[j].path);
+				outdated = 1;
+			}
+		}
+	}
+
+	if (outdated) {
+		fprintf(stderr, "\nAt least one referenced file is missing. "
+			"Either some required kernel\nmodules haven't been "
+			"loaded, or your configuration file is outdated.\n"
+			"In the latter case, you should run pwmconfig "
+			"again.\n");
+	}
+	return outdated;
+}
+
+static const char *sensors_dir(const char *pwm)
+{
+	const char *p;
+
+	if (pwm[0] == '/')
+		return "/";
+	if (!strncmp(pwm, "hwmon", 5) && pwm[5] >= '0' && pwm[5] <= '9')
+		return "/sys/class/hwmon";
+	/* i2c device, like 0-0290 */
+	p = pwm + strspn(pwm, "0123456789");
+	if (p > pwm && *p == '-' && strspn(p + 1, "0123456789abcdef") >= 4)
+		return "/sys/bus/i2c/devices";
+	return NULL;
+}
+
+static void check_devices(void)
+{
+	const char *dir;
+
+	dir = sensors_dir(channels[0].pwm);
+	if (!dir) {
+		fprintf(stderr, "fancontrold: Invalid path to sensors\n");
+		exit(1);
+	}
+	if (chdir(dir)) {
+		fprintf(stderr, "fancontrold: No sensors found! (did you load "
+			"the necessary modules?)\n");
+		exit(1);
+	}
+
+	/* Check for configuration change */
+	if (strcmp(dir, "/") && (!settings[S_DEVPATH].value ||
+				 !*settings[S_DEVPATH].value ||
+				 !settings[S_DEVNAME].value ||
+				 !*settings[S_DEVNAME].value)) {
+		fprintf(stderr, "Configuration is too old, please run "
+			"pwmconfig again\n");
+		exit(1);
+	}
+	if (!strcmp(dir, "/") && settings[S_DEVPATH].value &&
+	    *settings[S_DEVPATH].value) {
+		fprintf(stderr, "Unneeded DEVPATH with absolute device "
+			"paths\n");
+		exit(1);
+	}
+	if (for_each_device(S_DEVPATH, check_device_path) |
+	    for_each_device(S_DEVNAME, check_device_name)) {
+		fprintf(stderr, "Configuration appears to be outdated, please "
+			"run pwmconfig again\n");
+		exit(1);
+	}
+	if (!strcmp(dir, "/sys/class/hwmon"))
+		for_each_device(S_DEVPATH, fixup_device_files);
+	if (check_files())
+		exit(1);
+}
+
+/*
+ * PWM outputs
+ */
+
+static int read_int(int fd, int *value)
+{
+	char buf[32], *end;
+	ssize_t len;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+	*value = strtol(buf, &end, 10);
+	return end == buf ? -1 : 0;
+}
+
+static int write_int(int fd, int value)
+{
+	char buf[16];
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "%d\n", value);
+	return pwrite(fd, buf, len, 0) == len ? 0 : -1;
+}
+
+/* For the pwmN_enable files, which are only accessed at start and exit */
+static int read_int_file(const char *path, int *value)
+{
+	int fd, ret;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	ret = read_int(fd, value);
+	close(fd);
+	return ret;
+}
+
+static int write_int_file(const char *path, int value)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	ret = write_int(fd, value);
+	if (close(fd))
+		ret = -1;
+	return ret;
+}
+
+static int pwm_enable(struct channel *ch)
+{
+	char enable[PATH_MAX];
+	int value;
+
+	ch->fd = open(ch->pwm, O_RDWR | O_CLOEXEC);
+	if (ch->fd < 0)
+		return -1;
+
+	snprintf(enable, sizeof(enable), "%s_enable", ch->pwm);
+	if (!access(enable, F_OK)) {
+		/* save the original pwmN_enable state, e.g. 1 for manual or
+		   2 for auto, and the value from pwmN */
+		if (!read_int_file(enable, &ch->orig_enable) &&
+		    !read_int(ch->fd, &ch->orig_pwm))
+			ch->saved = 1;
+		/* enable manual control by fancontrold */
+		if (write_int_file(enable, 1))
+			return -1;
+	}
+	if (!read_int(ch->fd, &value) && value == MAX)
+		return 0;
+	return write_int(ch->fd, MAX);
+}
+
+static int pwm_disable(struct channel *ch)
+{
+	char enable[PATH_MAX];
+	int value, pwm;
+
+	/* No enable file? Just set to max */
+	snprintf(enable, sizeof(enable), "%s_enable", ch->pwm);
+	if (access(enable, F_OK))
+		return ch->fd >= 0 ? write_int(ch->fd, MAX) :
+				     write_int_file(ch->pwm, MAX);
+	if (ch->fd < 0)
+		return 0;
+
+	/* Try to restore pwmN and pwmN_enable to the same state as before
+	   fancontrold started, pwmN first: some chips seem to need this to
+	   properly restore fan operation in automatic mode. Writing 1 again
+	   to pwmN_enable might reset pwmN, so it isn't. */
+	if (ch->saved) {
+		write_int(ch->fd, ch->orig_pwm);
+		if (ch->orig_enable != 1) {
+			write_int_file(enable, ch->orig_enable);
+			if (!read_int_file(enable, &value) &&
+			    value == ch->orig_enable)
+				return 0;
+		} else if (!read_int(ch->fd, &pwm) && pwm == ch->orig_pwm) {
+			return 0;
+		}
+	}
+
+	/* Try pwmN_enable=0 */
+	write_int_file(enable, 0);
+	if (!read_int_file(enable, &value) && value == 0)
+		return 0;
+
+	/* It didn't work, try pwmN_enable=1 pwmN=255 */
+	write_int_file(enable, 1);
+	write_int(ch->fd, MAX);
+	if (!read_int_file(enable, &value) && value == 1 &&
+	    !read_int(ch->fd, &pwm) && pwm >= 190)
+		return 0;
+
+	/* Nothing worked */
+	if (read_int_file(enable, &value))
+		value = -1;
+	fprintf(stderr, "%s stuck to %d\n", enable, value);
+	return -1;
+}
+
+static void restore_fans(int status)
+{
+	int i;
+
+	printf("Aborting, restoring fans...\n");
+	for (i = 0; i < channel_count; i++)
+		pwm_disable(&channels[i]);
+	printf("Verify fans have returned to full speed\n");
+	if (pidfile_created)
+		unlink(PIDFILE);
+	exit(status);
+}
+
+/*
+ * Main loop
+ */
+
+/* The pwm value of a temperature, linear between MINTEMP and MAXTEMP */
+static double curve(const struct channel *ch, double temp)
+{
+	if (temp <= ch->min_temp)
+		return ch->min_pwm;	/* below min temp, use defined min pwm */
+	if (temp >= ch->max_temp)
+		return ch->max_pwm;	/* over max temp, use defined max pwm */
+	return (temp - ch->min_temp) * (ch->max_pwm - ch->min_stop) /
+	       (ch->max_temp - ch->min_temp) + ch->min_stop;
+}
+
+/*
+ * With KI set, the output follows the curve through a PI controller
+ * instead of jumping to it: the integral term moves towards the curve by
+ * KI times the error integrated over the time elapsed, and the output adds
+ * KP times the remaining error to it. So KP is the part of a change which
+ * applies right away, and the rest follows with a time constant of 1/KI.
+ */
+static double smooth(struct channel *ch, double target, double elapsed,
+		     int first)
+{
+	if (!ch->ki)
+		return target;
+	if (first) {
+		ch->integral = target;
+		return target;
+	}
+
+	ch->integral += ch->ki * elapsed * (target - ch->integral);
+	return ch->integral + ch->kp * (target - ch->integral) + 0.5;
+}
+
+static void update_channel(struct channel *ch, long long now, double elapsed,
+			   int first)
+{
+	double temp, value, min_fan = 1, target;
+	int i, err, pwm, new_pwm, in_range;
+
+	if ((err = sensors_get_value(ch->temp.chip, ch->temp.nr, &temp))) {
+		fprintf(stderr, "Error reading temperature from %s: %s\n",
+			ch->temp.path, sensors_strerror(err));
+		restore_fans(1);
+	}
+	if (read_int(ch->fd, &pwm)) {
+		fprintf(stderr, "Error reading PWM value from %s\n", ch->pwm);
+		restore_fans(1);
+	}
+	for (i = 0; i < ch->fan_count; i++) {
+		if ((err = sensors_get_value(ch->fans[i].chip, ch->fans[i].nr,
+					     &value))) {
+			fprintf(stderr, "Error reading Fan value from %s: %s\n",
+				ch->fans[i].path, sensors_strerror(err));
+			restore_fans(1);
+		}
+		/* Remember the minimum, it only matters if it is 0 */
+		if (!i || value < min_fan)
+			min_fan = value;
+	}
+
+	/* Let a fan being started spin up */
+	if (ch->start_until && now < ch->start_until)
+		return;
+	ch->start_until = 0;
+
+	/* The output only decreases when the temperature dropped by more
+	   than HYSTERESIS since the output last increased */
+	if (!ch->have_ref || temp > ch->ref_temp ||
+	    temp < ch->ref_temp - ch->hyst) {
+		ch->ref_temp = temp;
+		ch->have_ref = 1;
+	}
+
+	target = curve(ch, ch->ref_temp);
+	in_range = ch->ref_temp > ch->min_temp && ch->ref_temp < ch->max_temp;
+	new_pwm = smooth(ch, target, elapsed, first);
+	if (in_range && new_pwm < ch->min_stop)
+		new_pwm = ch->min_stop;
+
+	/* If the fan was stopped, start it using a safe value */
+	if (in_range && (pwm == 0 || min_fan == 0)) {
+		if (write_int(ch->fd, ch->min_start)) {
+			fprintf(stderr, "Error writing PWM value to %s\n",
+				ch->pwm);
+			restore_fans(1);
+		}
+		if (ch->ki)
+			ch->integral = ch->min_start;
+		ch->start_until = now + START_TIME;
+		return;
+	}
+
+	if (new_pwm != pwm && write_int(ch->fd, new_pwm)) {
+		fprintf(stderr, "Error writing PWM value to %s\n", ch->pwm);
+		restore_fans(1);
+	}
+}
+
+static void update_fan_speeds(long long now, double elapsed, int first)
+{
+	int i;
+
+	for (i = 0; i < channel_count; i++)
+		update_channel(&channels[i], now, elapsed, first);
+}
+
+/* ms until the next fan start completes, -1 if none */
+static int start_timeout(long long now)
+{
+	long long timeout = -1, left;
+	int i;
+
+	for (i = 0; i < channel_count; i++) {
+		if (!channels[i].start_until)
+			continue;
+		left = channels[i].start_until - now;
+		if (left < 0)
+			left = 0;
+		if (timeout < 0 || left < timeout)
+			timeout = left;
+	}
+	return timeout;
+}
+
+static void create_pidfile(void)
+{
+	char buf[16];
+	int fd, len;
+
+	fd = open(PIDFILE, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		if (errno == EEXIST)
+			fprintf(stderr, "File %s exists, is fancontrol already "
+				"running?\n", PIDFILE);
+		else
+			fprintf(stderr, "Can't create %s: %s\n", PIDFILE,
+				strerror(errno));
+		exit(1);
+	}
+	len = snprintf(buf, sizeof(buf), "%d\n", (int) getpid());
+	if (write(fd, buf, len) != len || close(fd)) {
+		fprintf(stderr, "Can't write %s\n", PIDFILE);
+		unlink(PIDFILE);
+		exit(1);
+	}
+	pidfile_created = 1;
+}
+
+/* Only returns through restore_fans() */
+static void run(void)
+{
+	struct signalfd_siginfo si;
+	struct itimerspec its;
+	struct pollfd fds[2];
+	long long now, last;
+	uint64_t expirations;
+	sigset_t mask;
+	int timer;
+
+	/* Signals are received through a file descriptor */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGQUIT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGINT);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	fds[0].fd = signalfd(-1, &mask, SFD_CLOEXEC);
+	fds[1].fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	fds[0].events = fds[1].events = POLLIN;
+	if (fds[0].fd < 0 || fds[1].fd < 0) {
+		fprintf(stderr, "Error setting up the main loop: %s\n",
+			strerror(errno));
+		restore_fans(1);
+	}
+
+	its.it_interval.tv_sec = (time_t) interval;
+	its.it_interval.tv_nsec = (interval - its.it_interval.tv_sec) * 1e9;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(fds[1].fd, 0, &its, NULL)) {
+		fprintf(stderr, "Error setting up the timer: %s\n",
+			strerror(errno));
+		restore_fans(1);
+	}
+
+	printf("Starting automatic fan control...\n");
+	fflush(stdout);
+
+	last = now_ms();
+	update_fan_speeds(last, 0, 1);
+	for (;;) {
+		if (poll(fds, 2, start_timeout(now_ms())) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Error waiting for events: %s\n",
+				strerror(errno));
+			restore_fans(1);
+		}
+
+		if (fds[0].revents & POLLIN &&
+		    read(fds[0].fd, &si, sizeof(si)) == sizeof(si))
+			restore_fans(si.ssi_signo == SIGQUIT ||
+				     si.ssi_signo == SIGTERM ? 0 : 1);
+
+		/* Missed expirations are not caught up on */
+		timer = (fds[1].revents & POLLIN) &&
+			read(fds[1].fd, &expirations, sizeof(expirations)) ==
+			sizeof(expirations);
+		/* Otherwise, update when a fan start completes */
+		if (!timer && start_timeout(now_ms()) != 0)
+			continue;
+
+		now = now_ms();
+		update_fan_speeds(now, (now - last) / 1000.0, 0);
+		last = now;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *config = DEFAULT_CONFIG;
+	struct stat st;
+	int i, err;
+
+	if (argc > 2 || (argc == 2 && (!strcmp(argv[1], "-h") ||
+				      !strcmp(argv[1], "--help")))) {
+		printf("Usage: fancontrold [CONFIGFILE]\n");
+		exit(argc > 2);
+	}
+	if (argc == 2 && (!strcmp(argv[1], "-v") ||
+			  !strcmp(argv[1], "--version"))) {
+		printf("fancontrold version %s with libsensors version %s\n",
+		       LM_VERSION, libsensors_version);
+		exit(0);
+	}
+	if (argc == 2 && !stat(argv[1], &st) && S_ISREG(st.st_mode))
+		config = argv[1];
+
+	load_config(config);
+
+	/* The temperatures and fan speeds are read over and over, have
+	   libsensors keep their files open */
+	sensors_set_flags(sensors_get_flags() | SENSORS_FLAG_CACHE_FD);
+	if ((err = sensors_init(NULL))) {
+		fprintf(stderr, "Error initializing libsensors: %s\n",
+			sensors_strerror(err));
+		exit(1);
+	}
+
+	check_devices();
+	create_pidfile();
+
+	printf("Enabling PWM on fans...\n");
+	for (i = 0; i < channel_count; i++) {
+		if (pwm_enable(&channels[i])) {
+			fprintf(stderr, "Error enabling PWM on %s\n",
+				channels[i].pwm);
+			restore_fans(1);
+		}
+	}
+
+	run();
+	return 0;
+}
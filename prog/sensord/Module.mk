@@ -28,11 +28,12 @@ PROGSENSORDDIR := $(MODULE_DIR)
 
 PROGSENSORDMAN8DIR := $(MANDIR)/man8
 PROGSENSORDMAN8FILES := $(MODULE_DIR)/sensord.8
+PROGSENSORDHEADERFILES := $(MODULE_DIR)/sensord_shm.h
 
 # Regrettably, even 'simply expanded variables' will not put their currently
 # defined value verbatim into the command-list of rules...
 PROGSENSORDTARGETS := $(MODULE_DIR)/sensord
-PROGSENSORDSOURCES := $(MODULE_DIR)/args.c $(MODULE_DIR)/chips.c $(MODULE_DIR)/lib.c $(MODULE_DIR)/rrd.c $(MODULE_DIR)/sense.c $(MODULE_DIR)/sensord.c
+PROGSENSORDSOURCES := $(MODULE_DIR)/aggregate.c $(MODULE_DIR)/args.c $(MODULE_DIR)/chips.c $(MODULE_DIR)/lib.c $(MODULE_DIR)/rrd.c $(MODULE_DIR)/sense.c $(MODULE_DIR)/sensord.c $(MODULE_DIR)/sink.c
 
 # Include all dependency files. We use '.rd' to indicate this will create
 # executables.
@@ -40,22 +41,25 @@ INCLUDEFILES += $(PROGSENSORDSOURCES:.c=.rd)
 
 REMOVESENSORDBIN := $(patsubst $(MODULE_DIR)/%,$(DESTDIR)$(SBINDIR)/%,$(PROGSENSORDTARGETS))
 REMOVESENSORDMAN := $(patsubst $(MODULE_DIR)/%,$(DESTDIR)$(PROGSENSORDMAN8DIR)/%,$(PROGSENSORDMAN8FILES))
+REMOVESENSORDHF := $(patsubst $(MODULE_DIR)/%,$(DESTDIR)$(LIBINCLUDEDIR)/%,$(PROGSENSORDHEADERFILES))
 
 $(PROGSENSORDTARGETS): $(PROGSENSORDSOURCES:.c=.ro) lib/$(LIBSHBASENAME)
-	$(CC) $(EXLDFLAGS) -o $@ $(PROGSENSORDSOURCES:.c=.ro) -Llib -lsensors -lrrd
+	$(CC) $(EXLDFLAGS) -o $@ $(PROGSENSORDSOURCES:.c=.ro) -Llib -lsensors -lrrd -lpthread
 
 all-prog-sensord: $(PROGSENSORDTARGETS)
 user :: all-prog-sensord
 
 install-prog-sensord: all-prog-sensord
-	$(MKDIR) $(DESTDIR)$(SBINDIR) $(DESTDIR)$(PROGSENSORDMAN8DIR)
+	$(MKDIR) $(DESTDIR)$(SBINDIR) $(DESTDIR)$(PROGSENSORDMAN8DIR) $(DESTDIR)$(LIBINCLUDEDIR)
 	$(INSTALL) -m 755 $(PROGSENSORDTARGETS) $(DESTDIR)$(SBINDIR)
 	$(INSTALL) -m 644 $(PROGSENSORDMAN8FILES) $(DESTDIR)$(PROGSENSORDMAN8DIR)
+	$(INSTALL) -m 644 $(PROGSENSORDHEADERFILES) $(DESTDIR)$(LIBINCLUDEDIR)
 user_install :: install-prog-sensord
 
 user_uninstall::
 	$(RM) $(REMOVESENSORDBIN)
 	$(RM) $(REMOVESENSORDMAN)
+	$(RM) $(REMOVESENSORDHF)
 
 clean-prog-sensord:
 	$(RM) $(PROGSENSORDDIR)/*.rd $(PROGSENSORDDIR)/*.ro 
@@ -0,0 +1,167 @@
+/*
+ * sensord
+ *
+ * A daemon that periodically logs sensor information to syslog.
+ *
+ * Copyright (c) 2026 lm-sensors contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA.
+ */
+
+/*
+ * Aggregates of the values sampled during a window: minimum, maximum,
+ * sum, last value, and a few quantiles. The quantiles are estimated with
+ * the P-square algorithm (R. Jain and I. Chlamtac, "The P2 algorithm for
+ * dynamic calculation of quantiles and histograms without storing
+ * observations", CACM 28(10), 1985), which keeps 5 markers per quantile,
+ * so the memory used doesn't depend on the number of samples.
+ */
+
+#include <string.h>
+
+#include "sensord.h"
+
+const double aggregateQuantiles[AGG_QUANTILES] = { 0.5, 0.95, 0.99 };
+
+void aggregateReset(Aggregate *window)
+{
+	memset(window, 0, sizeof(*window));
+}
+
+/* Piecewise-parabolic prediction of the height of marker i moved by d */
+static double parabolic(const Quantile *q, int i, int d)
+{
+	return q->heights[i] + (double) d /
+	       (q->positions[i + 1] - q->positions[i - 1]) *
+	       ((q->positions[i] - q->positions[i - 1] + d) *
+		(q->heights[i + 1] - q->heights[i]) /
+		(q->positions[i + 1] - q->positions[i]) +
+		(q->positions[i + 1] - q->positions[i] - d) *
+		(q->heights[i] - q->heights[i - 1]) /
+		(q->positions[i] - q->positions[i - 1]));
+}
+
+static double linear(const Quantile *q, int i, int d)
+{
+	return q->heights[i] + d * (q->heights[i + d] - q->heights[i]) /
+	       (q->positions[i + d] - q->positions[i]);
+}
+
+/* Add a value once the markers are initialized */
+static void quantileAdd(Quantile *q, double p, double value)
+{
+	const double increments[5] = { 0, p / 2, p, (1 + p) / 2, 1 };
+	double height;
+	int i, k, d;
+
+	if (value < q->heights[0]) {
+		q->heights[0] = value;
+		k = 0;
+	} else if (value >= q->heights[4]) {
+		q->heights[4] = value;
+		k = 3;
+	} else {
+		for (k = 0; value >= q->heights[k + 1]; k++)
+			;
+	}
+
+	for (i = k + 1; i < 5; i++)
+		q->positions[i]++;
+	for (i = 0; i < 5; i++)
+		q->desired[i] += increments[i];
+
+	/* Move the middle markers to their desired positions if needed */
+	for (i = 1; i < 4; i++) {
+		double delta = q->desired[i] - q->positions[i];
+
+		if ((delta < 1 || q->positions[i + 1] - q->positions[i] <= 1) &&
+		    (delta > -1 || q->positions[i - 1] - q->positions[i] >= -1))
+			continue;
+
+		d = delta > 0 ? 1 : -1;
+		height = parabolic(q, i, d);
+		if (q->heights[i - 1] < height && height < q->heights[i + 1])
+			q->heights[i] = height;
+		else
+			q->heights[i] = linear(q, i, d);
+		q->positions[i] += d;
+	}
+}
+
+/* The first 5 values are kept sorted, they become the markers */
+static void quantileInit(Quantile *q, double p, int count, double value)
+{
+	int i;
+
+	for (i = count; i > 0 && q->heights[i - 1] > value; i--)
+		q->heights[i] = q->heights[i - 1];
+	q->heights[i] = value;
+
+	if (count < 4)
+		return;
+	for (i = 0; i < 5; i++)
+		q->positions[i] = i + 1;
+	q->desired[0] = 1;
+	q->desired[1] = 1 + 2 * p;
+	q->desired[2] = 1 + 4 * p;
+	q->desired[3] = 3 + 2 * p;
+	q->desired[4] = 5;
+}
+
+void aggregateAdd(Aggregate *window, double value)
+{
+	int i;
+
+	if (!window->count || value < window->min)
+		window->min = value;
+	if (!window->count || value > window->max)
+		window->max = value;
+	window->sum += value;
+	window->last = value;
+
+	for (i = 0; i < AGG_QUANTILES; i++) {
+		if (window->count < 5)
+			quantileInit(&window->quantiles[i],
+				     aggregateQuantiles[i], window->count,
+				     value);
+		else
+			quantileAdd(&window->quantiles[i],
+				    aggregateQuantiles[i], value);
+	}
+	window->count++;
+}
+
+/*
+ * The estimated quantile i of the window, which must not be empty. This is
+ * interpolated between the markers around its rank, rather than just
+ * being the middle marker, which is only accurate after many values.
+ */
+double aggregateQuantile(const Aggregate *window, int i)
+{
+	const Quantile *q = &window->quantiles[i];
+	double rank = 1 + aggregateQuantiles[i] * (window->count - 1);
+	int k;
+
+	/* Few values, they are all there, sorted */
+	if (window->count < 5)
+		return q->heights[(int) (rank - 0.5)];
+
+	for (k = 0; k < 3 && q->positions[k + 1] < rank; k++)
+		;
+	return q->heights[k] + (rank - q->positions[k]) *
+	       (q->heights[k + 1] - q->heights[k]) /
+	       (q->positions[k + 1] - q->positions[k]);
+}
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <getopt.h>
 #include <syslog.h>
 
@@ -34,32 +35,69 @@
 
 struct sensord_arguments sensord_args = {
  	.pidFile = "/var/run/sensord.pid",
- 	.scanTime = 60,
- 	.logTime = 30 * 60,
- 	.rrdTime = 5 * 60,
+ 	.scanTime = 60 * 1000,
+ 	.logTime = 30 * 60 * 1000,
+ 	.rrdTime = 5 * 60 * 1000,
+	.sinkTime = 10 * 1000,
+	.keyframeTime = 30 * 60 * 1000,
+	.logDelta = -1,
+	.chipTimeout = 1000,
+	.rrdBatch = 1,
  	.syslogFacility = LOG_DAEMON,
 };
 
+/* Parse a time value, and return it in milliseconds */
 static int parseTime(char *arg)
 {
 	char *end;
-	int value = strtoul(arg, &end, 10);
-	if ((end > arg) && (*end == 's')) {
+	long long value = strtoul(arg, &end, 10);
+	if ((end > arg) && !strcmp(end, "ms")) {
+		end += 2;
+	} else if ((end > arg) && (*end == 's')) {
+		value *= 1000;
 		++ end;
 	} else if ((end > arg) && (*end == 'm')) {
-		value *= 60;
+		value *= 60 * 1000;
 		++ end;
 	} else if ((end > arg) && (*end == 'h')) {
-		value *= 60 * 60;
+		value *= 60 * 60 * 1000;
 		++ end;
+	} else {
+		value *= 1000;
 	}
-	if ((end == arg) || *end) {
+	if ((end == arg) || *end || value > INT_MAX) {
 		fprintf(stderr, "Error parsing time value `%s'.\n", arg);
 		return -1;
 	}
 	return value;
 }
 
+/* Parse a count between min and max */
+static int parseCount(char *arg, int min, int max, const char *what)
+{
+	char *end;
+	long value = strtol(arg, &end, 10);
+	if ((end == arg) || *end || value < min || value > max) {
+		fprintf(stderr, "Error parsing %s `%s'.\n", what, arg);
+		return -1;
+	}
+	return value;
+}
+
+/* Parse a percentage */
+static double parsePercent(char *arg)
+{
+	char *end;
+	double value = strtod(arg, &end);
+	if ((end > arg) && (*end == '%'))
+		++ end;
+	if ((end == arg) || *end || !(value >= 0)) {
+		fprintf(stderr, "Error parsing percentage `%s'.\n", arg);
+		return -1;
+	}
+	return value;
+}
+
 static struct {
 	const char *name;
 	int id;
@@ -92,9 +130,21 @@ static int parseFacility(char *arg)
 static const char *daemonSyntax =
 	"  -i, --interval <time>     -- interval between scanning alarms (default 60s)\n"
 	"  -l, --log-interval <time> -- interval between logging sensors (default 30m)\n"
+	"  -e, --log-delta <pct>     -- log only changes above pct (default <none>)\n"
+	"  -k, --keyframe <time>     -- interval between full logs (default 30m)\n"
 	"  -t, --rrd-interval <time> -- interval between updating RRD file (default 5m)\n"
 	"  -T, --rrd-no-average      -- switch RRD in non-average mode\n"
+	"  -j, --threads <n>         -- read the chips with n threads (default 0)\n"
+	"  -w, --chip-timeout <time> -- max time to read a chip (default 1s)\n"
 	"  -r, --rrd-file <file>     -- RRD file (default <none>)\n"
+	"  -D, --rrd-daemon <addr>   -- send RRD updates to rrdcached (default <none>)\n"
+	"  -b, --rrd-batch <n>       -- write RRD updates n at a time (default 1)\n"
+	"  -M, --metrics <addr>      -- serve OpenMetrics on addr (default <none>)\n"
+	"  -U, --line-protocol <a>   -- send line protocol to a (default <none>)\n"
+	"  -m, --shm-file <file>     -- publish readings in file (default <none>)\n"
+	"  -s, --sink-interval <t>   -- interval between metrics updates (default 10s)\n"
+	"  -S, --sample-interval <t> -- aggregate values sampled every t (default 0)\n"
+	"  -x, --stats               -- export read statistics to the sinks\n"
 	"  -c, --config-file <file>  -- configuration file\n"
 	"  -p, --pid-file <file>     -- PID file (default /var/run/sensord.pid)\n"
 	"  -f, --syslog-facility <f> -- syslog facility to use (default local4)\n"
@@ -105,7 +155,11 @@ static const char *daemonSyntax =
 	"  -h, --help                -- display help and exit\n"
 	"\n"
 	"Specify a value of 0 for any interval to disable that operation;\n"
-	"for example, specify --log-interval 0 to only scan for alarms."
+	"for example, specify --log-interval 0 to only scan for alarms.\n"
+	"Times are in seconds, or use the suffix ms, s, m or h.\n"
+	"\n"
+	"With threads, chips not read within the chip timeout are skipped for\n"
+	"that cycle; specify --chip-timeout 0 to always wait for them.\n"
 	"\n"
 	"Specify the filename `-' to read the config file from stdin.\n"
 	"\n"
@@ -116,15 +170,27 @@ static const char *daemonSyntax =
 	"the RRD file configuration must EXACTLY match the sensors that are used. If\n"
 	"your configuration changes, delete the old RRD file and restart sensord.\n";
 
-static const char *shortOptions = "i:l:t:Tf:r:c:p:advhg:";
+static const char *shortOptions = "i:l:e:k:t:Tj:w:f:r:D:b:M:U:m:s:S:xc:p:advhg:";
 
 static const struct option longOptions[] = {
 	{ "interval", required_argument, NULL, 'i' },
 	{ "log-interval", required_argument, NULL, 'l' },
+	{ "log-delta", required_argument, NULL, 'e' },
+	{ "keyframe", required_argument, NULL, 'k' },
 	{ "rrd-interval", required_argument, NULL, 't' },
 	{ "rrd-no-average", no_argument, NULL, 'T' },
+	{ "threads", required_argument, NULL, 'j' },
+	{ "chip-timeout", required_argument, NULL, 'w' },
 	{ "syslog-facility", required_argument, NULL, 'f' },
 	{ "rrd-file", required_argument, NULL, 'r' },
+	{ "rrd-daemon", required_argument, NULL, 'D' },
+	{ "rrd-batch", required_argument, NULL, 'b' },
+	{ "metrics", required_argument, NULL, 'M' },
+	{ "line-protocol", required_argument, NULL, 'U' },
+	{ "shm-file", required_argument, NULL, 'm' },
+	{ "sink-interval", required_argument, NULL, 's' },
+	{ "sample-interval", required_argument, NULL, 'S' },
+	{ "stats", no_argument, NULL, 'x' },
 	{ "config-file", required_argument, NULL, 'c' },
 	{ "pid-file", required_argument, NULL, 'p' },
 	{ "rrd-cgi", required_argument, NULL, 'g' },
@@ -157,6 +223,14 @@ int parseArgs(int argc, char **argv)
 			if ((sensord_args.logTime = parseTime(optarg)) < 0)
 				return -1;
 			break;
+		case 'e':
+			if ((sensord_args.logDelta = parsePercent(optarg)) < 0)
+				return -1;
+			break;
+		case 'k':
+			if ((sensord_args.keyframeTime = parseTime(optarg)) < 0)
+				return -1;
+			break;
 		case 't':
 			if ((sensord_args.rrdTime = parseTime(optarg)) < 0)
 				return -1;
@@ -164,6 +238,17 @@ int parseArgs(int argc, char **argv)
 		case 'T':
 			sensord_args.rrdNoAverage = 1;
 			break;
+		case 'j':
+			sensord_args.threads = parseCount(optarg, 0,
+							  MAX_THREADS,
+							  "thread count");
+			if (sensord_args.threads < 0)
+				return -1;
+			break;
+		case 'w':
+			if ((sensord_args.chipTimeout = parseTime(optarg)) < 0)
+				return -1;
+			break;
 		case 'f':
 			sensord_args.syslogFacility = parseFacility(optarg);
 			if (sensord_args.syslogFacility < 0)
@@ -181,6 +266,36 @@ int parseArgs(int argc, char **argv)
 		case 'r':
 			sensord_args.rrdFile = optarg;
 			break;
+		case 'D':
+			sensord_args.rrdDaemon = optarg;
+			break;
+		case 'M':
+			sensord_args.metricsAddress = optarg;
+			break;
+		case 'U':
+			sensord_args.lineAddress = optarg;
+			break;
+		case 'm':
+			sensord_args.shmFile = optarg;
+			break;
+		case 's':
+			if ((sensord_args.sinkTime = parseTime(optarg)) < 0)
+				return -1;
+			break;
+		case 'S':
+			if ((sensord_args.sampleTime = parseTime(optarg)) < 0)
+				return -1;
+			break;
+		case 'x':
+			sensord_args.doStats = 1;
+			break;
+		case 'b':
+			sensord_args.rrdBatch = parseCount(optarg, 1,
+							   MAX_RRD_BATCH,
+							   "RRD batch size");
+			if (sensord_args.rrdBatch < 0)
+				return -1;
+			break;
 		case 'd':
 			sensord_args.debug = 1;
 			break;
@@ -219,10 +334,47 @@ int parseArgs(int argc, char **argv)
 		return -1;
 	}
 
+	if (sensord_args.rrdFile && sensord_args.rrdTime % 1000) {
+		fprintf(stderr,
+			"Error: --rrd-interval must be a whole number of seconds.\n");
+		return -1;
+	}
+
+	if ((sensord_args.metricsAddress || sensord_args.lineAddress ||
+	     sensord_args.shmFile) && !sensord_args.sinkTime) {
+		fprintf(stderr,
+			"Error: Incompatible --metrics, --line-protocol or --shm-file without --sink-interval.\n");
+		return -1;
+	}
+
+	if (sensord_args.logDelta >= 0 && !sensord_args.logTime &&
+	    !(sensord_args.lineAddress && sensord_args.sinkTime)) {
+		fprintf(stderr,
+			"Error: Incompatible --log-delta without --log-interval or --line-protocol.\n");
+		return -1;
+	}
+
+	if (sensord_args.sampleTime && !sensord_args.rrdFile &&
+	    !(sensord_args.sinkTime && (sensord_args.metricsAddress ||
+					 sensord_args.lineAddress))) {
+		fprintf(stderr,
+			"Error: Incompatible --sample-interval without --rrd-file, --metrics or --line-protocol.\n");
+		return -1;
+	}
+
+	if (sensord_args.doStats &&
+	    !(sensord_args.sinkTime && (sensord_args.metricsAddress ||
+					 sensord_args.lineAddress))) {
+		fprintf(stderr,
+			"Error: Incompatible --stats without --metrics or --line-protocol.\n");
+		return -1;
+	}
+
 	if (!sensord_args.logTime && !sensord_args.scanTime &&
-	    !sensord_args.rrdFile) {
+	    !sensord_args.rrdFile && !sensord_args.metricsAddress &&
+	    !sensord_args.lineAddress && !sensord_args.shmFile) {
 		fprintf(stderr,
-			"Error: No logging, alarm or RRD scanning.\n");
+			"Error: No logging, alarm, RRD or metrics scanning.\n");
 		return -1;
 	}
 
@@ -4,22 +4,37 @@
 #include <lib/sensors.h>
 
 #define MAX_CHIP_NAMES 32
+#define MAX_THREADS 64
+#define MAX_RRD_BATCH 1024
 
 struct sensord_arguments {
 	int isDaemon;
 	const char *cfgFile;
 	const char *pidFile;
 	const char *rrdFile;
+	const char *rrdDaemon;
+	const char *metricsAddress;
+	const char *lineAddress;
+	const char *shmFile;
 	const char *cgiDir;
+	/* Intervals, in milliseconds */
+	int sampleTime;
 	int scanTime;
 	int logTime;
 	int rrdTime;
+	int sinkTime;
+	int keyframeTime;
+	int chipTimeout;
+	int threads;
+	double logDelta;	/* percent, negative if disabled */
 	int rrdNoAverage;
+	int rrdBatch;
 	int syslogFacility;
 	int doScan;
 	int doSet;
 	int doCGI;
 	int doLoad;
+	int doStats;
 	int debug;
 	sensors_chip_name chipNames[MAX_CHIP_NAMES];
 	int numChipNames;
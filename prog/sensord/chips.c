@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "args.h"
 #include "sensord.h"
 
 /* TODO: Temp in C/F */
@@ -107,28 +108,24 @@ static const char *fmtSoundAlarm(const double values[], int alrm, int beep)
 	return fmtExtra(alrm, beep);
 }
 
-static const char *rrdF0(const double values[])
+static void rrdF0(const double values[])
 {
-	sprintf(buff, "%.0f", values[0]);
-	return buff;
+	rrdSampleValue(values[0], 0);
 }
 
-static const char *rrdF1(const double values[])
+static void rrdF1(const double values[])
 {
-	sprintf(buff, "%.1f", values[0]);
-	return buff;
+	rrdSampleValue(values[0], 1);
 }
 
-static const char *rrdF2(const double values[])
+static void rrdF2(const double values[])
 {
-	sprintf(buff, "%.2f", values[0]);
-	return buff;
+	rrdSampleValue(values[0], 2);
 }
 
-static const char *rrdF3(const double values[])
+static void rrdF3(const double values[])
 {
-	sprintf(buff, "%.3f", values[0]);
-	return buff;
+	rrdSampleValue(values[0], 3);
 }
 
 static void fillChipVoltage(FeatureDescriptor *voltage,
@@ -367,13 +364,86 @@ static FeatureDescriptor * generateChipFeatures(const sensors_chip_name *chip)
 		}
 
 		features[count].feature = sensor;
+		/* Errors are reported when the label is used */
+		features[count].label = sensors_get_label(chip, sensor);
 		count++;
 	}
 
 	return features;
 }
 
+static void freeChipFeatures(FeatureDescriptor *features)
+{
+	int i;
+
+	for (i = 0; features[i].format; i++)
+		free(features[i].label);
+	free(features);
+}
+
+static char *getChipName(const sensors_chip_name *chip)
+{
+	char buffer[256];
+
+	if (sensors_snprintf_chip_name(buffer, 256, chip) < 0)
+		return NULL;
+	return strdup(buffer);
+}
+
+/* Allocate the sample buffer of a chip, large enough for all the
+   subfeatures its features use, and the last reports and aggregates of its
+   features */
+static int allocSamples(ChipDescriptor *chip)
+{
+	SampleBuffer *samples = &chip->samples;
+	const FeatureDescriptor *feature;
+	int i, max = -1, refs = 0;
+
+	for (feature = chip->features; feature->format; feature++) {
+		if (feature->alarmNumber > max)
+			max = feature->alarmNumber;
+		if (feature->beepNumber > max)
+			max = feature->beepNumber;
+		for (i = 0; feature->dataNumbers[i] >= 0; i++)
+			if (feature->dataNumbers[i] > max)
+				max = feature->dataNumbers[i];
+		refs += i + 2;
+	}
+
+	samples->count = max + 1;
+	samples->values = calloc(max + 1, sizeof(double));
+	samples->errors = calloc(max + 1, sizeof(int));
+	samples->cycles = calloc(max + 1, sizeof(unsigned int));
+	samples->pending = malloc((refs + 1) * sizeof(int));
+	samples->pendingValues = malloc((refs + 1) * sizeof(double));
+	samples->pendingErrors = malloc((refs + 1) * sizeof(int));
+	chip->reports = calloc((feature - chip->features) * REPORT_MAX + 1,
+			       sizeof(LastReport));
+	if (sensord_args.sampleTime)
+		chip->windows = calloc((feature - chip->features) * AGG_MAX +
+				       1, sizeof(Aggregate));
+	if (!samples->values || !samples->errors || !samples->cycles ||
+	    !samples->pending || !samples->pendingValues ||
+	    !samples->pendingErrors || !chip->reports ||
+	    (sensord_args.sampleTime && !chip->windows))
+		return 1;
+	return 0;
+}
+
+static void freeSamples(ChipDescriptor *chip)
+{
+	free(chip->samples.values);
+	free(chip->samples.errors);
+	free(chip->samples.cycles);
+	free(chip->samples.pending);
+	free(chip->samples.pendingValues);
+	free(chip->samples.pendingErrors);
+	free(chip->reports);
+	free(chip->windows);
+}
+
 ChipDescriptor * knownChips;
+unsigned int knownChipsGeneration;	/* changes when knownChips does */
 
 int initKnownChips(void)
 {
@@ -391,12 +461,19 @@ int initKnownChips(void)
 		return 1;
 
 	/* Fill in the data structures */
+	knownChipsGeneration++;
 	count = 0;
 	nr = 0;
 	while ((name = sensors_get_detected_chips(NULL, &nr))) {
 		knownChips[count].name = name;
-		if ((knownChips[count].features = generateChipFeatures(name)))
-			count++;
+		knownChips[count].fullName = getChipName(name);
+		if ((knownChips[count].features = generateChipFeatures(name))) {
+			if (allocSamples(&knownChips[count++]))
+				return 1;
+		} else {
+			free(knownChips[count].fullName);
+			knownChips[count].fullName = NULL;
+		}
 	}
 
 	return 0;
@@ -406,7 +483,69 @@ void freeKnownChips(void)
 {
 	int index0;
 
-	for (index0 = 0; knownChips[index0].features; index0++)
-		free(knownChips[index0].features);
+	for (index0 = 0; knownChips[index0].features; index0++) {
+		freeChipFeatures(knownChips[index0].features);
+		free(knownChips[index0].fullName);
+		freeSamples(&knownChips[index0]);
+	}
 	free(knownChips);
 }
+
+/* Add a chip detected after initialization */
+int addKnownChip(const sensors_chip_name *name)
+{
+	int count;
+	ChipDescriptor *chips;
+	FeatureDescriptor *features;
+
+	for (count = 0; knownChips[count].features; count++)
+		if (knownChips[count].name == name)
+			return 0;
+
+	features = generateChipFeatures(name);
+	if (!features)
+		return 1;
+	chips = realloc(knownChips, (count + 2) * sizeof(ChipDescriptor));
+	if (!chips) {
+		freeChipFeatures(features);
+		return 1;
+	}
+
+	knownChips = chips;
+	knownChipsGeneration++;
+	memset(&knownChips[count + 1], 0, sizeof(ChipDescriptor));
+	knownChips[count].name = name;
+	knownChips[count].fullName = getChipName(name);
+	knownChips[count].features = features;
+	if (allocSamples(&knownChips[count])) {
+		freeSamples(&knownChips[count]);
+		free(knownChips[count].fullName);
+		freeChipFeatures(features);
+		memset(&knownChips[count], 0, sizeof(ChipDescriptor));
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Forget about a chip before it is removed from libsensors */
+void removeKnownChip(const sensors_chip_name *name)
+{
+	int index0, count;
+
+	for (index0 = 0; knownChips[index0].features; index0++)
+		if (knownChips[index0].name == name)
+			break;
+	if (!knownChips[index0].features)
+		return;
+
+	knownChipsGeneration++;
+	freeChipFeatures(knownChips[index0].features);
+	free(knownChips[index0].fullName);
+	freeSamples(&knownChips[index0]);
+	for (count = index0; knownChips[count].features; count++)
+		;
+	/* Move the following chips and the terminating entry */
+	memmove(&knownChips[index0], &knownChips[index0 + 1],
+		(count - index0) * sizeof(ChipDescriptor));
+}
@@ -28,8 +28,12 @@
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <linux/netlink.h>
 
+#include "args.h"
 #include "sensord.h"
 #include "lib/error.h"
 
@@ -81,6 +85,12 @@ static int loadConfig(const char *cfgPath, int reload)
 int loadLib(const char *cfgPath)
 {
 	int ret;
+
+	/* We read the same attributes over and over, keep them open */
+	sensors_set_flags(sensors_get_flags() | SENSORS_FLAG_CACHE_FD);
+	/* Count the reads from the start, for the sinks */
+	if (sensord_args.doStats)
+		sensors_set_flags(sensors_get_flags() | SENSORS_FLAG_STATS);
 	ret = loadConfig(cfgPath, 0);
 	if (!ret)
 		ret = initKnownChips();
@@ -103,3 +113,260 @@ int unloadLib(void)
 	sensors_cleanup();
 	return 0;
 }
+
+/* Listen to the kernel uevents, to learn about hwmon devices coming and
+   going. Returns the socket, or -1 if this isn't possible. */
+int openHotplug(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		sensorLog(LOG_DEBUG, "No hotplug events: %s", strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;	/* Kernel events */
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		sensorLog(LOG_DEBUG, "No hotplug events: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void hotplugEvent(const char *action, const char *devpath)
+{
+	const char *classdev = strrchr(devpath, '/') + 1;
+	const sensors_chip_name *chip;
+	char name[256];
+	int ret;
+
+	if (!strcmp(action, "add")) {
+		ret = sensors_add_hwmon(classdev, &chip);
+		if (ret) {
+			sensorLog(LOG_NOTICE, "Error adding %s: %s", classdev,
+				  sensors_strerror(ret));
+			return;
+		}
+		if (!chip)
+			return;
+		if (addKnownChip(chip)) {
+			sensorLog(LOG_ERR, "Error adding %s: out of memory",
+				  classdev);
+			return;
+		}
+		sensors_snprintf_chip_name(name, sizeof(name), chip);
+		sensorLog(LOG_INFO, "Chip added: %s", name);
+	} else if (!strcmp(action, "remove")) {
+		chip = sensors_get_hwmon_chip(classdev);
+		if (!chip)
+			return;
+		sensors_snprintf_chip_name(name, sizeof(name), chip);
+		sensorLog(LOG_INFO, "Chip removed: %s", name);
+		removeKnownChip(chip);
+		sensors_remove_chip(chip);
+	}
+}
+
+/* Process the pending uevents. Each one is a header followed by
+   KEY=value strings. */
+void handleHotplug(int fd)
+{
+	char buf[8192];
+	struct sockaddr_nl addr;
+	struct iovec iov;
+	struct msghdr msg;
+	const char *p, *action, *devpath, *subsystem;
+	ssize_t len;
+
+	for (;;) {
+		iov.iov_base = buf;
+		iov.iov_len = sizeof(buf) - 1;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &addr;
+		msg.msg_namelen = sizeof(addr);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+
+		len = recvmsg(fd, &msg, 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		/* Only trust the kernel */
+		if (msg.msg_namelen != sizeof(addr) || addr.nl_pid != 0)
+			continue;
+		buf[len] = '\0';
+
+		action = devpath = subsystem = NULL;
+		for (p = buf + strlen(buf) + 1; p < buf + len;
+		     p += strlen(p) + 1) {
+			if (!strncmp(p, "ACTION=", 7))
+				action = p + 7;
+			else if (!strncmp(p, "DEVPATH=", 8))
+				devpath = p + 8;
+			else if (!strncmp(p, "SUBSYSTEM=", 10))
+				subsystem = p + 10;
+		}
+
+		if (action && devpath && subsystem &&
+		    !strcmp(subsystem, "hwmon") && strrchr(devpath, '/'))
+			hotplugEvent(action, devpath);
+	}
+}
+
+/*
+ * Alarm notifications: the alarm subfeatures of the known chips are kept
+ * open with sensors_open_poll(), and watched by an epoll instance of their
+ * own, which the main loop watches in turn. The alarms of drivers which
+ * don't notify their changes are only found by the periodic scan.
+ */
+typedef struct {
+	int fd;
+	const sensors_chip_name *chip;
+	int number;
+} AlarmWatch;
+
+static struct {
+	int epfd;
+	unsigned int generation;
+	AlarmWatch *watches;
+	int count;
+	int max;
+} alarms = { -1, 0, NULL, 0, 0 };
+
+static void closeAlarmWatches(void)
+{
+	int i;
+
+	/* Closing the descriptors removes them from the epoll instance */
+	for (i = 0; i < alarms.count; i++)
+		close(alarms.watches[i].fd);
+	alarms.count = 0;
+}
+
+static void addAlarmWatch(const sensors_chip_name *chip, int number)
+{
+	struct epoll_event ev;
+	AlarmWatch *watches;
+	double value;
+	int fd;
+
+	fd = sensors_open_poll(chip, number, &value);
+	if (fd < 0)
+		return;
+
+	if (alarms.count == alarms.max) {
+		watches = realloc(alarms.watches, (alarms.max + 16) *
+				  sizeof(AlarmWatch));
+		if (!watches) {
+			close(fd);
+			return;
+		}
+		alarms.watches = watches;
+		alarms.max += 16;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLPRI;
+	ev.data.u32 = alarms.count;
+	/* Fails for files which can't be polled, outside of sysfs */
+	if (epoll_ctl(alarms.epfd, EPOLL_CTL_ADD, fd, &ev)) {
+		close(fd);
+		return;
+	}
+
+	alarms.watches[alarms.count].fd = fd;
+	alarms.watches[alarms.count].chip = chip;
+	alarms.watches[alarms.count].number = number;
+	alarms.count++;
+}
+
+/* Open the alarms of the known chips again if they changed */
+void refreshAlarms(void)
+{
+	const FeatureDescriptor *feature;
+	int i;
+
+	if (alarms.epfd < 0 || alarms.generation == knownChipsGeneration)
+		return;
+	alarms.generation = knownChipsGeneration;
+
+	closeAlarmWatches();
+	for (i = 0; knownChips && knownChips[i].features; i++)
+		for (feature = knownChips[i].features; feature->format;
+		     feature++)
+			if (feature->alarmNumber >= 0)
+				addAlarmWatch(knownChips[i].name,
+					      feature->alarmNumber);
+
+	sensorLog(LOG_DEBUG, "Watching %d alarms for notifications",
+		  alarms.count);
+}
+
+/* Returns the descriptor to watch for alarm notifications, or -1 if this
+   isn't possible */
+int openAlarms(void)
+{
+	alarms.epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (alarms.epfd < 0) {
+		sensorLog(LOG_DEBUG, "No alarm notifications: %s",
+			  strerror(errno));
+		return -1;
+	}
+	alarms.generation = knownChipsGeneration - 1;
+	refreshAlarms();
+
+	return alarms.epfd;
+}
+
+/* Acknowledge the pending alarm notifications. Returns the number of
+   alarms which changed, the chips must be scanned if not 0. */
+int handleAlarms(void)
+{
+	struct epoll_event events[16];
+	double value;
+	int i, n, count = 0;
+
+	if (alarms.epfd < 0)
+		return 0;
+
+	/* The chips changed, the alarms are read again by the scan */
+	if (alarms.generation != knownChipsGeneration) {
+		refreshAlarms();
+		return 1;
+	}
+
+	while ((n = epoll_wait(alarms.epfd, events, ARRAY_SIZE(events),
+			       0)) > 0) {
+		for (i = 0; i < n; i++) {
+			AlarmWatch *watch = &alarms.watches[events[i].data.u32];
+
+			sensors_read_poll(watch->chip, watch->number,
+					  watch->fd, &value);
+		}
+		count += n;
+		if (n < ARRAY_SIZE(events))
+			break;
+	}
+
+	return count;
+}
+
+void closeAlarms(void)
+{
+	closeAlarmWatches();
+	free(alarms.watches);
+	alarms.watches = NULL;
+	alarms.max = 0;
+	if (alarms.epfd >= 0)
+		close(alarms.epfd);
+	alarms.epfd = -1;
+}
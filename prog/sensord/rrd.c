@@ -33,15 +33,18 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include <rrd.h>
+#include <rrd_client.h>
 
 #include "args.h"
 #include "sensord.h"
@@ -61,10 +64,101 @@
 #define RAW_LABEL_LENGTH 32
 /* DS:label:GAUGE:900:U:U | :3000 .. TODO: fix */
 #define RRD_BUFF 64
+/* The longest DS name rrdtool accepts */
+#define RRD_DS_NAME_MAX 19
 
-char rrdBuff[MAX_RRD_SENSORS * RRD_BUFF + 1];
+/* room for the aggregates and the load average too */
+static char rrdDefs[AGG_RRD_VALUES * MAX_RRD_SENSORS + 1][RRD_BUFF];
 static char rrdLabels[MAX_RRD_SENSORS][RAW_LABEL_LENGTH + 1];
 
+/* :-1234567890123456.789 or :-1.234e+300 */
+#define RRD_VALUE_MAX 24
+
+/* The update being built, N:value:value... */
+static struct {
+	char *data;
+	size_t len;
+	size_t size;
+	int overflow;	/* out of memory, the update is incomplete */
+} rrdSample;
+
+/* Make room for count values, returns 0 on success */
+static int rrdSampleReserve(int count)
+{
+	size_t size = rrdSample.len + count * RRD_VALUE_MAX + 1;
+	char *data;
+
+	if (size <= rrdSample.size)
+		return 0;
+	if (size < 2 * rrdSample.size)
+		size = 2 * rrdSample.size;
+	data = realloc(rrdSample.data, size);
+	if (!data)
+		return -1;
+	rrdSample.data = data;
+	rrdSample.size = size;
+	return 0;
+}
+
+/* The updates are written later, so they carry the time of the sample */
+void rrdSampleStart(void)
+{
+	rrdSample.len = 0;
+	rrdSample.overflow = rrdSampleReserve(1);
+	if (!rrdSample.overflow)
+		rrdSample.len = sprintf(rrdSample.data, "%ld",
+					(long) time(NULL));
+}
+
+void rrdSampleUnknown(void)
+{
+	if (rrdSample.overflow || (rrdSample.overflow = rrdSampleReserve(1)))
+		return;
+	rrdSample.data[rrdSample.len++] = ':';
+	rrdSample.data[rrdSample.len++] = 'U';
+}
+
+/* Append a value with the given number of decimals, at most 3 */
+void rrdSampleValue(double value, int decimals)
+{
+	static const unsigned int scale[] = { 1, 10, 100, 1000 };
+	char digits[24], *p;
+	unsigned long long scaled;
+	int n = 0;
+
+	/* NaN, or too large for the fast path, including infinites */
+	if (value != value) {
+		rrdSampleUnknown();
+		return;
+	}
+	if (rrdSample.overflow || (rrdSample.overflow = rrdSampleReserve(1)))
+		return;
+	p = rrdSample.data + rrdSample.len;
+	*p++ = ':';
+	if (value >= 1e15 || value <= -1e15) {
+		p += snprintf(p, RRD_VALUE_MAX - 1, "%.*e", decimals, value);
+		rrdSample.len = p - rrdSample.data;
+		return;
+	}
+
+	if (value < 0) {
+		*p++ = '-';
+		value = -value;
+	}
+	scaled = value * scale[decimals] + 0.5;
+	if (!scaled && p[-1] == '-')
+		p--;
+	do {
+		digits[n++] = '0' + scaled % 10;
+		scaled /= 10;
+		if (n == decimals)
+			digits[n++] = '.';
+	} while (scaled || n < (decimals ? decimals + 2 : 1));
+	while (n)
+		*p++ = digits[--n];
+	rrdSample.len = p - rrdSample.data;
+}
+
 #define LOADAVG "loadavg"
 #define LOAD_AVERAGE "Load Average"
 
@@ -84,14 +178,54 @@ static char rrdNextChar(char c)
 	}
 }
 
+/* The data sources of the aggregates are named after the label with these */
+static const char *rrdSuffixes[AGG_RRD_VALUES - 1] = {
+	"_min", "_max", "_p95"
+};
+#define RRD_SUFFIX_LENGTH 4
+
+/* Whether name is the name of an aggregate of label */
+static int rrdIsAggregate(const char *name, const char *label)
+{
+	size_t len = strlen(label);
+	int i;
+
+	if (strncmp(name, label, len))
+		return 0;
+	for (i = 0; i < AGG_RRD_VALUES - 1; i++)
+		if (!strcmp(name + len, rrdSuffixes[i]))
+			return 1;
+	return 0;
+}
+
+/* Whether a label can be used alongside the previous ones */
+static int rrdUniqueLabel(const char *label, int index0)
+{
+	int j;
+
+	for (j = 0; j < index0; j++) {
+		if (!strcmp(rrdLabels[j], label))
+			return 0;
+		if (sensord_args.sampleTime &&
+		    (rrdIsAggregate(rrdLabels[j], label) ||
+		     rrdIsAggregate(label, rrdLabels[j])))
+			return 0;
+	}
+	return 1;
+}
+
 static void rrdCheckLabel(const char *rawLabel, int index0)
 {
 	char *buffer = rrdLabels[index0];
-	int i, j, okay;
+	int i, okay, max = RAW_LABEL_LENGTH;
+
+	/* Leave room for the suffixes of the aggregates */
+	if (sensord_args.sampleTime)
+		max = RRD_DS_NAME_MAX - RRD_SUFFIX_LENGTH;
 
 	i = 0;
 	/* contrain raw label to [A-Za-z0-9_] */
-	while ((i < RAW_LABEL_LENGTH) && rawLabel[i]) {
+	while ((i < max) && rawLabel[i]) {
 		char c = rawLabel[i];
 		if (((c >= 'A') && (c <= 'Z')) || ((c >= 'a') && (c <= 'z'))
 		    || ((c >= '0') && (c <= '9')) || (c == '_')) {
@@ -103,18 +237,14 @@ static void rrdCheckLabel(const char *rawLabel, int index0)
 	}
 	buffer[i] = '\0';
 
-	j = 0;
-	okay = (i > 0);
-
 	/* locate duplicates */
-	while (okay && (j < index0))
-		okay = strcmp(rrdLabels[j++], buffer);
+	okay = (i > 0) && rrdUniqueLabel(buffer, index0);
 
 	/* uniquify duplicate labels with _? or _?? */
 	while (!okay) {
 		if (!buffer[i]) {
-			if (i > RAW_LABEL_LENGTH - 3)
-				i = RAW_LABEL_LENGTH - 3;
+			if (i > max - 3)
+				i = max - 3;
 			buffer[i] = '_';
 			buffer[i + 1] = '0';
 			buffer[i + 2] = '\0';
@@ -130,10 +260,7 @@ static void rrdCheckLabel(const char *rawLabel, int index0)
 				buffer[i + 2] = '0';
 			}
 		}
-		j = 0;
-		okay = 1;
-		while (okay && (j < index0))
-			okay = strcmp(rrdLabels[j ++], buffer);
+		okay = rrdUniqueLabel(buffer, index0);
 	}
 }
 
@@ -147,22 +274,19 @@ static int _applyToFeatures(FeatureFN fn, void *data,
 	const FeatureDescriptor *features = desc->features;
 	const FeatureDescriptor *feature;
 	const char *rawLabel;
-	char *label;
 
 	for (i = 0; labelOffset + i < MAX_RRD_SENSORS && features[i].format; ++i) {
 		feature = features + i;
 		rawLabel = feature->feature->name;
 
-		label = sensors_get_label(chip, feature->feature);
-		if (!label) {
+		if (!feature->label) {
 			sensorLog(LOG_ERR, "Error getting sensor label: %s/%s",
 				  chip->prefix, rawLabel);
 			return -1;
 		}
 
 		rrdCheckLabel(rawLabel, labelOffset + i);
-		fn(data, rrdLabels[labelOffset + i], label, feature);
-		free(label);
+		fn(data, rrdLabels[labelOffset + i], feature->label, feature);
 	}
 	return i;
 }
@@ -220,7 +344,7 @@ static void rrdGetSensors_DS(void *_data, const char *rawLabel,
 	(void) label; /* no warning */
 	if (!feature || feature->rrd) {
 		struct ds *data = _data;
-		char *ptr = rrdBuff + data->num * RRD_BUFF;
+		char *ptr = rrdDefs[data->num];
 		const char *min, *max;
 		data->argv[data->num ++] = ptr;
 
@@ -247,8 +371,22 @@ static void rrdGetSensors_DS(void *_data, const char *rawLabel,
 		 * number of seconds downtime during which average be used
 		 * instead of unknown
 		 */
-		sprintf(ptr, "DS:%s:GAUGE:%d:%s:%s", rawLabel, 5 *
-			sensord_args.rrdTime, min, max);
+		snprintf(ptr, RRD_BUFF, "DS:%s:GAUGE:%d:%s:%s", rawLabel, 5 *
+			 sensord_args.rrdTime / 1000, min, max);
+
+		/* The value is then the mean of the window, see rrdWindow() */
+		if (feature && sensord_args.sampleTime) {
+			int i;
+
+			for (i = 0; i < AGG_RRD_VALUES - 1; i++) {
+				ptr = rrdDefs[data->num];
+				data->argv[data->num ++] = ptr;
+				snprintf(ptr, RRD_BUFF, "DS:%s%s:GAUGE:%d:%s:%s",
+					 rawLabel, rrdSuffixes[i],
+					 5 * sensord_args.rrdTime / 1000,
+					 min, max);
+			}
+		}
 	}
 }
 
@@ -262,18 +400,148 @@ static int rrdGetSensors(const char **argv)
 	return ret ? -1 : data.num;
 }
 
+/*
+ * The chips and features of the RRD data sources, in order, as set up by
+ * rrdInit(). The layout of the file can't change afterwards, so the
+ * updates follow this list rather than the chips known at the time: chips
+ * which went away, or whose features changed, are written as unknown, and
+ * chips which appeared are left out.
+ */
+typedef struct {
+	char *fullName;
+	char *features;		/* names of the RRD features, comma separated */
+	int values;
+	int known;		/* index in knownChips, -1 if not there */
+} RRDChip;
+
+static RRDChip *rrdLayout;
+static int rrdLayoutCount;
+/* The knownChipsGeneration the known chips of rrdLayout were found for */
+static unsigned int rrdLayoutGeneration;
+
+/* Returns the names of the features of a chip which go to the RRD file,
+   or NULL if out of memory */
+static char *rrdChipFeatures(const ChipDescriptor *desc, int *values)
+{
+	const FeatureDescriptor *feature;
+	size_t len = 1;
+	char *features;
+
+	for (feature = desc->features; feature->format; feature++)
+		if (feature->rrd)
+			len += strlen(feature->feature->name) + 1;
+	features = malloc(len);
+	if (!features)
+		return NULL;
+
+	*features = '\0';
+	*values = 0;
+	for (feature = desc->features; feature->format; feature++) {
+		if (!feature->rrd)
+			continue;
+		if (*values)
+			strcat(features, ",");
+		strcat(features, feature->feature->name);
+		*values += sensord_args.sampleTime ? AGG_RRD_VALUES : 1;
+	}
+	return features;
+}
+
+static int rrdFreezeLayout(void)
+{
+	const sensors_chip_name *chip, *chip_arg;
+	const ChipDescriptor *desc;
+	RRDChip *layout;
+	int i, i_detected;
+
+	for (i = 0; i < sensord_args.numChipNames; i++) {
+		chip_arg = &sensord_args.chipNames[i];
+		i_detected = 0;
+		while ((chip = sensors_get_detected_chips(chip_arg,
+							  &i_detected))) {
+			desc = lookup_known_chips(chip);
+			if (!desc)
+				continue;
+
+			layout = realloc(rrdLayout, (rrdLayoutCount + 1) *
+					 sizeof(RRDChip));
+			if (!layout)
+				return -1;
+			rrdLayout = layout;
+			layout += rrdLayoutCount;
+			layout->fullName = strdup(desc->fullName);
+			layout->features = rrdChipFeatures(desc,
+							   &layout->values);
+			if (!layout->fullName || !layout->features) {
+				free(layout->fullName);
+				free(layout->features);
+				return -1;
+			}
+			rrdLayoutCount++;
+		}
+	}
+	rrdLayoutGeneration = knownChipsGeneration - 1;
+	return 0;
+}
+
+/* Find the known chips of the layout again, once the known chips changed.
+   Returns 0 on success, -1 if out of memory, to be tried again. */
+static int rrdFindLayoutChips(void)
+{
+	char *features;
+	int i, index0, count, ret = 0;
+
+	for (i = 0; i < rrdLayoutCount; i++) {
+		rrdLayout[i].known = -1;
+		for (index0 = 0; knownChips[index0].features; index0++) {
+			if (strcmp(knownChips[index0].fullName,
+				   rrdLayout[i].fullName))
+				continue;
+			features = rrdChipFeatures(&knownChips[index0], &count);
+			if (!features) {
+				ret = -1;
+				break;
+			}
+			if (!strcmp(features, rrdLayout[i].features))
+				rrdLayout[i].known = index0;
+			free(features);
+			break;
+		}
+	}
+	if (!ret)
+		rrdLayoutGeneration = knownChipsGeneration;
+	return ret;
+}
+
+int rrdLayoutChip(int i, ChipDescriptor **desc, int *values)
+{
+	if (i >= rrdLayoutCount)
+		return -1;
+	*values = rrdLayout[i].values;
+
+	if (rrdLayoutGeneration != knownChipsGeneration &&
+	    rrdFindLayoutChips())
+		sensorLog(LOG_ERR, "Out of memory finding the RRD chips");
+	if (rrdLayout[i].known < 0)
+		return 0;
+	*desc = &knownChips[rrdLayout[i].known];
+	return 1;
+}
+
 int rrdInit(void)
 {
 	int ret;
 	struct stat sb;
 	char stepBuff[STEP_BUFF], rraBuff[RRA_BUFF];
 	int argc = 4, num;
-	const char *argv[6 + MAX_RRD_SENSORS] = {
+	const char *argv[6 + AGG_RRD_VALUES * MAX_RRD_SENSORS] = {
 		"sensord", sensord_args.rrdFile, "-s", stepBuff
 	};
 
 	sensorLog(LOG_DEBUG, "sensor RRD init");
 
+	num = rrdGetSensors(argv + argc);
+
 	/* Create RRD if it does not exist. */
 	if (stat(sensord_args.rrdFile, &sb)) {
 		if (errno != ENOENT) {
@@ -283,17 +551,16 @@ int rrdInit(void)
 		}
 		sensorLog(LOG_INFO, "Creating round robin database");
 
-		num = rrdGetSensors(argv + argc);
 		if (num < 1) {
 			sensorLog(LOG_ERR, "Error creating RRD: %s: %s",
 				  sensord_args.rrdFile, "No sensors detected");
 			return -1;
 		}
 
-		sprintf(stepBuff, "%d", sensord_args.rrdTime);
+		sprintf(stepBuff, "%d", sensord_args.rrdTime / 1000);
 		sprintf(rraBuff, "RRA:%s:%f:%d:%d",
 			sensord_args.rrdNoAverage ? "LAST" :"AVERAGE",
-			0.5, 1, 7 * 24 * 60 * 60 / sensord_args.rrdTime);
+			0.5, 1, 7 * 24 * 60 * 60 * 1000 / sensord_args.rrdTime);
 
 		argc += num;
 		argv[argc++] = rraBuff;
@@ -307,6 +574,13 @@ int rrdInit(void)
 		}
 	}
 
+	/* Room for the timestamp and all the data sources */
+	if ((num > 0 && rrdSampleReserve(num + 1)) || rrdFreezeLayout()) {
+		sensorLog(LOG_ERR, "Error initializing RRD: %s",
+			  "Out of memory");
+		return -1;
+	}
+
 	sensorLog(LOG_DEBUG, "sensor RRD initialized");
 	return 0;
 }
@@ -427,6 +701,162 @@ static struct gr graphs[] = {
 	}
 };
 
+/*
+ * The updates are written to the RRD file, or sent to rrdcached, by a
+ * writer thread, so that slow storage doesn't delay the sampling. They
+ * are written rrdBatch at a time, and on exit.
+ */
+#define RRD_QUEUE_MAX (4 * MAX_RRD_BATCH)
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;	/* a batch is ready, or the thread must quit */
+	pthread_t thread;
+	int started;
+	int quit;
+	char *pending[RRD_QUEUE_MAX];
+	int count;
+} rrdWriter = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.ready = PTHREAD_COND_INITIALIZER,
+};
+
+static void rrdWrite(char **values, int count)
+{
+	const char **argv;
+	int ret;
+
+	if (sensord_args.rrdDaemon) {
+		if (!rrdc_is_connected(sensord_args.rrdDaemon) &&
+		    rrdc_connect(sensord_args.rrdDaemon)) {
+			sensorLog(LOG_ERR,
+				  "Error connecting to rrdcached: %s: %s",
+				  sensord_args.rrdDaemon, rrd_get_error());
+			rrd_clear_error();
+			return;
+		}
+		ret = rrdc_update(sensord_args.rrdFile, count,
+				  (const char * const *) values);
+		if (ret) {
+			sensorLog(LOG_ERR, "Error updating RRD file: %s: %s",
+				  sensord_args.rrdFile, rrd_get_error());
+			rrd_clear_error();
+			/* Reconnect next time */
+			rrdc_disconnect();
+		}
+		return;
+	}
+
+	argv = malloc((count + 3) * sizeof(char *));
+	if (!argv) {
+		sensorLog(LOG_ERR, "Error updating RRD file: %s: %s",
+			  sensord_args.rrdFile, "Out of memory");
+		return;
+	}
+	argv[0] = "sensord";
+	argv[1] = sensord_args.rrdFile;
+	memcpy(argv + 2, values, count * sizeof(char *));
+	argv[count + 2] = NULL;
+
+	if ((ret = rrd_update(count + 2, (char **) /* WEAK */ argv))) {
+		sensorLog(LOG_ERR, "Error updating RRD file: %s: %s",
+			  sensord_args.rrdFile, rrd_get_error());
+		rrd_clear_error();
+	}
+	free(argv);
+}
+
+static void *rrdWriterThread(void *arg)
+{
+	char *values[RRD_QUEUE_MAX];
+	int i, count;
+
+	(void) arg;
+	pthread_mutex_lock(&rrdWriter.lock);
+	for (;;) {
+		while (!rrdWriter.quit &&
+		       rrdWriter.count < sensord_args.rrdBatch)
+			pthread_cond_wait(&rrdWriter.ready, &rrdWriter.lock);
+		if (!rrdWriter.count)
+			break;
+
+		count = rrdWriter.count;
+		memcpy(values, rrdWriter.pending, count * sizeof(char *));
+		rrdWriter.count = 0;
+		pthread_mutex_unlock(&rrdWriter.lock);
+
+		rrdWrite(values, count);
+		for (i = 0; i < count; i++)
+			free(values[i]);
+		sensorLog(LOG_DEBUG, "%d rrd updates written", count);
+
+		pthread_mutex_lock(&rrdWriter.lock);
+	}
+	pthread_mutex_unlock(&rrdWriter.lock);
+
+	return NULL;
+}
+
+/* Start the writer thread, returns 0 on success */
+int rrdStart(void)
+{
+	if (pthread_create(&rrdWriter.thread, NULL, rrdWriterThread, NULL)) {
+		sensorLog(LOG_ERR, "Error starting RRD writer thread");
+		return -1;
+	}
+	rrdWriter.started = 1;
+
+	return 0;
+}
+
+/* Write the pending updates and stop the writer thread */
+void rrdStop(void)
+{
+	if (!rrdWriter.started)
+		return;
+
+	pthread_mutex_lock(&rrdWriter.lock);
+	rrdWriter.quit = 1;
+	pthread_cond_signal(&rrdWriter.ready);
+	pthread_mutex_unlock(&rrdWriter.lock);
+	pthread_join(rrdWriter.thread, NULL);
+
+	rrdWriter.started = 0;
+	rrdWriter.quit = 0;
+}
+
+/* Queue the update built, returns 0 on success */
+static int rrdQueue(void)
+{
+	char *value;
+
+	value = malloc(rrdSample.len + 1);
+	if (!value) {
+		sensorLog(LOG_ERR, "Error updating RRD file: %s: %s",
+			  sensord_args.rrdFile, "Out of memory");
+		return 3;
+	}
+	memcpy(value, rrdSample.data, rrdSample.len);
+	value[rrdSample.len] = '\0';
+
+	pthread_mutex_lock(&rrdWriter.lock);
+	if (rrdWriter.count == RRD_QUEUE_MAX) {
+		/* Storage can't keep up, drop the oldest update */
+		free(rrdWriter.pending[0]);
+		memmove(rrdWriter.pending, rrdWriter.pending + 1,
+			(RRD_QUEUE_MAX - 1) * sizeof(char *));
+		rrdWriter.count--;
+		sensorLog(LOG_WARNING, "RRD updates are lagging, "
+			  "dropping the oldest one");
+	}
+	rrdWriter.pending[rrdWriter.count++] = value;
+	if (rrdWriter.count >= sensord_args.rrdBatch)
+		pthread_cond_signal(&rrdWriter.ready);
+	pthread_mutex_unlock(&rrdWriter.lock);
+
+	return 0;
+}
+
 int rrdUpdate(void)
 {
 	int ret = rrdChips ();
@@ -445,20 +875,21 @@ int rrdUpdate(void)
 					  "Error reading load average");
 				ret = 2;
 			} else {
-				sprintf(rrdBuff + strlen(rrdBuff), ":%f",
-					value);
+				rrdSampleValue(value, 2);
 			}
 			fclose(loadavg);
 		}
 	}
-	if (!ret) {
-		const char *argv[] = {
-			"sensord", sensord_args.rrdFile, rrdBuff, NULL
-		};
-		if ((ret = rrd_update(3, (char **) /* WEAK */ argv))) {
-			sensorLog(LOG_ERR, "Error updating RRD file: %s: %s",
-				  sensord_args.rrdFile, rrd_get_error());
-		}
+	if (!ret && rrdSample.overflow) {
+		sensorLog(LOG_ERR, "Error updating RRD file: %s: %s",
+			  sensord_args.rrdFile, "Out of memory");
+		ret = 3;
+	}
+	if (!ret && rrdWriter.started) {
+		ret = rrdQueue();
+	} else if (!ret) {
+		rrdSample.data[rrdSample.len] = '\0';
+		rrdWrite(&rrdSample.data, 1);
 	}
 	sensorLog(LOG_DEBUG, "sensor rrd updated");
 
@@ -21,10 +21,14 @@
  * MA 02110-1301 USA.
  */
 
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <time.h>
 
 #include "args.h"
 #include "sensord.h"
@@ -34,6 +38,18 @@
 #define DO_SCAN 1
 #define DO_SET 2
 #define DO_RRD 3
+#define DO_SINK 4
+#define DO_SAMPLE 5
+
+/* Values read during the same cycle are shared between the tasks, 0 means
+   no cycle was started and values are not shared */
+static unsigned int cycle;
+
+void newCycle(void)
+{
+	if (!++cycle)
+		cycle = 1;
+}
 
 static const char *chipName(const sensors_chip_name *chip)
 {
@@ -43,11 +59,10 @@ static const char *chipName(const sensors_chip_name *chip)
 	return buffer;
 }
 
-static int idChip(const sensors_chip_name *chip)
+static int idChip(const sensors_chip_name *chip, const char *name)
 {
-	const char *name, *adapter;
+	const char *adapter;
 
-	name = chipName(chip);
 	if (!name) {
 		sensorLog(LOG_ERR, "Error getting chip name");
 		return -1;
@@ -64,65 +79,515 @@ static int idChip(const sensors_chip_name *chip)
 	return 0;
 }
 
-static int get_flag(const sensors_chip_name *chip, int num)
+/*
+ * Read the given subfeatures into the sample buffer of the chip, skipping
+ * those already read during this cycle. The not yet read ones are read all
+ * at once. numbers may be the pending array of the buffer itself.
+ */
+static int readSamples(const sensors_chip_name *chip, SampleBuffer *samples,
+		       const int *numbers, int count, unsigned int stamp)
+{
+	int i, n = 0, ret;
+
+	for (i = 0; i < count; i++) {
+		if (stamp && samples->cycles[numbers[i]] == stamp)
+			continue;
+		samples->pending[n++] = numbers[i];
+	}
+	if (!n)
+		return 0;
+
+	ret = sensors_get_values(chip, samples->pending, n,
+				 samples->pendingValues,
+				 samples->pendingErrors);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < n; i++) {
+		int num = samples->pending[i];
+
+		samples->values[num] = samples->pendingValues[i];
+		samples->errors[num] = samples->pendingErrors[i];
+		samples->cycles[num] = stamp;
+	}
+
+	return 0;
+}
+
+/* Read all the subfeatures an action will need at once */
+static void prefetchSamples(const sensors_chip_name *chip,
+			    ChipDescriptor *descriptor, int action,
+			    unsigned int stamp)
+{
+	SampleBuffer *samples = &descriptor->samples;
+	const FeatureDescriptor *feature;
+	int i, n = 0;
+
+	for (feature = descriptor->features; feature->format; feature++) {
+		if (action == DO_SAMPLE) {
+			if (feature->dataNumbers[0] >= 0)
+				samples->pending[n++] = feature->dataNumbers[0];
+			continue;
+		}
+		if (feature->alarmNumber >= 0)
+			samples->pending[n++] = feature->alarmNumber;
+		if (action == DO_SCAN)
+			continue;
+		for (i = 0; feature->dataNumbers[i] >= 0; i++)
+			samples->pending[n++] = feature->dataNumbers[i];
+		if (action == DO_READ && feature->beepNumber >= 0)
+			samples->pending[n++] = feature->beepNumber;
+	}
+
+	/* Errors are reported when the values are used */
+	readSamples(chip, samples, samples->pending, n, stamp);
+}
+
+/*
+ * Sampler threads, reading the chips in parallel ahead of the tasks, so
+ * that a slow chip doesn't delay the others. The tasks then process the
+ * chips in order from the values read, as if they had read them.
+ */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work;	/* jobs were queued, or the threads must quit */
+	pthread_cond_t done;	/* a job was completed */
+	pthread_t *threads;
+	int count;
+	ChipDescriptor **jobs;
+	int jobCount, jobMax;
+	int nextJob;		/* first job not taken by a thread yet */
+	int running;		/* jobs taken and not completed yet */
+	int quit;
+} samplers = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void *samplerThread(void *arg)
+{
+	ChipDescriptor *descriptor;
+
+	(void) arg;
+	pthread_mutex_lock(&samplers.lock);
+	for (;;) {
+		while (!samplers.quit && samplers.nextJob >= samplers.jobCount)
+			pthread_cond_wait(&samplers.work, &samplers.lock);
+		if (samplers.quit)
+			break;
+
+		descriptor = samplers.jobs[samplers.nextJob++];
+		samplers.running++;
+		pthread_mutex_unlock(&samplers.lock);
+
+		prefetchSamples(descriptor->name, descriptor,
+				descriptor->jobAction, descriptor->jobCycle);
+
+		pthread_mutex_lock(&samplers.lock);
+		descriptor->busy = 0;
+		samplers.running--;
+		pthread_cond_broadcast(&samplers.done);
+	}
+	pthread_mutex_unlock(&samplers.lock);
+
+	return NULL;
+}
+
+/* Start the sampler threads, returns 0 on success */
+int startSamplers(int count)
+{
+	pthread_condattr_t attr;
+
+	if (!count)
+		return 0;
+
+	samplers.threads = malloc(count * sizeof(pthread_t));
+	if (!samplers.threads)
+		return 1;
+
+	/* Timeouts are measured on the same clock as the task timers */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&samplers.done, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_cond_init(&samplers.work, NULL);
+
+	for (samplers.count = 0; samplers.count < count; samplers.count++) {
+		if (pthread_create(&samplers.threads[samplers.count], NULL,
+				   samplerThread, NULL))
+			break;
+	}
+	if (samplers.count < count) {
+		sensorLog(LOG_ERR, "Error starting sampler threads");
+		stopSamplers();
+		return 1;
+	}
+	sensorLog(LOG_DEBUG, "%d sampler threads started", count);
+
+	return 0;
+}
+
+/* Drop the jobs no thread has taken yet, the lock must be held */
+static void cancelJobs(void)
+{
+	int i;
+
+	for (i = samplers.nextJob; i < samplers.jobCount; i++)
+		samplers.jobs[i]->busy = 0;
+	samplers.jobCount = samplers.nextJob;
+}
+
+/* Wait until no chip is being read by a sampler thread, so that the
+   chip descriptors and libsensors can be changed */
+void waitSamplers(void)
+{
+	if (!samplers.count)
+		return;
+
+	pthread_mutex_lock(&samplers.lock);
+	cancelJobs();
+	while (samplers.running)
+		pthread_cond_wait(&samplers.done, &samplers.lock);
+	pthread_mutex_unlock(&samplers.lock);
+}
+
+void stopSamplers(void)
+{
+	int i;
+
+	if (!samplers.threads)
+		return;
+
+	waitSamplers();
+	pthread_mutex_lock(&samplers.lock);
+	samplers.quit = 1;
+	pthread_cond_broadcast(&samplers.work);
+	pthread_mutex_unlock(&samplers.lock);
+	for (i = 0; i < samplers.count; i++)
+		pthread_join(samplers.threads[i], NULL);
+
+	pthread_cond_destroy(&samplers.work);
+	pthread_cond_destroy(&samplers.done);
+	free(samplers.threads);
+	free(samplers.jobs);
+	samplers.threads = NULL;
+	samplers.jobs = NULL;
+	samplers.count = samplers.jobMax = 0;
+	samplers.jobCount = samplers.nextJob = 0;
+	samplers.quit = 0;
+}
+
+static int chipBusy(const ChipDescriptor *descriptor)
+{
+	int busy;
+
+	if (!samplers.count)
+		return 0;
+
+	pthread_mutex_lock(&samplers.lock);
+	busy = descriptor->busy;
+	pthread_mutex_unlock(&samplers.lock);
+
+	return busy;
+}
+
+static ChipDescriptor *lookupKnownChip(const sensors_chip_name *chip)
+{
+	int index0;
+
+	for (index0 = 0; knownChips[index0].features; ++index0) {
+		/*
+		 * Trick: we compare addresses here. We know it works
+		 * because both pointers were returned by
+		 * sensors_get_detected_chips(), so they refer to
+		 * libsensors internal structures, which do not move.
+		 */
+		if (knownChips[index0].name == chip)
+			return &knownChips[index0];
+	}
+
+	return NULL;
+}
+
+/*
+ * Have the sampler threads read the chips an action will process, and
+ * wait until they are done or the chip timeout expires. Chips still being
+ * read after that are skipped by the action, those not taken by any
+ * thread yet are read by the action itself.
+ */
+static void sampleChips(int action)
+{
+	const sensors_chip_name *chip, *chip_arg;
+	ChipDescriptor *descriptor, **jobs;
+	struct timespec deadline;
+	int i, j, ret = 0;
+
+	if (!samplers.count)
+		return;
+
+	for (i = 0; knownChips[i].features; i++)
+		;
+
+	pthread_mutex_lock(&samplers.lock);
+	if (i > samplers.jobMax) {
+		jobs = realloc(samplers.jobs, i * sizeof(ChipDescriptor *));
+		if (!jobs) {
+			pthread_mutex_unlock(&samplers.lock);
+			return;
+		}
+		samplers.jobs = jobs;
+		samplers.jobMax = i;
+	}
+
+	samplers.jobCount = samplers.nextJob = 0;
+	for (j = 0; j < sensord_args.numChipNames; j++) {
+		chip_arg = &sensord_args.chipNames[j];
+		i = 0;
+		while ((chip = sensors_get_detected_chips(chip_arg, &i))) {
+			descriptor = lookupKnownChip(chip);
+			/* Still being read since a previous cycle */
+			if (!descriptor || descriptor->busy)
+				continue;
+			descriptor->busy = 1;
+			descriptor->jobAction = action;
+			descriptor->jobCycle = cycle;
+			samplers.jobs[samplers.jobCount++] = descriptor;
+		}
+	}
+	pthread_cond_broadcast(&samplers.work);
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += sensord_args.chipTimeout / 1000;
+	deadline.tv_nsec += (sensord_args.chipTimeout % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	while (ret != ETIMEDOUT) {
+		for (i = 0; i < samplers.jobCount; i++)
+			if (samplers.jobs[i]->busy)
+				break;
+		if (i == samplers.jobCount)
+			break;
+
+		if (sensord_args.chipTimeout)
+			ret = pthread_cond_timedwait(&samplers.done,
+						     &samplers.lock,
+						     &deadline);
+		else
+			pthread_cond_wait(&samplers.done, &samplers.lock);
+	}
+	cancelJobs();
+	pthread_mutex_unlock(&samplers.lock);
+}
+
+static int get_flag(const sensors_chip_name *chip, SampleBuffer *samples,
+		    int num)
 {
-	double val;
 	int ret;
 
 	if (num == -1)
 		return 0;
 
-	ret = sensors_get_value(chip, num, &val);
+	ret = readSamples(chip, samples, &num, 1, cycle);
+	if (!ret)
+		ret = samples->errors[num];
 	if (ret) {
 		sensorLog(LOG_ERR, "Error getting sensor data: %s/#%d: %s",
 			  chip->prefix, num, sensors_strerror(ret));
 		return -1;
 	}
 
-	return (int) (val + 0.5);
+	return (int) (samples->values[num] + 0.5);
+}
+
+/*
+ * With --log-delta, the log and the line protocol only report the features
+ * which changed since they last reported them, and everything once per
+ * keyframe interval.
+ */
+static struct {
+	int started;
+	int keyframe;		/* report everything this time */
+	struct timespec last;	/* of the last keyframe */
+} reporting[REPORT_MAX];
+
+/* Start reporting the features to an output */
+void reportStart(int output)
+{
+	struct timespec now;
+	long long elapsed;
+
+	if (sensord_args.logDelta < 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - reporting[output].last.tv_sec) * 1000LL +
+		  (now.tv_nsec - reporting[output].last.tv_nsec) / 1000000;
+	reporting[output].keyframe = !reporting[output].started ||
+				     (sensord_args.keyframeTime &&
+				      elapsed >= sensord_args.keyframeTime);
+	if (reporting[output].keyframe) {
+		reporting[output].started = 1;
+		reporting[output].last = now;
+	}
+}
+
+/*
+ * Whether a feature must be reported to an output: one of its values moved
+ * by more than the delta since it was last reported, its input crossed one
+ * of its limits, or its alarm changed.
+ */
+int reportChanged(const ChipDescriptor *chip,
+		  const FeatureDescriptor *feature, const double values[],
+		  int alarm, int output)
+{
+	LastReport *last;
+	int i, count, changed;
+
+	if (sensord_args.logDelta < 0)
+		return 1;
+
+	last = &chip->reports[(feature - chip->features) * REPORT_MAX + output];
+	for (count = 0; feature->dataNumbers[count] >= 0; count++)
+		;
+
+	changed = reporting[output].keyframe || !last->valid ||
+		  alarm != last->alarm;
+	for (i = 0; i < count && !changed; i++)
+		changed = fabs(values[i] - last->values[i]) >
+			  sensord_args.logDelta / 100 * fabs(last->values[i]);
+	/* The other values are the limits of the input */
+	for (i = 1; i < count && !changed; i++)
+		changed = (values[0] > values[i]) !=
+			  (last->values[0] > last->values[i]);
+	if (!changed)
+		return 0;
+
+	for (i = 0; i < count; i++)
+		last->values[i] = values[i];
+	last->alarm = alarm;
+	last->valid = 1;
+	return 1;
+}
+
+/* Add the input of a feature to its windows. Errors are left for the other
+   tasks to report, so that they aren't reported at each sample. */
+static int sampleFeature(const sensors_chip_name *chip,
+			 ChipDescriptor *descriptor,
+			 const FeatureDescriptor *feature)
+{
+	SampleBuffer *samples = &descriptor->samples;
+	Aggregate *windows;
+	int i, num = feature->dataNumbers[0];
+
+	if (num < 0 || readSamples(chip, samples, &num, 1, cycle) ||
+	    samples->errors[num])
+		return 0;
+
+	windows = &descriptor->windows[(feature - descriptor->features) *
+				       AGG_MAX];
+	for (i = 0; i < AGG_MAX; i++)
+		aggregateAdd(&windows[i], samples->values[num]);
+	return 0;
+}
+
+/* Append the aggregates of a window to the RRD update, and start a new
+   window */
+static void rrdWindow(const FeatureDescriptor *feature, Aggregate *window)
+{
+	double value;
+	int i;
+
+	if (!window->count) {
+		for (i = 0; i < AGG_RRD_VALUES; i++)
+			rrdSampleUnknown();
+		return;
+	}
+
+	value = window->sum / window->count;
+	feature->rrd(&value);
+	feature->rrd(&window->min);
+	feature->rrd(&window->max);
+	value = aggregateQuantile(window, 1);
+	feature->rrd(&value);
+	aggregateReset(window);
 }
 
 static int do_features(const sensors_chip_name *chip,
-		       const FeatureDescriptor *feature, int action)
+		       ChipDescriptor *descriptor,
+		       const FeatureDescriptor *feature, int action,
+		       int *idPending)
 {
-	char *label;
+	SampleBuffer *samples = &descriptor->samples;
 	const char *formatted;
-	int i, alrm, beep, ret;
+	int i, count, alrm, beep, ret;
 	double val[MAX_DATA];
+	Aggregate *windows = NULL;
+
+	if (action == DO_SAMPLE)
+		return sampleFeature(chip, descriptor, feature);
+	if (descriptor->windows)
+		windows = &descriptor->windows[(feature - descriptor->features) *
+					       AGG_MAX];
 
 	/* If only scanning, take a quick exit if alarm is off */
-	alrm = get_flag(chip, feature->alarmNumber);
+	alrm = get_flag(chip, samples, feature->alarmNumber);
 	if (alrm == -1)
 		return -1;
 	if (action == DO_SCAN && !alrm)
 		return 0;
 
-	for (i = 0; feature->dataNumbers[i] >= 0; i++) {
-		ret = sensors_get_value(chip, feature->dataNumbers[i],
-					val + i);
-		if (ret) {
+	for (count = 0; feature->dataNumbers[count] >= 0; count++)
+		;
+	ret = readSamples(chip, samples, feature->dataNumbers, count, cycle);
+	if (ret < 0) {
+		sensorLog(LOG_ERR, "Error getting sensor data: %s: %s",
+			  chip->prefix, sensors_strerror(ret));
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		int num = feature->dataNumbers[i];
+
+		if (samples->errors[num]) {
 			sensorLog(LOG_ERR,
 				  "Error getting sensor data: %s/#%d: %s",
-				  chip->prefix, feature->dataNumbers[i],
-				  sensors_strerror(ret));
+				  chip->prefix, num,
+				  sensors_strerror(samples->errors[num]));
+			return -1;
+		}
+		val[i] = samples->values[num];
+	}
+
+	if (action == DO_SINK) {
+		if (!feature->label) {
+			sensorLog(LOG_ERR, "Error getting sensor label: %s/%s",
+				  chip->prefix, feature->feature->name);
 			return -1;
 		}
+		sinkAdd(descriptor, feature, val, alrm,
+			windows ? &windows[AGG_SINK] : NULL);
+		if (windows)
+			aggregateReset(&windows[AGG_SINK]);
+		return 0;
 	}
 
 	/* For RRD, we don't need anything else */
 	if (action == DO_RRD) {
-		if (feature->rrd) {
-			const char *rrded = feature->rrd(val);
-
-			sprintf(rrdBuff + strlen(rrdBuff), ":%s",
-				rrded ? rrded : "U");
-		}
+		if (feature->rrd && windows)
+			rrdWindow(feature, &windows[AGG_RRD]);
+		else if (feature->rrd)
+			feature->rrd(val);
 
 		return 0;
 	}
 
+	if (action == DO_READ &&
+	    !reportChanged(descriptor, feature, val, alrm, REPORT_LOG))
+		return 0;
+
 	/* For scanning and logging, we need extra information */
-	beep = get_flag(chip, feature->beepNumber);
+	beep = get_flag(chip, samples, feature->beepNumber);
 	if (beep == -1)
 		return -1;
 
@@ -132,41 +597,65 @@ static int do_features(const sensors_chip_name *chip,
 		return -1;
 	}
 
-	/* FIXME: It would be more efficient to store the label at
-	 * initialization time.
-	 */
-	label = sensors_get_label(chip, feature->feature);
-	if (!label) {
+	if (!feature->label) {
 		sensorLog(LOG_ERR, "Error getting sensor label: %s/%s",
 			  chip->prefix, feature->feature->name);
 		return -1;
 	}
 
-	if (action == DO_READ)
-		sensorLog(LOG_INFO, "  %s: %s", label, formatted);
-	else
+	if (action == DO_READ) {
+		/* Only name the chips which have something to log */
+		if (*idPending) {
+			*idPending = 0;
+			ret = idChip(chip, descriptor->fullName);
+			if (ret)
+				return ret;
+		}
+		sensorLog(LOG_INFO, "  %s: %s", feature->label, formatted);
+	} else
 		sensorLog(LOG_ALERT, "Sensor alarm: Chip %s: %s: %s",
-			  chipName(chip), label, formatted);
-
-	free(label);
+			  descriptor->fullName, feature->label, formatted);
 
 	return 0;
 }
 
 static int doKnownChip(const sensors_chip_name *chip,
-		       const ChipDescriptor *descriptor, int action)
+		       ChipDescriptor *descriptor, int action)
 {
 	const FeatureDescriptor *features = descriptor->features;
-	int i, ret = 0;
+	int i, j, ret = 0, idPending = 0;
+
+	if (chipBusy(descriptor)) {
+		/* Samples are just missed */
+		if (action == DO_SAMPLE)
+			return 0;
+		sensorLog(LOG_ERR, "Timeout reading chip: %s",
+			  descriptor->fullName);
+		/* Keep the layout of the RRD data */
+		if (action == DO_RRD)
+			for (i = 0; features[i].format; i++)
+				for (j = 0; features[i].rrd &&
+				     j < (descriptor->windows ?
+					  AGG_RRD_VALUES : 1); j++)
+					rrdSampleUnknown();
+		return 0;
+	}
 
 	if (action == DO_READ) {
-		ret = idChip(chip);
-		if (ret)
-			return ret;
+		if (sensord_args.logDelta >= 0) {
+			idPending = 1;
+		} else {
+			ret = idChip(chip, descriptor->fullName);
+			if (ret)
+				return ret;
+		}
 	}
 
+	prefetchSamples(chip, descriptor, action, cycle);
+
 	for (i = 0; features[i].format; i++) {
-		ret = do_features(chip, features + i, action);
+		ret = do_features(chip, descriptor, features + i, action,
+				  &idPending);
 		if (ret == -1)
 			break;
 	}
@@ -177,7 +666,7 @@ static int doKnownChip(const sensors_chip_name *chip,
 static int setChip(const sensors_chip_name *chip)
 {
 	int ret = 0;
-	if ((ret = idChip(chip))) {
+	if ((ret = idChip(chip, chipName(chip)))) {
 		sensorLog(LOG_ERR, "Error identifying chip: %s",
 			  chip->prefix);
 	} else if ((ret = sensors_do_chip_sets(chip))) {
@@ -196,24 +685,10 @@ static int doChip(const sensors_chip_name *chip, int action)
 	if (action == DO_SET) {
 		ret = setChip(chip);
 	} else {
-		int index0, chipindex = -1;
-		for (index0 = 0; knownChips[index0].features; ++index0) {
-			/*
-			 * Trick: we compare addresses here. We know it works
-			 * because both pointers were returned by
-			 * sensors_get_detected_chips(), so they refer to
-			 * libsensors internal structures, which do not move.
-			 */
-			if (knownChips[index0].name == chip) {
-				chipindex = index0;
-				break;
-			}
-		}
+		ChipDescriptor *descriptor = lookupKnownChip(chip);
 
-		if (chipindex >= 0) {
-			ret = doKnownChip(chip, &knownChips[chipindex],
-					  action);
-		}
+		if (descriptor)
+			ret = doKnownChip(chip, descriptor, action);
 	}
 	return ret;
 }
@@ -223,6 +698,9 @@ static int doChips(int action)
 	const sensors_chip_name *chip, *chip_arg;
 	int i, j, ret = 0;
 
+	if (action != DO_SET)
+		sampleChips(action);
+
 	for (j = 0; j < sensord_args.numChipNames; j++) {
 		chip_arg = &sensord_args.chipNames[j];
 		i = 0;
@@ -240,6 +718,7 @@ int readChips(void)
 	int ret = 0;
 
 	sensorLog(LOG_DEBUG, "sensor read started");
+	reportStart(REPORT_LOG);
 	ret = doChips(DO_READ);
 	sensorLog(LOG_DEBUG, "sensor read finished");
 
@@ -270,15 +749,50 @@ int setChips(void)
 
 /* TODO: loadavg entry */
 
+/* The chips are taken in the order of the RRD data sources, which don't
+   change when chips come and go */
 int rrdChips(void)
 {
-	int ret = 0;
+	ChipDescriptor *descriptor;
+	int i, found, count, ret = 0;
 
-	strcpy(rrdBuff, "N");
+	rrdSampleStart();
 
 	sensorLog(LOG_DEBUG, "sensor rrd started");
-	ret = doChips(DO_RRD);
+	sampleChips(DO_RRD);
+	for (i = 0; (found = rrdLayoutChip(i, &descriptor, &count)) >= 0;
+	     i++) {
+		if (!found) {
+			while (count--)
+				rrdSampleUnknown();
+			continue;
+		}
+		ret = doKnownChip(descriptor->name, descriptor, DO_RRD);
+		if (ret)
+			break;
+	}
 	sensorLog(LOG_DEBUG, "sensor rrd finished");
 
 	return ret;
 }
+
+int sinkChips(void)
+{
+	int ret = 0;
+
+	sinkStart();
+
+	sensorLog(LOG_DEBUG, "sensor sink update started");
+	ret = doChips(DO_SINK);
+	sensorLog(LOG_DEBUG, "sensor sink update finished");
+
+	sinkEnd();
+
+	return ret;
+}
+
+/* Not logged, this is meant to run often */
+int aggregateChips(void)
+{
+	return doChips(DO_SAMPLE);
+}
@@ -24,14 +24,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
-#include <limits.h>
 #include <string.h>
 #include <signal.h>
 #include <syslog.h>
 #include <unistd.h>
 #include <time.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
 #include "args.h"
 #include "sensord.h"
@@ -45,9 +48,10 @@ static volatile sig_atomic_t reload = 0;
 
 #include <stdarg.h>
 
+/* Called from several threads */
 void sensorLog(int priority, const char *fmt, ...)
 {
-	static char buffer[1 + LOG_BUFFER];
+	char buffer[1 + LOG_BUFFER];
 	va_list ap;
 	va_start(ap, fmt);
 	vsnprintf(buffer, LOG_BUFFER, fmt, ap);
@@ -75,66 +79,280 @@ static void signalHandler(int sig)
 	}
 }
 
-static int sensord(void)
+/* Periodic tasks, in the order they run when due at the same time */
+/* Samples are aggregated first, so that the other tasks get them */
+enum { TASK_SAMPLE, TASK_SCAN, TASK_LOG, TASK_RRD, TASK_SINK, TASK_MAX };
+
+/* Arm a timer to expire after first milliseconds, then every interval
+   milliseconds (once only if interval is 0) */
+static int armTimer(int fd, long first, long interval)
+{
+	struct itimerspec its;
+
+	its.it_value.tv_sec = first / 1000;
+	its.it_value.tv_nsec = (first % 1000) * 1000000;
+	if (!first)
+		its.it_value.tv_nsec = 1;	/* 0 would disarm it */
+	its.it_interval.tv_sec = interval / 1000;
+	its.it_interval.tv_nsec = (interval % 1000) * 1000000;
+
+	return timerfd_settime(fd, 0, &its, NULL);
+}
+
+/*
+ * The amount of time to wait until the next RRD update is computed using
+ * the same method as in RRD instead of simply adding the interval, so that
+ * the updates are aligned with the RRD timeslots.
+ */
+static long rrdDelay(void)
+{
+	struct timespec now;
+	long long ms;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+	return sensord_args.rrdTime - ms % sensord_args.rrdTime;
+}
+
+static int watchFd(int epfd, int fd)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void handleSignals(int fd)
+{
+	struct signalfd_siginfo si;
+
+	while (read(fd, &si, sizeof(si)) == sizeof(si))
+		signalHandler(si.ssi_signo);
+}
+
+static int runTask(int task)
 {
 	int ret = 0;
-	int scanValue = 0, logValue = 0;
-	/*
-	 * First RRD update at next RRD timeslot to prevent failures due
-	 * one timeslot updated twice on restart for example.
-	 */
-	int rrdValue = sensord_args.rrdTime - time(NULL) %
-		sensord_args.rrdTime;
+
+	switch (task) {
+	case TASK_SAMPLE:
+		/* Errors are reported by the other tasks */
+		ret = aggregateChips();
+		break;
+	case TASK_SCAN:
+		if ((ret = scanChips()))
+			sensorLog(LOG_NOTICE, "sensor scan error (%d)", ret);
+		break;
+	case TASK_LOG:
+		if ((ret = readChips()))
+			sensorLog(LOG_NOTICE, "sensor read error (%d)", ret);
+		break;
+	case TASK_RRD:
+		if ((ret = rrdUpdate()))
+			sensorLog(LOG_NOTICE, "rrd update error (%d)", ret);
+		break;
+	case TASK_SINK:
+		if ((ret = sinkChips()))
+			sensorLog(LOG_NOTICE, "sensor sink error (%d)", ret);
+		break;
+	}
+	return ret;
+}
+
+static int sensord(void)
+{
+	int ret = 0, epfd, sigfd, hotplugFd = -1, sinkFd = -1, alarmFd = -1;
+	int i, n;
+	int timers[TASK_MAX], due[TASK_MAX], enabled[TASK_MAX];
+	long first[TASK_MAX], interval[TASK_MAX];
+	struct epoll_event events[TASK_MAX + 4];
+	uint64_t expirations;
+	sigset_t mask;
 
 	sensorLog(LOG_INFO, "sensord started");
 
+	/* Signals are received through a file descriptor from now on */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGHUP);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	for (i = 0; i < TASK_MAX; i++)
+		timers[i] = -1;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	sigfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (epfd < 0 || sigfd < 0 || watchFd(epfd, sigfd)) {
+		sensorLog(LOG_ERR, "Error setting up main loop: %s",
+			  strerror(errno));
+		ret = 1;
+		goto exit_close;
+	}
+
+	hotplugFd = openHotplug();
+	if (hotplugFd >= 0 && watchFd(epfd, hotplugFd)) {
+		close(hotplugFd);
+		hotplugFd = -1;
+	}
+
+	/* The threads inherit the signal mask */
+	if (startSamplers(sensord_args.threads)) {
+		ret = 1;
+		goto exit_close;
+	}
+
+	/* Scanning and logging start right away, RRD updates at the next
+	   RRD timeslot to prevent failures due to one timeslot updated
+	   twice on restart for example. RRD updates are rescheduled each
+	   time, see rrdDelay(). */
+	enabled[TASK_SAMPLE] = sensord_args.sampleTime != 0;
+	enabled[TASK_SCAN] = sensord_args.scanTime != 0;
+	enabled[TASK_LOG] = sensord_args.logTime != 0;
+	enabled[TASK_RRD] = sensord_args.rrdTime && sensord_args.rrdFile;
+	enabled[TASK_SINK] = sensord_args.sinkTime &&
+			     (sensord_args.metricsAddress ||
+			      sensord_args.lineAddress ||
+			      sensord_args.shmFile);
+	first[TASK_SAMPLE] = first[TASK_SCAN] = first[TASK_LOG] = 0;
+	first[TASK_SINK] = 0;
+	first[TASK_RRD] = enabled[TASK_RRD] ? rrdDelay() : 0;
+	interval[TASK_SAMPLE] = sensord_args.sampleTime;
+	interval[TASK_SCAN] = sensord_args.scanTime;
+	interval[TASK_LOG] = sensord_args.logTime;
+	interval[TASK_RRD] = 0;
+	interval[TASK_SINK] = sensord_args.sinkTime;
+
+	if (enabled[TASK_SINK]) {
+		if (sinkInit()) {
+			ret = 1;
+			goto exit_close;
+		}
+		sinkFd = sinkListenFd();
+		if (sinkFd >= 0 && watchFd(epfd, sinkFd)) {
+			sensorLog(LOG_ERR, "Error watching metrics socket: %s",
+				  strerror(errno));
+			ret = 1;
+			goto exit_close;
+		}
+	}
+
+	/* Alarms the drivers notify are scanned for right away, the others
+	   at the next scan */
+	if (enabled[TASK_SCAN]) {
+		alarmFd = openAlarms();
+		if (alarmFd >= 0 && watchFd(epfd, alarmFd)) {
+			closeAlarms();
+			alarmFd = -1;
+		}
+	}
+
+	if (enabled[TASK_RRD] && rrdStart()) {
+		ret = 1;
+		goto exit_close;
+	}
+
+	for (i = 0; i < TASK_MAX; i++) {
+		if (!enabled[i])
+			continue;
+		timers[i] = timerfd_create(CLOCK_MONOTONIC,
+					   TFD_CLOEXEC | TFD_NONBLOCK);
+		if (timers[i] < 0 || armTimer(timers[i], first[i], interval[i])
+		    || watchFd(epfd, timers[i])) {
+			sensorLog(LOG_ERR, "Error setting up timer: %s",
+				  strerror(errno));
+			ret = 1;
+			goto exit_close;
+		}
+	}
+
 	while (!done) {
 		if (reload) {
+			waitSamplers();
 			ret = reloadLib(sensord_args.cfgFile);
 			if (ret)
 				sensorLog(LOG_NOTICE, "configuration reload"
 					  " error");
+			refreshAlarms();
 			reload = 0;
+			continue;
 		}
-		if (sensord_args.scanTime && (scanValue <= 0)) {
-			if ((ret = scanChips()))
-				sensorLog(LOG_NOTICE,
-					  "sensor scan error (%d)", ret);
-			scanValue += sensord_args.scanTime;
-		}
-		if (sensord_args.logTime && (logValue <= 0)) {
-			if ((ret = readChips()))
-				sensorLog(LOG_NOTICE,
-					  "sensor read error (%d)", ret);
-			logValue += sensord_args.logTime;
-		}
-		if (sensord_args.rrdTime && sensord_args.rrdFile &&
-		    (rrdValue <= 0)) {
-			if ((ret = rrdUpdate()))
-				sensorLog(LOG_NOTICE,
-					  "rrd update error (%d)", ret);
-			/*
-			 * The amount of time to wait is computed using the
-			 * same method as in RRD instead of simply adding the
-			 * interval.
-			 */
-			rrdValue = sensord_args.rrdTime - time(NULL) %
-				sensord_args.rrdTime;
+
+		n = epoll_wait(epfd, events, ARRAY_SIZE(events), -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			sensorLog(LOG_ERR, "Error waiting for events: %s",
+				  strerror(errno));
+			ret = 1;
+			break;
 		}
-		if (!done) {
-			int a = sensord_args.logTime ? logValue : INT_MAX;
-			int b = sensord_args.scanTime ? scanValue : INT_MAX;
-			int c = (sensord_args.rrdTime && sensord_args.rrdFile)
-				? rrdValue : INT_MAX;
-			int sleepTime = (a < b) ? ((a < c) ? a : c) :
-				((b < c) ? b : c);
-			sleep(sleepTime);
-			scanValue -= sleepTime;
-			logValue -= sleepTime;
-			rrdValue -= sleepTime;
+
+		memset(due, 0, sizeof(due));
+		for (i = 0; i < n; i++) {
+			int fd = events[i].data.fd, task;
+
+			if (fd == sigfd) {
+				handleSignals(fd);
+				continue;
+			}
+			if (fd == sinkFd) {
+				sinkAccept();
+				continue;
+			}
+			if (fd == hotplugFd) {
+				waitSamplers();
+				handleHotplug(fd);
+				refreshAlarms();
+				continue;
+			}
+			if (fd == alarmFd) {
+				if (handleAlarms())
+					due[TASK_SCAN] = 1;
+				continue;
+			}
+			for (task = 0; task < TASK_MAX; task++)
+				if (fd == timers[task])
+					break;
+			/* Missed expirations are not caught up on */
+			if (task == TASK_MAX ||
+			    read(fd, &expirations, sizeof(expirations)) !=
+			    sizeof(expirations))
+				continue;
+			due[task] = 1;
+			/* Rescheduled right away, even if a pending signal
+			   prevents the update from running in this batch */
+			if (task == TASK_RRD)
+				armTimer(fd, rrdDelay(), 0);
 		}
+
+		/* Pending signals take precedence over the tasks */
+		if (done || reload)
+			continue;
+
+		/* Tasks due at the same time share the values they read */
+		newCycle();
+		for (i = 0; i < TASK_MAX; i++)
+			if (due[i])
+				ret = runTask(i);
 	}
 
+exit_close:
+	stopSamplers();
+	rrdStop();
+	sinkClose();
+	closeAlarms();
+	for (i = 0; i < TASK_MAX; i++)
+		if (timers[i] >= 0)
+			close(timers[i]);
+	if (hotplugFd >= 0)
+		close(hotplugFd);
+	if (sigfd >= 0)
+		close(sigfd);
+	if (epfd >= 0)
+		close(epfd);
+	sigprocmask(SIG_UNBLOCK, &mask, NULL);
 	sensorLog(LOG_INFO, "sensord stopped");
 
 	return ret;
@@ -38,6 +38,12 @@ extern void freeChips(void);
 extern int loadLib(const char *cfgPath);
 extern int reloadLib(const char *cfgPath);
 extern int unloadLib(void);
+extern int openHotplug(void);
+extern void handleHotplug(int fd);
+extern int openAlarms(void);
+extern int handleAlarms(void);
+extern void refreshAlarms(void);
+extern void closeAlarms(void);
 
 /* from sense.c */
 
@@ -45,11 +51,21 @@ extern int readChips(void);
 extern int scanChips(void);
 extern int setChips(void);
 extern int rrdChips(void);
+extern int sinkChips(void);
+extern int aggregateChips(void);
+extern void newCycle(void);
+extern int startSamplers(int count);
+extern void waitSamplers(void);
+extern void stopSamplers(void);
 
 /* from rrd.c */
 
-extern char rrdBuff[];
+extern void rrdSampleStart(void);
+extern void rrdSampleValue(double value, int decimals);
+extern void rrdSampleUnknown(void);
 extern int rrdInit(void);
+extern int rrdStart(void);
+extern void rrdStop(void);
 extern int rrdUpdate(void);
 extern int rrdCGI(void);
 
@@ -60,7 +76,8 @@ extern int rrdCGI(void);
 typedef const char *(*FormatterFN) (const double values[], int alrm,
 				     int beep);
 
-typedef const char *(*RRDFN) (const double values[]);
+/* Appends the value to the RRD update */
+typedef void (*RRDFN) (const double values[]);
 
 typedef enum {
 	DataType_voltage = 0,
@@ -76,14 +93,113 @@ typedef struct {
 	int alarmNumber;
 	int beepNumber;
 	const sensors_feature *feature;
+	char *label;		/* resolved at initialization time */
 	int dataNumbers[MAX_DATA + 1];
 } FeatureDescriptor;
 
+/*
+ * The values read during the current cycle, indexed by subfeature number,
+ * so that each subfeature is read at most once per cycle, whatever the
+ * number of tasks running.
+ */
+typedef struct {
+	int count;
+	double *values;
+	int *errors;
+	unsigned int *cycles;	/* cycle of each value, 0 if never read */
+	int *pending;		/* subfeatures to read, one per reference */
+	double *pendingValues;
+	int *pendingErrors;
+} SampleBuffer;
+
+/*
+ * Aggregates of the samples of a feature during a window, with
+ * --sample-interval. Each output consuming them has its own window.
+ */
+#define AGG_RRD 0
+#define AGG_SINK 1
+#define AGG_MAX 2
+
+#define AGG_QUANTILES 3		/* see aggregateQuantiles */
+#define AGG_RRD_VALUES 4	/* mean, minimum, maximum, 95th percentile */
+
+typedef struct {
+	double heights[5];
+	double positions[5];
+	double desired[5];
+} Quantile;
+
+typedef struct {
+	unsigned int count;
+	double min;
+	double max;
+	double sum;
+	double last;
+	Quantile quantiles[AGG_QUANTILES];
+} Aggregate;
+
+/*
+ * The values last reported by a change-triggered output, for a feature,
+ * see --log-delta.
+ */
+#define REPORT_LOG 0
+#define REPORT_LINE 1
+#define REPORT_MAX 2
+
+typedef struct {
+	double values[MAX_DATA];
+	int alarm;
+	int valid;
+} LastReport;
+
 typedef struct {
 	const sensors_chip_name *name;
+	char *fullName;		/* as printed by sensors_snprintf_chip_name */
 	FeatureDescriptor *features;
+	SampleBuffer samples;
+	LastReport *reports;	/* REPORT_MAX per feature */
+	Aggregate *windows;	/* AGG_MAX per feature, or NULL */
+	/* Protected by the lock of the sampler threads */
+	int busy;		/* queued or being read by a sampler thread */
+	int jobAction;
+	unsigned int jobCycle;
 } ChipDescriptor;
 
 extern ChipDescriptor * knownChips;
+extern unsigned int knownChipsGeneration;
 extern int initKnownChips(void);
 extern void freeKnownChips(void);
+extern int addKnownChip(const sensors_chip_name *name);
+extern void removeKnownChip(const sensors_chip_name *name);
+
+/* The chips of the RRD layout, from rrd.c. Find the known chip of the i-th
+   one: returns 1 and sets *desc if found, 0 if the chip is gone or its
+   features changed, or -1 past the end of the layout. *values is set to
+   the number of values of the chip in either case. */
+extern int rrdLayoutChip(int i, ChipDescriptor **desc, int *values);
+
+/* from aggregate.c */
+
+extern const double aggregateQuantiles[AGG_QUANTILES];
+extern void aggregateReset(Aggregate *window);
+extern void aggregateAdd(Aggregate *window, double value);
+extern double aggregateQuantile(const Aggregate *window, int i);
+
+/* change-triggered reports, from sense.c */
+
+extern void reportStart(int output);
+extern int reportChanged(const ChipDescriptor *chip,
+			 const FeatureDescriptor *feature,
+			 const double values[], int alarm, int output);
+
+/* from sink.c */
+
+extern int sinkInit(void);
+extern void sinkClose(void);
+extern int sinkListenFd(void);
+extern void sinkAccept(void);
+extern void sinkStart(void);
+extern void sinkAdd(const ChipDescriptor *chip,
+		    const FeatureDescriptor *feature, const double values[],
+		    int alarm, const Aggregate *window);
+extern void sinkEnd(void);
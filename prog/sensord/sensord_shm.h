@@ -0,0 +1,207 @@
+/*
+    sensord_shm.h - Reader for the sensor readings published by sensord
+    Copyright (C) 2026  lm-sensors contributors
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+/*
+ * sensord --shm-file publishes the readings of each sink cycle in a
+ * memory-mapped file, as a ring of the most recent samples. This header
+ * maps that file and reads from it, without any system call once mapped
+ * and without locking: each slot of the ring is protected by a sequence
+ * counter, odd while sensord writes the slot.
+ *
+ * The file starts with a header, followed by the entries describing each
+ * value (chip, feature and subfeature names as used by libsensors), then
+ * the slots, each holding one value per entry. Unavailable values are
+ * NaN. When the chips change, sensord replaces the file and marks the
+ * old one stale, readers must then open the file again.
+ */
+
+#ifndef SENSORD_SHM_H
+#define SENSORD_SHM_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SENSORD_SHM_MAGIC	0x4d485353	/* "SSHM" */
+#define SENSORD_SHM_VERSION	1
+
+#define SENSORD_SHM_LIVE	0
+#define SENSORD_SHM_STALE	1	/* replaced or sensord stopped */
+
+struct sensord_shm_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t state;
+	uint32_t entry_count;
+	uint32_t entry_size;
+	uint32_t entries_offset;
+	uint32_t slot_count;
+	uint32_t slot_size;
+	uint32_t slots_offset;
+	uint32_t reserved;
+	uint64_t head;		/* number of slots written so far */
+};
+
+/* Names are truncated if needed, and always null-terminated */
+struct sensord_shm_entry {
+	char chip[64];		/* as printed by sensors_snprintf_chip_name */
+	char feature[32];	/* sensors_feature name */
+	char subfeature[32];	/* sensors_subfeature name */
+	char label[64];
+	int32_t type;		/* sensors_subfeature_type */
+	uint32_t reserved;
+};
+
+struct sensord_shm_slot {
+	uint32_t seq;		/* odd while being written */
+	uint32_t reserved;
+	int64_t time_ns;	/* CLOCK_REALTIME of the sample */
+	double values[];	/* one per entry */
+};
+
+struct sensord_shm {
+	const struct sensord_shm_header *header;
+	void *map;		/* header, for munmap */
+	size_t size;
+};
+
+/* Map the file, returns 0 on success or a negative errno */
+static inline int sensord_shm_open(struct sensord_shm *shm, const char *path)
+{
+	const struct sensord_shm_header *h;
+	struct stat st;
+	void *map;
+	int fd, err;
+
+	shm->header = NULL;
+	shm->map = NULL;
+	shm->size = 0;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st) < 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+	if ((size_t) st.st_size < sizeof(*h)) {
+		close(fd);
+		return -EINVAL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	err = -errno;
+	close(fd);
+	if (map == MAP_FAILED)
+		return err;
+
+	h = (const struct sensord_shm_header *) map;
+	if (h->magic != SENSORD_SHM_MAGIC ||
+	    h->version != SENSORD_SHM_VERSION ||
+	    h->entry_size != sizeof(struct sensord_shm_entry) ||
+	    h->slot_size < sizeof(struct sensord_shm_slot) +
+			   h->entry_count * sizeof(double) ||
+	    h->entries_offset + (uint64_t) h->entry_count * h->entry_size >
+	    (uint64_t) st.st_size ||
+	    h->slots_offset + (uint64_t) h->slot_count * h->slot_size >
+	    (uint64_t) st.st_size || !h->slot_count) {
+		munmap(map, st.st_size);
+		return -EINVAL;
+	}
+
+	shm->header = h;
+	shm->map = map;
+	shm->size = st.st_size;
+	return 0;
+}
+
+static inline void sensord_shm_close(struct sensord_shm *shm)
+{
+	munmap(shm->map, shm->size);
+	shm->header = NULL;
+	shm->map = NULL;
+}
+
+/* Whether the file must be opened again */
+static inline int sensord_shm_stale(const struct sensord_shm *shm)
+{
+	return __atomic_load_n(&shm->header->state, __ATOMIC_ACQUIRE) !=
+	       SENSORD_SHM_LIVE;
+}
+
+static inline unsigned int sensord_shm_count(const struct sensord_shm *shm)
+{
+	return shm->header->entry_count;
+}
+
+static inline const struct sensord_shm_entry *
+sensord_shm_entry(const struct sensord_shm *shm, unsigned int i)
+{
+	return (const struct sensord_shm_entry *)
+	       ((const char *) shm->header + shm->header->entries_offset +
+		i * shm->header->entry_size);
+}
+
+/*
+ * Copy the values of a sample, age 0 being the latest one. values must
+ * have room for sensord_shm_count() values. Returns 0 on success, -EAGAIN
+ * if there is no such sample (yet), or -ESTALE if the sample kept being
+ * overwritten while being read.
+ */
+static inline int sensord_shm_read(const struct sensord_shm *shm,
+				   unsigned int age, double *values,
+				   int64_t *time_ns)
+{
+	const struct sensord_shm_header *h = shm->header;
+	const struct sensord_shm_slot *slot;
+	uint64_t head;
+	uint32_t seq;
+	int tries;
+
+	if (age >= h->slot_count)
+		return -EAGAIN;
+
+	for (tries = 0; tries < 16; tries++) {
+		head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+		if (head <= age)
+			return -EAGAIN;
+		slot = (const struct sensord_shm_slot *)
+		       ((const char *) h + h->slots_offset +
+			((head - 1 - age) % h->slot_count) * h->slot_size);
+
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(values, slot->values, h->entry_count * sizeof(double));
+		if (time_ns)
+			*time_ns = slot->time_ns;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq &&
+		    __atomic_load_n(&h->head, __ATOMIC_RELAXED) - head <
+		    h->slot_count - age)
+			return 0;
+	}
+	return -ESTALE;
+}
+
+#endif /* def SENSORD_SHM_H */
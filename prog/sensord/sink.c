@@ -0,0 +1,1143 @@
+/*
+ * sensord
+ *
+ * A daemon that periodically logs sensor information to syslog.
+ *
+ * Copyright (c) 2026 lm-sensors contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE	/* for accept4 */
+
+/*
+ * Sinks publish the sensor readings of each sink cycle to other
+ * processes, so that they don't have to read the sensors themselves:
+ *
+ * - metrics: serve the readings in the OpenMetrics text format over HTTP,
+ *   on a TCP or Unix socket. The text is rendered once per cycle, so a
+ *   request only costs writing it out.
+ * - line protocol: push the readings in the InfluxDB line protocol over
+ *   UDP, or a Unix datagram socket.
+ * - shm: keep the most recent readings in a memory-mapped file, which
+ *   local readers map with sensord_shm.h and read without any call to
+ *   sensord.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "args.h"
+#include "sensord.h"
+#include "sensord_shm.h"
+
+/* Keep the datagrams below the usual MTU */
+#define DATAGRAM_MAX 1400
+
+/* Time allowed to a client to send its request and read the response */
+#define CLIENT_TIMEOUT_MS 100
+
+/* Samples kept in the shared memory ring */
+#define SHM_SLOTS 64
+
+/* One reading of the current cycle */
+typedef struct {
+	const ChipDescriptor *chip;
+	const FeatureDescriptor *feature;
+	double values[MAX_DATA];
+	int alarm;
+	/* Aggregates of the window, with --sample-interval */
+	unsigned int samples;
+	double min, max, sum;
+	double quantiles[AGG_QUANTILES];
+} SinkRow;
+
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+} SinkBuffer;
+
+typedef struct {
+	const char *name;
+	const char **address;	/* in sensord_args, NULL if unused */
+	int (*open)(const char *address);
+	void (*publish)(void);
+	void (*close)(void);
+} Sink;
+
+/* The read statistics of a subfeature accessed so far, with --stats */
+typedef struct {
+	const ChipDescriptor *chip;
+	const sensors_subfeature *subfeature;
+	sensors_subfeature_stats stats;
+} StatsRow;
+
+static SinkRow *rows;
+static int rowCount, rowMax;
+static time_t rowTime;
+static StatsRow *statsRows;
+static int statsCount, statsMax;
+
+/* Growable buffer, returns 0 on success */
+static int bufPrintf(SinkBuffer *buf, const char *fmt, ...)
+{
+	va_list ap;
+	char *data;
+	int len;
+
+	for (;;) {
+		va_start(ap, fmt);
+		len = vsnprintf(buf->data + buf->len, buf->size - buf->len,
+				fmt, ap);
+		va_end(ap);
+		if (len < 0)
+			return -1;
+		if (buf->len + len < buf->size)
+			break;
+
+		data = realloc(buf->data, 2 * (buf->len + len + 64));
+		if (!data)
+			return -1;
+		buf->data = data;
+		buf->size = 2 * (buf->len + len + 64);
+	}
+	buf->len += len;
+
+	return 0;
+}
+
+/* Parse a unix:path address, returns 0 if it is one */
+static int unixAddress(const char *address, struct sockaddr_un *sun)
+{
+	if (strncmp(address, "unix:", 5) ||
+	    strlen(address + 5) >= sizeof(sun->sun_path))
+		return -1;
+
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	strcpy(sun->sun_path, address + 5);
+	return 0;
+}
+
+/* Resolve a host:port address, the host possibly in brackets. Returns the
+   addresses to try, or NULL on error. */
+static struct addrinfo *inetAddress(const char *address, int type,
+				    int passive)
+{
+	struct addrinfo hints, *res;
+	char host[256];
+	const char *port;
+	size_t len;
+	int err;
+
+	port = strrchr(address, ':');
+	if (!port)
+		return NULL;
+	len = port - address;
+	if (len && address[0] == '[' && address[len - 1] == ']') {
+		address++;
+		len -= 2;
+	}
+	if (len >= sizeof(host))
+		return NULL;
+	memcpy(host, address, len);
+	host[len] = '\0';
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = type;
+	if (passive)
+		hints.ai_flags = AI_PASSIVE;
+	err = getaddrinfo(len ? host : NULL, port + 1, &hints, &res);
+	if (err) {
+		sensorLog(LOG_ERR, "Error resolving address: %s: %s",
+			  address, gai_strerror(err));
+		return NULL;
+	}
+
+	return res;
+}
+
+/* Create a listening socket, returns it or -1 */
+static int listenOn(int family, const struct sockaddr *addr,
+		    socklen_t len)
+{
+	int fd, one = 1;
+
+	fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0)
+		return -1;
+	if (family == AF_UNIX)
+		unlink(((const struct sockaddr_un *) addr)->sun_path);
+	else
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, addr, len) || listen(fd, 16)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * OpenMetrics over HTTP
+ */
+
+static int metricsFd = -1;
+static struct sockaddr_un metricsUnix;	/* to remove on exit */
+static SinkBuffer metricsText;
+
+/* The aggregates of the windows are summaries, in families of their own */
+static const struct {
+	DataType type;
+	const char *name;
+	const char *window;
+	const char *unit;
+} families[] = {
+	{ DataType_voltage, "sensor_voltage_volts",
+	  "sensor_voltage_window_volts", "volts" },
+	{ DataType_rpm, "sensor_fan_rpm", "sensor_fan_window_rpm", "rpm" },
+	{ DataType_temperature, "sensor_temperature_celsius",
+	  "sensor_temperature_window_celsius", "celsius" },
+	{ DataType_other, "sensor_value", "sensor_window", NULL },
+};
+
+static int metricsOpen(const char *address)
+{
+	struct sockaddr_un sun;
+	struct addrinfo *res, *ai;
+	int fd = -1;
+
+	if (!unixAddress(address, &sun)) {
+		fd = listenOn(AF_UNIX, (struct sockaddr *) &sun, sizeof(sun));
+		if (fd >= 0)
+			metricsUnix = sun;
+	} else {
+		res = inetAddress(address, SOCK_STREAM, 1);
+		if (!res) {
+			sensorLog(LOG_ERR, "Invalid metrics address: %s",
+				  address);
+			return -1;
+		}
+		for (ai = res; ai && fd < 0; ai = ai->ai_next)
+			fd = listenOn(ai->ai_family, ai->ai_addr,
+				      ai->ai_addrlen);
+		freeaddrinfo(res);
+	}
+
+	if (fd < 0) {
+		sensorLog(LOG_ERR, "Error listening on %s: %s", address,
+			  strerror(errno));
+		return -1;
+	}
+	metricsFd = fd;
+
+	/* Nothing was read yet */
+	return bufPrintf(&metricsText, "# EOF\n");
+}
+
+/* Append a label value, escaped */
+static int metricsLabel(const char *name, const char *value)
+{
+	const char *p;
+	int ret;
+
+	ret = bufPrintf(&metricsText, "%s=\"", name);
+	for (p = value; !ret && *p; p++) {
+		if (*p == '\\')
+			ret = bufPrintf(&metricsText, "\\\\");
+		else if (*p == '"')
+			ret = bufPrintf(&metricsText, "\\\"");
+		else if (*p == '\n')
+			ret = bufPrintf(&metricsText, "\\n");
+		else
+			ret = bufPrintf(&metricsText, "%c", *p);
+	}
+	return ret ? ret : bufPrintf(&metricsText, "\"");
+}
+
+/* A sample value, with the spelling OpenMetrics wants for the others than
+   numbers, as printf() has its own */
+static int metricsValue(double value)
+{
+	if (isnan(value))
+		return bufPrintf(&metricsText, "NaN\n");
+	if (isinf(value))
+		return bufPrintf(&metricsText, "%cInf\n",
+				 value < 0 ? '-' : '+');
+	return bufPrintf(&metricsText, "%g\n", value);
+}
+
+/* A sample, with an extra label if quantile isn't NULL */
+static int metricsSample(const char *name, const char *suffix,
+			 const SinkRow *row, const char *quantile,
+			 double value)
+{
+	return bufPrintf(&metricsText, "%s%s{", name, suffix) ||
+	       metricsLabel("chip", row->chip->fullName) ||
+	       bufPrintf(&metricsText, ",") ||
+	       metricsLabel("feature", row->feature->feature->name) ||
+	       bufPrintf(&metricsText, ",") ||
+	       metricsLabel("label", row->feature->label) ||
+	       (quantile &&
+		bufPrintf(&metricsText, ",quantile=\"%s\"", quantile)) ||
+	       bufPrintf(&metricsText, "} ") ||
+	       metricsValue(value);
+}
+
+static int metricsRow(const char *name, const SinkRow *row, double value)
+{
+	return metricsSample(name, "", row, NULL, value);
+}
+
+/* The minimum and maximum are the quantiles 0 and 1 */
+static int metricsWindow(const char *name, const SinkRow *row)
+{
+	char quantile[16];
+	int i, ret;
+
+	ret = metricsSample(name, "", row, "0", row->min);
+	for (i = 0; i < AGG_QUANTILES && !ret; i++) {
+		snprintf(quantile, sizeof(quantile), "%g",
+			 aggregateQuantiles[i]);
+		ret = metricsSample(name, "", row, quantile,
+				    row->quantiles[i]);
+	}
+	return ret ||
+	       metricsSample(name, "", row, "1", row->max) ||
+	       metricsSample(name, "_sum", row, NULL, row->sum) ||
+	       metricsSample(name, "_count", row, NULL, row->samples);
+}
+
+/* A sample of the statistics of a subfeature, with an extra label if extra
+   isn't NULL. Counters are printed in full. */
+static int metricsStatsSample(const char *name, const StatsRow *row,
+			      const char *extra, double value)
+{
+	return bufPrintf(&metricsText, "%s{", name) ||
+	       metricsLabel("chip", row->chip->fullName) ||
+	       bufPrintf(&metricsText, ",") ||
+	       metricsLabel("subfeature", row->subfeature->name) ||
+	       (extra && bufPrintf(&metricsText, ",%s", extra)) ||
+	       bufPrintf(&metricsText, "} %.15g\n", value);
+}
+
+/* The latency histogram of the reads, the buckets are cumulative */
+static int metricsLatency(const char *name, const StatsRow *row)
+{
+	const sensors_io_stats *stats = &row->stats.read;
+	char bucket[64], le[32];
+	unsigned long long count = 0;
+	int i, ret = 0;
+
+	snprintf(bucket, sizeof(bucket), "%s_bucket", name);
+	for (i = 0; i < SENSORS_STATS_BUCKETS && !ret; i++) {
+		count += stats->histogram[i];
+		if (i == SENSORS_STATS_BUCKETS - 1)
+			snprintf(le, sizeof(le), "le=\"+Inf\"");
+		else
+			snprintf(le, sizeof(le), "le=\"%g\"",
+				 (double) (2ULL << i) / 1e6);
+		ret = metricsStatsSample(bucket, row, le, count);
+	}
+	snprintf(bucket, sizeof(bucket), "%s_count", name);
+	ret = ret || metricsStatsSample(bucket, row, NULL, stats->count);
+	snprintf(bucket, sizeof(bucket), "%s_sum", name);
+	return ret ||
+	       metricsStatsSample(bucket, row, NULL, stats->total_ns / 1e9);
+}
+
+static const sensors_io_stats *statsIo(const StatsRow *row, int write)
+{
+	return write ? &row->stats.write : &row->stats.read;
+}
+
+/* The read and write statistics, one family after the other */
+static int metricsStats(void)
+{
+	static const char *kinds[] = {
+		"kind=\"io\"", "kind=\"access\"", "kind=\"kernel\""
+	};
+	const sensors_io_stats *io;
+	char name[64];
+	int j, w, ret = 0;
+
+	for (w = 0; w < 2; w++) {
+		const char *what = w ? "write" : "read";
+
+		for (j = 0; j < statsCount; j++)
+			if (statsIo(&statsRows[j], w)->count)
+				break;
+		if (j == statsCount)
+			continue;
+
+		ret |= bufPrintf(&metricsText, "# TYPE sensor_%ss counter\n",
+				 what);
+		snprintf(name, sizeof(name), "sensor_%ss_total", what);
+		for (j = 0; j < statsCount; j++) {
+			io = statsIo(&statsRows[j], w);
+			if (io->count)
+				ret |= metricsStatsSample(name, &statsRows[j],
+							  NULL, io->count);
+		}
+
+		ret |= bufPrintf(&metricsText,
+				 "# TYPE sensor_%s_errors counter\n", what);
+		snprintf(name, sizeof(name), "sensor_%s_errors_total", what);
+		for (j = 0; j < statsCount; j++) {
+			io = statsIo(&statsRows[j], w);
+			if (!io->count)
+				continue;
+			ret |= metricsStatsSample(name, &statsRows[j],
+						  kinds[0], io->io_errors) ||
+			       metricsStatsSample(name, &statsRows[j],
+						  kinds[1], io->access_errors) ||
+			       metricsStatsSample(name, &statsRows[j],
+						  kinds[2], io->kernel_errors);
+		}
+
+		snprintf(name, sizeof(name), "sensor_%s_max_seconds", what);
+		ret |= bufPrintf(&metricsText, "# TYPE %s gauge\n"
+				 "# UNIT %s seconds\n", name, name);
+		for (j = 0; j < statsCount; j++) {
+			io = statsIo(&statsRows[j], w);
+			if (io->count)
+				ret |= metricsStatsSample(name, &statsRows[j],
+							  NULL,
+							  io->max_ns / 1e9);
+		}
+	}
+
+	/* Only the reads are worth a histogram */
+	for (j = 0; j < statsCount; j++)
+		if (statsRows[j].stats.read.count)
+			break;
+	if (j == statsCount)
+		return ret;
+	ret |= bufPrintf(&metricsText,
+			 "# TYPE sensor_read_latency_seconds histogram\n"
+			 "# UNIT sensor_read_latency_seconds seconds\n");
+	for (; j < statsCount; j++)
+		if (statsRows[j].stats.read.count)
+			ret |= metricsLatency("sensor_read_latency_seconds",
+					      &statsRows[j]);
+	return ret;
+}
+
+/* Families must not be interleaved, so go through the rows per family */
+static void metricsPublish(void)
+{
+	int i, j, ret = 0;
+
+	metricsText.len = 0;
+	for (i = 0; i < ARRAY_SIZE(families); i++) {
+		for (j = 0; j < rowCount; j++)
+			if (rows[j].feature->type == families[i].type)
+				break;
+		if (j == rowCount)
+			continue;
+
+		ret |= bufPrintf(&metricsText, "# TYPE %s gauge\n",
+				 families[i].name);
+		if (families[i].unit)
+			ret |= bufPrintf(&metricsText, "# UNIT %s %s\n",
+					 families[i].name, families[i].unit);
+		for (; j < rowCount; j++)
+			if (rows[j].feature->type == families[i].type)
+				ret |= metricsRow(families[i].name, &rows[j],
+						  rows[j].values[0]);
+
+		for (j = 0; j < rowCount; j++)
+			if (rows[j].feature->type == families[i].type &&
+			    rows[j].samples)
+				break;
+		if (j == rowCount)
+			continue;
+
+		ret |= bufPrintf(&metricsText, "# TYPE %s summary\n",
+				 families[i].window);
+		if (families[i].unit)
+			ret |= bufPrintf(&metricsText, "# UNIT %s %s\n",
+					 families[i].window, families[i].unit);
+		for (; j < rowCount; j++)
+			if (rows[j].feature->type == families[i].type &&
+			    rows[j].samples)
+				ret |= metricsWindow(families[i].window,
+						     &rows[j]);
+	}
+
+	ret |= bufPrintf(&metricsText, "# TYPE sensor_alarm gauge\n");
+	for (j = 0; j < rowCount; j++)
+		if (rows[j].feature->alarmNumber >= 0)
+			ret |= metricsRow("sensor_alarm", &rows[j],
+					  rows[j].alarm);
+	if (statsCount)
+		ret |= metricsStats();
+	ret |= bufPrintf(&metricsText, "# EOF\n");
+
+	if (ret) {
+		sensorLog(LOG_ERR, "Error rendering metrics: %s",
+			  "Out of memory");
+		metricsText.len = 0;
+	}
+}
+
+static void metricsClose(void)
+{
+	close(metricsFd);
+	metricsFd = -1;
+	if (metricsUnix.sun_path[0]) {
+		unlink(metricsUnix.sun_path);
+		metricsUnix.sun_path[0] = '\0';
+	}
+	free(metricsText.data);
+	memset(&metricsText, 0, sizeof(metricsText));
+}
+
+/* Write all of a buffer, returns 0 on success */
+static int writeAll(int fd, const char *data, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = send(fd, data, len, MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		data += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+/*
+ * Answer a client: any request gets the metrics of the last cycle. Clients
+ * are served one at a time from the main loop, with a short timeout so
+ * that they can't delay the sampling much.
+ */
+static void metricsServe(void)
+{
+	struct timeval tv = { 0, CLIENT_TIMEOUT_MS * 1000 };
+	char request[1024], header[256];
+	ssize_t len;
+	int fd;
+
+	while ((fd = accept4(metricsFd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+		/* We only need to know that the request is complete */
+		len = recv(fd, request, sizeof(request) - 1, 0);
+		if (len > 0) {
+			snprintf(header, sizeof(header),
+				 "HTTP/1.0 200 OK\r\n"
+				 "Content-Type: application/openmetrics-text;"
+				 " version=1.0.0; charset=utf-8\r\n"
+				 "Content-Length: %lu\r\n"
+				 "Connection: close\r\n\r\n",
+				 (unsigned long) metricsText.len);
+			if (!writeAll(fd, header, strlen(header)) &&
+			    strncmp(request, "HEAD ", 5))
+				writeAll(fd, metricsText.data,
+					 metricsText.len);
+		}
+		close(fd);
+	}
+}
+
+/*
+ * InfluxDB line protocol over UDP
+ */
+
+static int lineFd = -1;
+static struct sockaddr_storage lineAddr;
+static socklen_t lineAddrLen;
+static SinkBuffer lineText;
+
+static int lineOpen(const char *address)
+{
+	struct sockaddr_un sun;
+	struct addrinfo *res;
+
+	if (!unixAddress(address, &sun)) {
+		memcpy(&lineAddr, &sun, sizeof(sun));
+		lineAddrLen = sizeof(sun);
+	} else {
+		res = inetAddress(address, SOCK_DGRAM, 0);
+		if (!res) {
+			sensorLog(LOG_ERR, "Invalid line protocol address: %s",
+				  address);
+			return -1;
+		}
+		memcpy(&lineAddr, res->ai_addr, res->ai_addrlen);
+		lineAddrLen = res->ai_addrlen;
+		freeaddrinfo(res);
+	}
+
+	lineFd = socket(lineAddr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC |
+			SOCK_NONBLOCK, 0);
+	if (lineFd < 0) {
+		sensorLog(LOG_ERR, "Error creating socket: %s",
+			  strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Append a tag value, escaped. Empty values aren't allowed, so such tags
+   are left out. */
+static int lineTag(const char *name, const char *value)
+{
+	const char *p;
+	int ret;
+
+	if (!value[strspn(value, "\n")])
+		return 0;
+	ret = bufPrintf(&lineText, ",%s=", name);
+	for (p = value; !ret && *p; p++) {
+		if (*p == ',' || *p == '=' || *p == ' ')
+			ret = bufPrintf(&lineText, "\\%c", *p);
+		else if (*p != '\n')
+			ret = bufPrintf(&lineText, "%c", *p);
+	}
+	return ret;
+}
+
+/* The separator before a field, the first one follows the tags */
+static char lineSep(int *first)
+{
+	if (!*first)
+		return ',';
+	*first = 0;
+	return ' ';
+}
+
+/* Append a floating-point field. Only finite values can be written, so
+   the others are left out. */
+static int lineField(const char *name, double value, int *first)
+{
+	if (!isfinite(value))
+		return 0;
+	return bufPrintf(&lineText, "%c%s=%g", lineSep(first), name, value);
+}
+
+static void lineSend(const char *data, size_t len)
+{
+	if (sendto(lineFd, data, len, 0, (struct sockaddr *) &lineAddr,
+		   lineAddrLen) < 0)
+		sensorLog(LOG_ERR, "Error sending line protocol: %s",
+			  strerror(errno));
+}
+
+/* After a line was added, send the previous ones if it doesn't fit in
+   their datagram */
+static void lineFlush(size_t *start, size_t *end)
+{
+	if (lineText.len - *start > DATAGRAM_MAX && *end > *start) {
+		lineSend(lineText.data + *start, *end - *start);
+		*start = *end;
+	}
+	*end = lineText.len;
+}
+
+/* Send the rows, as many per datagram as fit, only the changed ones with
+   --log-delta */
+static void linePublish(void)
+{
+	size_t start = 0, end = 0, line;
+	int i, first, ret = 0;
+
+	reportStart(REPORT_LINE);
+	lineText.len = 0;
+	for (i = 0; i < rowCount && !ret; i++) {
+		if (!reportChanged(rows[i].chip, rows[i].feature,
+				   rows[i].values, rows[i].alarm, REPORT_LINE))
+			continue;
+
+		line = lineText.len;
+		first = 1;
+		ret = bufPrintf(&lineText, "sensors") ||
+		      lineTag("chip", rows[i].chip->fullName) ||
+		      lineTag("feature", rows[i].feature->feature->name) ||
+		      lineTag("label", rows[i].feature->label) ||
+		      lineField("value", rows[i].values[0], &first);
+		if (!ret && rows[i].feature->alarmNumber >= 0)
+			ret = bufPrintf(&lineText, "%calarm=%di",
+					lineSep(&first), rows[i].alarm);
+		if (!ret && rows[i].samples)
+			ret = lineField("min", rows[i].min, &first) ||
+			      lineField("max", rows[i].max, &first) ||
+			      lineField("mean", rows[i].sum / rows[i].samples,
+					&first) ||
+			      lineField("p50", rows[i].quantiles[0], &first) ||
+			      lineField("p95", rows[i].quantiles[1], &first) ||
+			      lineField("p99", rows[i].quantiles[2], &first) ||
+			      bufPrintf(&lineText, "%csamples=%ui",
+					lineSep(&first), rows[i].samples);
+		if (ret)
+			break;
+
+		/* A line needs a field, a reading without any is dropped */
+		if (first) {
+			lineText.len = line;
+			continue;
+		}
+		ret = bufPrintf(&lineText, " %ld000000000\n", (long) rowTime);
+		if (ret)
+			break;
+		lineFlush(&start, &end);
+	}
+
+	/* The statistics are counters, always sent */
+	for (i = 0; i < statsCount && !ret; i++) {
+		const sensors_io_stats *rd = &statsRows[i].stats.read;
+		const sensors_io_stats *wr = &statsRows[i].stats.write;
+
+		ret = bufPrintf(&lineText, "sensors_stats") ||
+		      lineTag("chip", statsRows[i].chip->fullName) ||
+		      lineTag("subfeature", statsRows[i].subfeature->name) ||
+		      bufPrintf(&lineText, " reads=%llui,io_errors=%llui,"
+				"access_errors=%llui,kernel_errors=%llui,"
+				"read_seconds=%g,max_read_seconds=%g",
+				rd->count, rd->io_errors, rd->access_errors,
+				rd->kernel_errors, rd->total_ns / 1e9,
+				rd->max_ns / 1e9);
+		if (!ret && wr->count)
+			ret = bufPrintf(&lineText, ",writes=%llui,"
+					"write_errors=%llui", wr->count,
+					wr->io_errors + wr->access_errors +
+					wr->kernel_errors);
+		if (!ret)
+			ret = bufPrintf(&lineText, " %ld000000000\n",
+					(long) rowTime);
+		if (!ret)
+			lineFlush(&start, &end);
+	}
+	if (end > start)
+		lineSend(lineText.data + start, end - start);
+
+	if (ret)
+		sensorLog(LOG_ERR, "Error rendering line protocol: %s",
+			  "Out of memory");
+}
+
+static void lineClose(void)
+{
+	close(lineFd);
+	lineFd = -1;
+	free(lineText.data);
+	memset(&lineText, 0, sizeof(lineText));
+}
+
+/*
+ * Shared memory ring, see sensord_shm.h for the layout
+ */
+
+static struct sensord_shm_header *shmHeader;
+static size_t shmSize;
+static const char *shmPath;
+static unsigned int shmGeneration;	/* of knownChips when laid out */
+static int *shmChips;		/* first feature of each chip */
+static int *shmFeatures;	/* first entry of each feature */
+
+static int shmOpen(const char *path)
+{
+	shmPath = path;
+	/* The file is created on the first cycle, once the chips are known */
+	shmGeneration = knownChipsGeneration - 1;
+	return 0;
+}
+
+/* Give up a mapping, readers will notice that they must open the file
+   again */
+static void shmRelease(struct sensord_shm_header *header, size_t size)
+{
+	if (!header)
+		return;
+	__atomic_store_n(&header->state, SENSORD_SHM_STALE, __ATOMIC_RELEASE);
+	munmap(header, size);
+}
+
+static void shmEntry(struct sensord_shm_entry *entry,
+		     const ChipDescriptor *chip,
+		     const FeatureDescriptor *feature, int number)
+{
+	const sensors_subfeature *sub;
+	int nr = 0;
+
+	snprintf(entry->chip, sizeof(entry->chip), "%s",
+		 chip->fullName ? chip->fullName : "");
+	snprintf(entry->feature, sizeof(entry->feature), "%s",
+		 feature->feature->name);
+	snprintf(entry->label, sizeof(entry->label), "%s",
+		 feature->label ? feature->label : "");
+	while ((sub = sensors_get_all_subfeatures(chip->name, feature->feature,
+						  &nr)))
+		if (sub->number == number) {
+			snprintf(entry->subfeature, sizeof(entry->subfeature),
+				 "%s", sub->name);
+			entry->type = sub->type;
+			break;
+		}
+}
+
+/* The entries of a feature: its data values, then its alarm if any */
+static int shmFeatureEntries(const FeatureDescriptor *feature)
+{
+	int count;
+
+	for (count = 0; feature->dataNumbers[count] >= 0; count++)
+		;
+	return count + (feature->alarmNumber >= 0);
+}
+
+/*
+ * Lay out the entries for the current chips in a new file, and replace
+ * the previous file with it. The new file is filled before being renamed,
+ * so readers never see it incomplete. Returns 0 on success.
+ */
+static int shmCreate(void)
+{
+	struct sensord_shm_header *header;
+	struct sensord_shm_entry *entries;
+	struct sensord_shm_slot *slot;
+	int *chips = NULL, *features = NULL;
+	int c, f, i, e, chipCount, featureCount, entryCount, fd;
+	size_t slotSize, slotsOffset, size;
+	char *tmp;
+
+	chipCount = featureCount = entryCount = 0;
+	for (c = 0; knownChips[c].features; c++, chipCount++)
+		for (f = 0; knownChips[c].features[f].format; f++) {
+			featureCount++;
+			entryCount += shmFeatureEntries(&knownChips[c].features[f]);
+		}
+
+	slotSize = sizeof(struct sensord_shm_slot) +
+		   entryCount * sizeof(double);
+	slotSize = (slotSize + 63) & ~(size_t) 63;
+	slotsOffset = sizeof(*header) +
+		      entryCount * sizeof(struct sensord_shm_entry);
+	slotsOffset = (slotsOffset + 63) & ~(size_t) 63;
+	size = slotsOffset + SHM_SLOTS * slotSize;
+
+	chips = malloc((chipCount + 1) * sizeof(int));
+	features = malloc((featureCount + 1) * sizeof(int));
+	tmp = malloc(strlen(shmPath) + 5);
+	if (!chips || !features || !tmp) {
+		sensorLog(LOG_ERR, "Error creating %s: %s", shmPath,
+			  strerror(ENOMEM));
+		goto fail;
+	}
+	sprintf(tmp, "%s.tmp", shmPath);
+
+	fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		sensorLog(LOG_ERR, "Error creating %s: %s", tmp,
+			  strerror(errno));
+		goto fail;
+	}
+	if (ftruncate(fd, size) ||
+	    (header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   fd, 0)) == MAP_FAILED) {
+		sensorLog(LOG_ERR, "Error creating %s: %s", tmp,
+			  strerror(errno));
+		close(fd);
+		unlink(tmp);
+		goto fail;
+	}
+	close(fd);
+
+	/* The file is all zeroes, fill in what isn't */
+	entries = (struct sensord_shm_entry *) (header + 1);
+	for (c = f = e = 0; knownChips[c].features; c++) {
+		const ChipDescriptor *chip = &knownChips[c];
+		const FeatureDescriptor *feature;
+
+		chips[c] = f;
+		for (feature = chip->features; feature->format; feature++) {
+			features[f++] = e;
+			for (i = 0; feature->dataNumbers[i] >= 0; i++)
+				shmEntry(&entries[e++], chip, feature,
+					 feature->dataNumbers[i]);
+			if (feature->alarmNumber >= 0)
+				shmEntry(&entries[e++], chip, feature,
+					 feature->alarmNumber);
+		}
+	}
+	for (i = 0; i < SHM_SLOTS; i++) {
+		slot = (struct sensord_shm_slot *) ((char *) header +
+						    slotsOffset + i * slotSize);
+		for (e = 0; e < entryCount; e++)
+			slot->values[e] = NAN;
+	}
+
+	header->magic = SENSORD_SHM_MAGIC;
+	header->version = SENSORD_SHM_VERSION;
+	header->state = SENSORD_SHM_LIVE;
+	header->entry_count = entryCount;
+	header->entry_size = sizeof(struct sensord_shm_entry);
+	header->entries_offset = sizeof(*header);
+	header->slot_count = SHM_SLOTS;
+	header->slot_size = slotSize;
+	header->slots_offset = slotsOffset;
+
+	if (rename(tmp, shmPath)) {
+		sensorLog(LOG_ERR, "Error renaming %s: %s", tmp,
+			  strerror(errno));
+		munmap(header, size);
+		unlink(tmp);
+		goto fail;
+	}
+	free(tmp);
+
+	shmRelease(shmHeader, shmSize);
+	free(shmChips);
+	free(shmFeatures);
+	shmHeader = header;
+	shmSize = size;
+	shmChips = chips;
+	shmFeatures = features;
+	shmGeneration = knownChipsGeneration;
+	sensorLog(LOG_DEBUG, "%s created with %d values", shmPath, entryCount);
+	return 0;
+
+fail:
+	free(chips);
+	free(features);
+	free(tmp);
+	return -1;
+}
+
+/* Write the readings to the next slot, under its sequence counter */
+static void shmPublish(void)
+{
+	struct sensord_shm_slot *slot;
+	uint64_t head;
+	uint32_t seq;
+	double *values;
+	int i, j, e;
+
+	if (shmGeneration != knownChipsGeneration && shmCreate())
+		return;
+
+	head = shmHeader->head;
+	slot = (struct sensord_shm_slot *) ((char *) shmHeader +
+					    shmHeader->slots_offset +
+					    (head % SHM_SLOTS) *
+					    shmHeader->slot_size);
+	seq = slot->seq;
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	values = slot->values;
+	for (e = 0; e < (int) shmHeader->entry_count; e++)
+		values[e] = NAN;
+	for (i = 0; i < rowCount; i++) {
+		const FeatureDescriptor *feature = rows[i].feature;
+
+		e = shmFeatures[shmChips[rows[i].chip - knownChips] +
+				(feature - rows[i].chip->features)];
+		for (j = 0; feature->dataNumbers[j] >= 0; j++)
+			values[e++] = rows[i].values[j];
+		if (feature->alarmNumber >= 0)
+			values[e] = rows[i].alarm;
+	}
+	slot->time_ns = (int64_t) rowTime * 1000000000;
+
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&shmHeader->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void shmClose(void)
+{
+	if (shmHeader)
+		unlink(shmPath);
+	shmRelease(shmHeader, shmSize);
+	shmHeader = NULL;
+	free(shmChips);
+	free(shmFeatures);
+	shmChips = shmFeatures = NULL;
+}
+
+static const Sink sinks[] = {
+	{ "metrics", &sensord_args.metricsAddress, metricsOpen,
+	  metricsPublish, metricsClose },
+	{ "line protocol", &sensord_args.lineAddress, lineOpen,
+	  linePublish, lineClose },
+	{ "shm", &sensord_args.shmFile, shmOpen, shmPublish, shmClose },
+};
+
+static int opened[ARRAY_SIZE(sinks)];
+
+/* Open the sinks given on the command line, returns 0 on success */
+int sinkInit(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sinks); i++) {
+		if (!*sinks[i].address)
+			continue;
+		if (sinks[i].open(*sinks[i].address)) {
+			sinkClose();
+			return -1;
+		}
+		opened[i] = 1;
+		sensorLog(LOG_DEBUG, "%s sink opened", sinks[i].name);
+	}
+	return 0;
+}
+
+void sinkClose(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sinks); i++) {
+		if (opened[i])
+			sinks[i].close();
+		opened[i] = 0;
+	}
+	free(rows);
+	rows = NULL;
+	rowCount = rowMax = 0;
+	free(statsRows);
+	statsRows = NULL;
+	statsCount = statsMax = 0;
+}
+
+/* The socket to watch for clients, or -1 */
+int sinkListenFd(void)
+{
+	return metricsFd;
+}
+
+void sinkAccept(void)
+{
+	metricsServe();
+}
+
+void sinkStart(void)
+{
+	rowCount = 0;
+	rowTime = time(NULL);
+}
+
+void sinkAdd(const ChipDescriptor *chip, const FeatureDescriptor *feature,
+	     const double values[], int alarm, const Aggregate *window)
+{
+	SinkRow *row;
+	int i;
+
+	if (!chip->fullName || !feature->label)
+		return;
+
+	if (rowCount == rowMax) {
+		int max = rowMax ? 2 * rowMax : 64;
+		SinkRow *r = realloc(rows, max * sizeof(SinkRow));
+
+		if (!r)
+			return;
+		rows = r;
+		rowMax = max;
+	}
+
+	row = &rows[rowCount++];
+	row->chip = chip;
+	row->feature = feature;
+	for (i = 0; i < MAX_DATA && feature->dataNumbers[i] >= 0; i++)
+		row->values[i] = values[i];
+	row->alarm = alarm;
+
+	row->samples = window ? window->count : 0;
+	if (!row->samples)
+		return;
+	row->min = window->min;
+	row->max = window->max;
+	row->sum = window->sum;
+	for (i = 0; i < AGG_QUANTILES; i++)
+		row->quantiles[i] = aggregateQuantile(window, i);
+}
+
+/* Gather the statistics of the subfeatures of the known chips which were
+   read or written so far */
+static void statsCollect(void)
+{
+	const sensors_feature *feature;
+	const sensors_subfeature *sub;
+	const ChipDescriptor *chip;
+	StatsRow *row;
+	int f, s;
+
+	statsCount = 0;
+	for (chip = knownChips; chip->features; chip++) {
+		if (!chip->fullName)
+			continue;
+		f = 0;
+		while ((feature = sensors_get_features(chip->name, &f))) {
+			s = 0;
+			while ((sub = sensors_get_all_subfeatures(chip->name,
+								  feature,
+								  &s))) {
+				if (statsCount == statsMax) {
+					int max = statsMax ? 2 * statsMax : 64;
+					StatsRow *r = realloc(statsRows,
+							      max * sizeof(StatsRow));
+
+					if (!r)
+						return;
+					statsRows = r;
+					statsMax = max;
+				}
+
+				row = &statsRows[statsCount];
+				if (sensors_get_stats(chip->name, sub->number,
+						      &row->stats) ||
+				    (!row->stats.read.count &&
+				     !row->stats.write.count))
+					continue;
+				row->chip = chip;
+				row->subfeature = sub;
+				statsCount++;
+			}
+		}
+	}
+}
+
+/* Publish the readings of the cycle to all the sinks */
+void sinkEnd(void)
+{
+	int i;
+
+	if (sensord_args.doStats)
+		statsCollect();
+	for (i = 0; i < ARRAY_SIZE(sinks); i++)
+		if (opened[i])
+			sinks[i].publish();
+}
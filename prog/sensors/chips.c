@@ -27,92 +27,262 @@
 
 #include "main.h"
 #include "chips.h"
+#include "output.h"
 #include "lib/sensors.h"
 #include "lib/error.h"
 
 #define ARRAY_SIZE(arr) (int)(sizeof(arr) / sizeof((arr)[0]))
 
+/*
+ * What is known of each chip, fetched once: the library allocates the
+ * labels, and may read them from sysfs, which --watch would otherwise do
+ * again for every feature at every tick. The buffers the values are read
+ * into are reused likewise.
+ */
+struct chip_cache {
+	const sensors_chip_name *chip;
+	char **labels;		/* indexed by feature number */
+	int count;
+	int *nr;		/* the readable subfeatures, in order */
+	double *values;
+	int *errors;
+	int value_count;	/* -1 until nr is filled */
+};
+
+static struct chip_cache *chip_cache;
+static int chip_cache_count;
+
+static struct chip_cache *get_chip_cache(const sensors_chip_name *name)
+{
+	struct chip_cache *cc;
+	int i;
+
+	for (i = 0; i < chip_cache_count; i++)
+		if (chip_cache[i].chip == name)
+			return &chip_cache[i];
+
+	cc = realloc(chip_cache, (i + 1) * sizeof(struct chip_cache));
+	if (!cc) {
+		fprintf(stderr, "ERROR: Out of memory\n");
+		exit(1);
+	}
+	chip_cache = cc;
+	cc = &chip_cache[i];
+	memset(cc, 0, sizeof(*cc));
+	cc->chip = name;
+	cc->value_count = -1;
+	chip_cache_count++;
+	return cc;
+}
+
+/*
+ * Read the values of all the readable subfeatures of a chip in one go, in
+ * the order in which they are enumerated. *values and *errors point to
+ * buffers which are reused the next time. Returns the number of values
+ * read, or -1 on error.
+ */
+static int get_chip_values(const sensors_chip_name *name, double **values,
+			   int **errors)
+{
+	struct chip_cache *cc = get_chip_cache(name);
+	int a, b, count;
+	const sensors_feature *feature;
+	const sensors_subfeature *sub;
+
+	if (cc->value_count < 0) {
+		count = sensors_get_values(name, NULL, 0, NULL, NULL);
+		if (count < 0) {
+			fprintf(stderr, "ERROR: Can't get values: %s\n",
+				sensors_strerror(count));
+			return -1;
+		}
+
+		cc->nr = malloc(count * sizeof(int));
+		cc->values = malloc(count * sizeof(double));
+		cc->errors = malloc(count * sizeof(int));
+		if (count && (!cc->nr || !cc->values || !cc->errors)) {
+			fprintf(stderr, "ERROR: Out of memory\n");
+			exit(1);
+		}
+
+		count = 0;
+		a = 0;
+		while ((feature = sensors_get_features(name, &a))) {
+			b = 0;
+			while ((sub = sensors_get_all_subfeatures(name, feature,
+								  &b)))
+				if (sub->flags & SENSORS_MODE_R)
+					cc->nr[count++] = sub->number;
+		}
+		cc->value_count = count;
+	}
+
+	count = sensors_get_values(name, cc->nr, cc->value_count, cc->values,
+				   cc->errors);
+	if (count < 0) {
+		fprintf(stderr, "ERROR: Can't get values: %s\n",
+			sensors_strerror(count));
+		return -1;
+	}
+	*values = cc->values;
+	*errors = cc->errors;
+	return count;
+}
+
+static const char *get_label(const sensors_chip_name *name,
+			     const sensors_feature *feature)
+{
+	struct chip_cache *cc = get_chip_cache(name);
+
+	if (feature->number >= cc->count) {
+		char **labels;
+
+		labels = realloc(cc->labels,
+				 (feature->number + 1) * sizeof(char *));
+		if (!labels) {
+			fprintf(stderr, "ERROR: Out of memory\n");
+			exit(1);
+		}
+		memset(labels + cc->count, 0,
+		       (feature->number + 1 - cc->count) * sizeof(char *));
+		cc->labels = labels;
+		cc->count = feature->number + 1;
+	}
+
+	if (!cc->labels[feature->number])
+		cc->labels[feature->number] = sensors_get_label(name, feature);
+	return cc->labels[feature->number];
+}
+
+/* Skip the values of a feature which can't be printed */
+static int skip_feature_values(const sensors_chip_name *name,
+			       const sensors_feature *feature)
+{
+	const sensors_subfeature *sub;
+	int b = 0, i = 0;
+
+	while ((sub = sensors_get_all_subfeatures(name, feature, &b)))
+		if (sub->flags & SENSORS_MODE_R)
+			i++;
+	return i;
+}
+
+/* The body of the raw output, to be written with out_flush() */
 void print_chip_raw(const sensors_chip_name *name)
 {
-	int a, b, err;
+	int a, b, i, err, *errors;
 	const sensors_feature *feature;
 	const sensors_subfeature *sub;
-	char *label;
-	double val;
+	const char *label;
+	double *values;
+
+	if (get_chip_values(name, &values, &errors) < 0)
+		return;
 
 	a = 0;
+	i = 0;
 	while ((feature = sensors_get_features(name, &a))) {
-		if (!(label = sensors_get_label(name, feature))) {
+		if (!(label = get_label(name, feature))) {
 			fprintf(stderr, "ERROR: Can't get label of feature "
 				"%s!\n", feature->name);
+			i += skip_feature_values(name, feature);
 			continue;
 		}
-		printf("%s:\n", label);
+		out_str(label);
+		out_str(":\n");
 
 		b = 0;
 		while ((sub = sensors_get_all_subfeatures(name, feature, &b))) {
-			if (sub->flags & SENSORS_MODE_R) {
-				if ((err = sensors_get_value(name, sub->number,
-							     &val)))
-					fprintf(stderr, "ERROR: Can't get "
-						"value of subfeature %s: %s\n",
-						sub->name,
-						sensors_strerror(err));
-				else
-					printf("  %s: %.3f\n", sub->name, val);
-			} else
-				printf("(%s)\n", label);
+			if (!(sub->flags & SENSORS_MODE_R))
+				continue;
+			if ((err = errors[i])) {
+				fprintf(stderr, "ERROR: Can't get value of "
+					"subfeature %s: %s\n", sub->name,
+					sensors_strerror(err));
+			} else {
+				out_str("  ");
+				out_str(sub->name);
+				out_str(": ");
+				out_number(values[i]);
+				out_char('\n');
+			}
+			i++;
 		}
-		free(label);
 	}
 }
 
-void print_chip_json(const sensors_chip_name *name)
+/*
+ * The "chip":{...} json object, to be written with out_flush(). Features
+ * which can't be labeled and values which can't be read are left out, so
+ * that the output remains valid.
+ */
+void print_chip_json(const sensors_chip_name *name, const char *chip,
+		     const char *adapter)
 {
-	int a, b, cnt, subCnt, err;
+	int a, b, i, cnt, subCnt, err, *errors;
 	const sensors_feature *feature;
 	const sensors_subfeature *sub;
-	char *label;
-	double val;
+	const char *label;
+	double *values;
 
-	a = 0;
+	out_indent(1);
+	out_json_str(chip);
+	out_str(":{");
 	cnt = 0;
+	if (adapter) {
+		out_indent(2);
+		out_str("\"Adapter\": ");
+		out_json_str(adapter);
+		cnt++;
+	}
+
+	if (get_chip_values(name, &values, &errors) < 0) {
+		out_indent(1);
+		out_char('}');
+		return;
+	}
+
+	a = 0;
+	i = 0;
 	while ((feature = sensors_get_features(name, &a))) {
-		if (!(label = sensors_get_label(name, feature))) {
+		if (!(label = get_label(name, feature))) {
 			fprintf(stderr, "ERROR: Can't get label of feature "
 				"%s!\n", feature->name);
+			i += skip_feature_values(name, feature);
 			continue;
 		}
 		if (cnt > 0)
-			printf(",\n");
-		printf("      \"%s\":{\n", label);
+			out_char(',');
+		out_indent(2);
+		out_json_str(label);
+		out_str(":{");
 
 		b = 0;
 		subCnt = 0;
 		while ((sub = sensors_get_all_subfeatures(name, feature, &b))) {
-			if (sub->flags & SENSORS_MODE_R) {
-				if ((err = sensors_get_value(name, sub->number,
-							     &val))) {
-					fprintf(stderr, "ERROR: Can't get "
-						"value of subfeature %s: %s\n",
-						sub->name,
-						sensors_strerror(err));
-				} else {
-					if (subCnt > 0)
-						printf(",\n");
-					printf("         \"%s\": %.3f", sub->name, val);
-				}
-
+			if (!(sub->flags & SENSORS_MODE_R))
+				continue;
+			if ((err = errors[i])) {
+				fprintf(stderr, "ERROR: Can't get value of "
+					"subfeature %s: %s\n", sub->name,
+					sensors_strerror(err));
 			} else {
-				printf("(%s)", label);
+				if (subCnt > 0)
+					out_char(',');
+				out_indent(3);
+				out_json_str(sub->name);
+				out_str(": ");
+				out_json_number(values[i]);
+				subCnt++;
 			}
-			subCnt++;
+			i++;
 		}
-		free(label);
-		printf("\n      }");
+		out_indent(2);
+		out_char('}');
 		cnt++;
 	}
-	printf("\n");
+	out_indent(1);
+	out_char('}');
 }
 
 static const char hyst_str[] = "hyst";
@@ -26,6 +26,8 @@
 #include <errno.h>
 #include <locale.h>
 #include <langinfo.h>
+#include <time.h>
+#include <unistd.h>
 
 #ifndef __UCLIBC__
 #include <iconv.h>
@@ -36,15 +38,18 @@
 #include "lib/error.h"
 #include "main.h"
 #include "chips.h"
+#include "output.h"
 #include "version.h"
 
 #define PROGRAM			"sensors"
 #define VERSION			LM_VERSION
 
-static int do_sets, do_raw, do_json, hide_adapter;
+static int do_sets, do_raw, do_json, do_stats, hide_adapter;
+static double watch_interval; /* in seconds, 0 if not watching */
 
 int fahrenheit;
 char degstr[5]; /* store the correct string to print degrees */
+int compact_json;
 
 static void print_short_help(void)
 {
@@ -60,6 +65,9 @@ static void print_long_help(void)
 	     "  -f, --fahrenheit      Show temperatures in degrees fahrenheit\n"
 	     "  -A, --no-adapter      Do not show adapter for each chip\n"
 	     "      --bus-list        Generate bus statements for sensors.conf\n"
+	     "      --cache-file=FILE Cache the detected chips and configuration\n"
+	     "      --watch=INTERVAL  Print again every INTERVAL seconds\n"
+	     "      --stats           Print read and write statistics\n"
 	     "  -u                    Raw output\n"
 	     "  -j                    Json output\n"
 	     "  -v, --version         Display the program version\n"
@@ -83,7 +91,7 @@ static void print_version(void)
 }
 
 /* Return 0 on success, and an exit error code otherwise */
-static int read_config_file(const char *config_file_name)
+static int read_config_file(const char *config_file_name, int all_chips)
 {
 	FILE *config_file;
 	int err;
@@ -104,6 +112,15 @@ static int read_config_file(const char *config_file_name)
 		config_file = NULL;
 	}
 
+	/* Short-lived, so startup time matters. All the chips are best read
+	   in parallel, otherwise only the requested ones get read. The set
+	   statements read each attribute before writing it, and watching reads
+	   them all again at each tick, share the file descriptors. */
+	sensors_set_flags(sensors_get_flags() |
+			  (all_chips ? SENSORS_FLAG_PARALLEL_INIT : 0) |
+			  (do_sets || watch_interval ?
+			   SENSORS_FLAG_CACHE_FD : 0) |
+			  (do_stats ? SENSORS_FLAG_STATS : 0));
 	err = sensors_init(config_file);
 	if (err) {
 		fprintf(stderr, "sensors_init: %s\n", sensors_strerror(err));
@@ -157,8 +174,32 @@ static const char *sprintf_chip_name(const sensors_chip_name *name)
 	return buf;
 }
 
+/* The raw output goes through the output buffer, written once per chip */
+static void do_a_raw_print(const sensors_chip_name *name)
+{
+	out_str(sprintf_chip_name(name));
+	out_char('\n');
+	if (!hide_adapter) {
+		const char *adap = sensors_get_adapter_name(&name->bus);
+		if (adap) {
+			out_str("Adapter: ");
+			out_str(adap);
+			out_char('\n');
+		} else
+			fprintf(stderr, "Can't get adapter name\n");
+	}
+	print_chip_raw(name);
+	out_char('\n');
+	out_flush();
+}
+
 static void do_a_print(const sensors_chip_name *name)
 {
+	if (do_raw) {
+		do_a_raw_print(name);
+		return;
+	}
+
 	printf("%s\n", sprintf_chip_name(name));
 	if (!hide_adapter) {
 		const char *adap = sensors_get_adapter_name(&name->bus);
@@ -167,25 +208,20 @@ static void do_a_print(const sensors_chip_name *name)
 		else
 			fprintf(stderr, "Can't get adapter name\n");
 	}
-	if (do_raw)
-		print_chip_raw(name);
-	else
-		print_chip(name);
+	print_chip(name);
 	printf("\n");
 }
 
 static void do_a_json_print(const sensors_chip_name *name)
 {
-	printf("   \"%s\":{\n", sprintf_chip_name(name));
+	const char *adap = NULL;
+
 	if (!hide_adapter) {
-		const char *adap = sensors_get_adapter_name(&name->bus);
-		if (adap)
-			printf("      \"Adapter\": \"%s\",\n", adap);
-		else
+		adap = sensors_get_adapter_name(&name->bus);
+		if (!adap)
 			fprintf(stderr, "Can't get adapter name\n");
 	}
-	print_chip_json(name);
-	printf("   }");
+	print_chip_json(name, sprintf_chip_name(name), adap);
 }
 
 /* returns 1 on error */
@@ -212,6 +248,51 @@ static int do_a_set(const sensors_chip_name *name)
 	return 0;
 }
 
+static void print_io_stats(const char *name, const char *what,
+			   const sensors_io_stats *stats)
+{
+	printf("  %-18s %8llu %-6s avg %9.1f us, max %9.1f us", name,
+	       stats->count, what, stats->total_ns / 1000.0 / stats->count,
+	       stats->max_ns / 1000.0);
+	if (stats->io_errors || stats->access_errors || stats->kernel_errors)
+		printf(", errors: %llu I/O, %llu access, %llu kernel",
+		       stats->io_errors, stats->access_errors,
+		       stats->kernel_errors);
+	printf("\n");
+}
+
+/* Print the statistics of the subfeatures which were read or written */
+static void print_stats(const sensors_chip_name *match)
+{
+	const sensors_chip_name *chip;
+	const sensors_feature *feature;
+	const sensors_subfeature *sub;
+	sensors_subfeature_stats stats;
+	int chip_nr = 0, feature_nr, sub_nr;
+
+	printf("Statistics:\n");
+	while ((chip = sensors_get_detected_chips(match, &chip_nr))) {
+		printf("%s\n", sprintf_chip_name(chip));
+		feature_nr = 0;
+		while ((feature = sensors_get_features(chip, &feature_nr))) {
+			sub_nr = 0;
+			while ((sub = sensors_get_all_subfeatures(chip, feature,
+								  &sub_nr))) {
+				if (sensors_get_stats(chip, sub->number,
+						      &stats))
+					continue;
+				if (stats.read.count)
+					print_io_stats(sub->name, "reads",
+						       &stats.read);
+				if (stats.write.count)
+					print_io_stats(sub->name, "writes",
+						       &stats.write);
+			}
+		}
+	}
+	printf("\n");
+}
+
 /* returns number of chips found */
 static int do_the_real_work(const sensors_chip_name *match, int *err)
 {
@@ -220,7 +301,7 @@ static int do_the_real_work(const sensors_chip_name *match, int *err)
 	int cnt = 0;
 
 	if (do_json)
-		printf("{\n");
+		out_char('{');
 	chip_nr = 0;
 	while ((chip = sensors_get_detected_chips(match, &chip_nr))) {
 		if (do_sets) {
@@ -229,7 +310,7 @@ static int do_the_real_work(const sensors_chip_name *match, int *err)
 		} else {
 			if (do_json) {
 				if (cnt > 0)
-					printf(",\n");
+					out_char(',');
 				do_a_json_print(chip);
 			} else {
 				do_a_print(chip);
@@ -237,11 +318,101 @@ static int do_the_real_work(const sensors_chip_name *match, int *err)
 		}
 		cnt++;
 	}
-	if (do_json)
-		printf("\n}\n");
+	if (do_json) {
+		/* The whole document is written at once */
+		out_indent(0);
+		out_str("}\n");
+		if (out_flush())
+			*err = 1;
+	} else if (do_stats && cnt) {
+		print_stats(match);
+	}
+	return cnt;
+}
+
+/* Print the matching chips once, as a single line record in json mode.
+   Returns the number of chips found, or -1 if stdout was closed. */
+static int do_a_watch_tick(const sensors_chip_name *match, int match_count)
+{
+	const sensors_chip_name *chip;
+	struct timespec now;
+	int i, chip_nr, cnt = 0;
+
+	if (do_json) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		out_str("{\"time\": ");
+		out_number(now.tv_sec + now.tv_nsec / 1e9);
+		out_str(", \"chips\": {");
+	} else if (isatty(STDOUT_FILENO)) {
+		/* Redraw from the top of the screen */
+		printf("\033[H\033[2J");
+	}
+
+	for (i = 0; i < match_count || (!match_count && !i); i++) {
+		chip_nr = 0;
+		while ((chip = sensors_get_detected_chips(match_count ?
+							  &match[i] : NULL,
+							  &chip_nr))) {
+			if (do_json) {
+				if (cnt > 0)
+					out_char(',');
+				do_a_json_print(chip);
+			} else {
+				do_a_print(chip);
+			}
+			cnt++;
+		}
+	}
+
+	if (do_json) {
+		out_str("}}\n");
+		if (out_flush())
+			return -1;
+	} else if (do_stats) {
+		for (i = 0; i < match_count || (!match_count && !i); i++)
+			print_stats(match_count ? &match[i] : NULL);
+	}
+	fflush(stdout);
 	return cnt;
 }
 
+/* Print the chips every watch_interval, until interrupted or stdout is
+   closed. The library is initialized only once, and the values are read
+   again through the file descriptors it keeps open. Returns an exit error
+   code. */
+static int do_watch(const sensors_chip_name *match, int match_count)
+{
+	struct timespec next, now;
+	int cnt;
+	long long step = watch_interval * 1e9;
+
+	/* Write each tick at once, so that redrawing doesn't flicker */
+	setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (1) {
+		cnt = do_a_watch_tick(match, match_count);
+		if (!cnt && !do_json) {
+			fprintf(stderr, "Specified sensor(s) not found!\n");
+			return 1;
+		}
+		if (cnt < 0 || ferror(stdout))
+			return 1;
+
+		/* Skip the ticks we missed rather than catching up */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		do {
+			next.tv_sec += (next.tv_nsec + step) / 1000000000;
+			next.tv_nsec = (next.tv_nsec + step) % 1000000000;
+		} while (next.tv_sec < now.tv_sec ||
+			 (next.tv_sec == now.tv_sec &&
+			  next.tv_nsec <= now.tv_nsec));
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+				       NULL) == EINTR)
+			;
+	}
+}
+
 /* List the buses in a format suitable for sensors.conf. We only list
    bus types for which bus statements are actually useful and supported.
    Known bug: i2c buses with number >= 32 or 64 could be listed several
@@ -281,6 +452,9 @@ int main(int argc, char *argv[])
 		{ "no-adapter", no_argument, NULL, 'A' },
 		{ "config-file", required_argument, NULL, 'c' },
 		{ "bus-list", no_argument, NULL, 'B' },
+		{ "cache-file", required_argument, NULL, 'C' },
+		{ "watch", required_argument, NULL, 'W' },
+		{ "stats", no_argument, NULL, 'S' },
 		{ 0, 0, 0, 0 }
 	};
 
@@ -289,6 +463,7 @@ int main(int argc, char *argv[])
 	do_raw = 0;
 	do_json = 0;
 	do_sets = 0;
+	do_stats = 0;
 	do_bus_list = 0;
 	hide_adapter = 0;
 	while (1) {
@@ -327,6 +502,26 @@ int main(int argc, char *argv[])
 		case 'B':
 			do_bus_list = 1;
 			break;
+		case 'C':
+			sensors_set_cache_file(optarg);
+			break;
+		case 'S':
+			do_stats = 1;
+			break;
+		case 'W': {
+			char *end;
+
+			/* Shorter intervals would only spin */
+			watch_interval = strtod(optarg, &end);
+			if (end == optarg || *end ||
+			    !(watch_interval >= 0.001) ||
+			    watch_interval > 86400) {
+				fprintf(stderr, "Invalid watch interval `%s'\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		}
 		default:
 			fprintf(stderr,
 				"Internal error while parsing options!\n");
@@ -334,14 +529,49 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	err = read_config_file(config_file_name);
+	if (watch_interval && (do_sets || do_bus_list)) {
+		fprintf(stderr, "--watch can't be used with --set or "
+			"--bus-list\n");
+		exit(1);
+	}
+	if (do_stats && (do_json || do_bus_list)) {
+		fprintf(stderr, "--stats can't be used with -j or --bus-list\n");
+		exit(1);
+	}
+	compact_json = watch_interval && do_json;
+
+	err = read_config_file(config_file_name, optind == argc);
 	if (err)
 		exit(err);
 
 	/* build the degrees string */
 	set_degstr();
 
-	if (do_bus_list) {
+	if (watch_interval) {
+		sensors_chip_name *match;
+		int cnt = argc - optind;
+
+		match = malloc((cnt ? cnt : 1) * sizeof(sensors_chip_name));
+		if (!match) {
+			fprintf(stderr, "Out of memory\n");
+			err = 1;
+			goto exit;
+		}
+		for (i = 0; i < cnt; i++) {
+			if (sensors_parse_chip_name(argv[optind + i],
+						    &match[i])) {
+				fprintf(stderr,
+					"Parse error in chip name `%s'\n",
+					argv[optind + i]);
+				print_short_help();
+				exit(1);
+			}
+		}
+		err = do_watch(match, cnt);
+		for (i = 0; i < cnt; i++)
+			sensors_free_chip_name(&match[i]);
+		free(match);
+	} else if (do_bus_list) {
 		print_bus_list();
 	} else if (optind == argc) { /* No chip name on command line */
 		if (!do_the_real_work(NULL, &err)) {
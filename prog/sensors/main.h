@@ -23,5 +23,6 @@
 
 extern int fahrenheit;
 extern char degstr[5];
+extern int compact_json;	/* one line per record, for --watch */
 
 #endif /* PROG_SENSORS_MAIN_H */
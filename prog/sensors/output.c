@@ -0,0 +1,166 @@
+/*
+    output.c - Part of sensors, a user-space program for hardware monitoring
+    Copyright (C) 2026  lm-sensors contributors
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+    MA 02110-1301 USA.
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "output.h"
+
+static char *out_data;
+static size_t out_len, out_size;
+
+static char *out_reserve(size_t len)
+{
+	if (out_len + len > out_size) {
+		size_t size = out_size ? out_size : 4096;
+
+		while (size < out_len + len)
+			size *= 2;
+		out_data = realloc(out_data, size);
+		if (!out_data) {
+			fprintf(stderr, "ERROR: Out of memory\n");
+			exit(1);
+		}
+		out_size = size;
+	}
+	return out_data + out_len;
+}
+
+static void out_add(const char *s, size_t len)
+{
+	memcpy(out_reserve(len), s, len);
+	out_len += len;
+}
+
+void out_str(const char *s)
+{
+	out_add(s, strlen(s));
+}
+
+void out_char(char c)
+{
+	*out_reserve(1) = c;
+	out_len++;
+}
+
+/* New line and 3 spaces per level, nothing in compact json */
+void out_indent(int level)
+{
+	char *p;
+
+	if (compact_json)
+		return;
+	p = out_reserve(1 + 3 * level);
+	*p++ = '\n';
+	memset(p, ' ', 3 * level);
+	out_len += 1 + 3 * level;
+}
+
+/* Quoted and escaped as a json string, labels can contain anything */
+void out_json_str(const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *p;
+	char *q;
+
+	out_char('"');
+	for (p = (const unsigned char *) s; *p; p++) {
+		if (*p == '"' || *p == '\\') {
+			q = out_reserve(2);
+			q[0] = '\\';
+			q[1] = *p;
+			out_len += 2;
+		} else if (*p < 0x20) {
+			q = out_reserve(6);
+			memcpy(q, "\\u00", 4);
+			q[4] = hex[*p >> 4];
+			q[5] = hex[*p & 0xf];
+			out_len += 6;
+		} else {
+			out_char(*p);
+		}
+	}
+	out_char('"');
+}
+
+/* Same as printf("%.3f"), without going through printf for usual values */
+void out_number(double value)
+{
+	char digits[24], *p;
+	long long millis;
+	int i;
+
+	if (!(fabs(value) < 1e15)) {
+		snprintf(digits, sizeof(digits), "%.3f", value);
+		out_str(digits);
+		return;
+	}
+
+	millis = llround(value * 1000);
+	if (millis < 0) {
+		out_char('-');
+		millis = -millis;
+	}
+	p = digits + sizeof(digits);
+	for (i = 0; i < 4 || millis; i++) {
+		if (i == 3)
+			*--p = '.';
+		*--p = '0' + millis % 10;
+		millis /= 10;
+	}
+	out_add(p, digits + sizeof(digits) - p);
+}
+
+/* NaN and infinities aren't valid json numbers */
+void out_json_number(double value)
+{
+	if (isfinite(value))
+		out_number(value);
+	else
+		out_str("null");
+}
+
+/* Returns 0 on success, or -1 if stdout couldn't be written to */
+int out_flush(void)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	/* Keep the order of anything already printed with stdio */
+	fflush(stdout);
+
+	while (done < out_len) {
+		ret = write(STDOUT_FILENO, out_data + done, out_len - done);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			out_len = 0;
+			return -1;
+		}
+		done += ret;
+	}
+	out_len = 0;
+	return 0;
+}